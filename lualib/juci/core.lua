@@ -7,6 +7,8 @@ local table = require("table");
 local string = require("string"); 
 local io = require("io"); 
 local json = require("juci/json"); 
+local fs = require("juci/fs"); 
+local dirindex = require("juci/dirindex"); 
 
 local posix = require("posix.unistd"); 
 local sys = require("posix.sys.wait");
@@ -156,39 +158,52 @@ local session = {
 	end
 }
 ]]--
-local function dir_tree(src, obj)
-	local list = shell("find %s -type d | sort 2>/dev/null", src);
-	if(list == "") then return nil; end
-	local root = { }; 
-	for line in list:gmatch("[^\n\r]+") do
-		local parent = root; 
-		local path = "/";
-		for node in line:gmatch("[^/]+") do
-			path = path .. node .. "/"; 
-			if not parent[node] then 
-				parent[node] = { path = path, children = {} }; 
+local file = {
+	-- directories below the file roots (config files in jucid), served from the directory index of the server
+	folder_tree = function(opts)
+		opts = opts or {}; 
+		local tree = {}; 
+		for _,root in base.ipairs(dirindex.roots()) do
+			local children, truncated = dirindex.tree(root, opts.depth, opts.limit); 
+			if(children) then
+				-- a root is nested below the directories of its path like any other directory
+				local parent, path, node = tree, "/", nil; 
+				for name in root:gmatch("[^/]+") do
+					path = path..name.."/"; 
+					if(not parent[name]) then parent[name] = { path = path, children = {} }; end
+					node = parent[name]; 
+					parent = node.children; 
+				end
+				if(node) then
+					node.children = children; 
+					-- set on the entry of the root when directories were left out because of the limit or a full index
+					if(truncated) then node.truncated = true; end
+				else
+					for name,child in base.pairs(children) do tree[name] = child; end
+				end
 			end
-			parent = parent[node].children; 
 		end
-	end
-	return root; 
-end
-
-local file = {
-	folder_tree = function()
-		local tree = dir_tree("/mnt/");
-		return tree;
+		if(not base.next(tree)) then return nil; end
+		return tree; 
 	end,
+	-- completes an absolute path, or a path relative to each of the roots
 	autocomplete = function(opts)
 		if(type(opts.path) ~= "string") then
 			return 1;
 		end
-		opts.path = "/mnt/"..opts.path.."*";
-		local stdout = shell("find \"$(dirname %s)\" -name \"$(basename %s)\" -maxdepth 1 -type d | sed 's/^\\/mnt//g' 2>/dev/null | sed 's|$|/|g'", opts.path, opts.path);
 		local result = { folders = {} }
-		for line in stdout:gmatch("[^\r\n]+") do 
-			table.insert(result.folders, line); 
-		end 
+		-- the path is compared as a plain prefix, it never reaches fs.glob where * or [ would expand
+		if(opts.path:sub(1, 1) == "/") then
+			for _,path in base.ipairs(dirindex.complete(opts.path) or {}) do 
+				table.insert(result.folders, path); 
+			end
+			return result; 
+		end
+		for _,root in base.ipairs(dirindex.roots()) do
+			for _,path in base.ipairs(dirindex.complete(root..opts.path) or {}) do 
+				table.insert(result.folders, path:sub(#root)); 
+			end 
+		end
 		return result
 	end
 }
@@ -202,6 +217,7 @@ return {
 	exec = exec, 
 	ubus = jubus,
 	file = file,
+	fs = fs, 
 	createDownload = createDownload
 }; 
 
@@ -3,25 +3,19 @@
 -- This module is distributed under JUCI Genereal Public License as published
 -- at https://github.com/mkschreder/jucid/COPYING. See COPYING file for details. 
 
-local juci = require("juci/core"); 
+local net = require("juci/net"); 
 
 local function list_services(opts)
-	local netstat = juci.shell("netstat -nlp 2>/dev/null");
 	local services = {};  
-	for line in netstat:gmatch("[^\r\n]+") do
-		local proto, rq, sq, local_address, remote_address, state, process = line:match("([^%s]+)%s+([^%s]+)%s+([^%s]+)%s+([^%s]+)%s+([^%s]+)%s+([^%s]+)%s+([^%s]+)"); 
-		if(local_address) then 
-			local listen_ip, listen_port = local_address:match("([^:]+):(.*)"); 
-			local pid,path = process:match("(%d+)/(.*)"); 
-			table.insert(services, {
-				proto = proto, 
-				listen_ip = listen_ip, 
-				listen_port = listen_port, 
-				pid = pid, 
-				name = path,
-				state = state
-			}); 
-		end
+	for _,sock in ipairs(net.listening()) do
+		table.insert(services, {
+			proto = sock.proto, 
+			listen_ip = sock.local_address, 
+			listen_port = tostring(sock.local_port), 
+			pid = sock.pid and tostring(sock.pid), 
+			name = sock.name,
+			state = sock.state
+		}); 
 	end
 	return services; 
 end
@@ -4,12 +4,17 @@
 -- at https://github.com/mkschreder/jucid/COPYING. See COPYING file for details. 
 
 local juci = require("juci/core"); 
-local ubus = require("juci/ubus"); 
+local net = require("juci/net"); 
+local macdb = require("juci/macdb"); 
+local uci = require("juci/uci"); 
 
 -- parse out dhcp information 
 local function read_dhcp_info()
-	local conf = ubus.call("uci", "get", {config = "dhcp"}); 
-	local leasefile_path = (conf["dnsmasq"] or {})["leasefile"];
+	local leasefile_path = nil; 
+	uci.foreach("dhcp", "dnsmasq", function(s)
+		leasefile_path = s.leasefile; 
+		return false; 
+	end); 
 	local dhcp = {}; 
 	if(not leasefile_path) then leasefile_path = "/var/dhcp.leases"; end
 	local dhcp_leases = io.open(leasefile_path, "r");
@@ -63,30 +68,16 @@ local function read_arp_info()
 end 
 	
 local function read_ip6_clients()
-	local proc = io.popen("ip -6 neigh show"); 
 	local result = {}; 
-	local line = proc:read("*l");
-	while line do 
-		local ip,_,dev,_,mac,status = line:match("(%S+)%s+(%S+)%s+(%S+)%s+(%S+)%s+(%S+)%s+(%S+)"); 
-		-- some lines also contain "router" string in place of status. Maybe we should parse values as key/value pairs instead? 
-		local _,_,_,_,_,_,status2 = line:match("(%S+)%s+(%S+)%s+(%S+)%s+(%S+)%s+(%S+)%s+(%S+)%s+(%S+)"); 
-		local obj = {
-			ip6addr = ip, 
-			ip6status = status,
-			device = dev, 
-			macaddr = mac,
-			router = false 
-		};
-		if(status2) then 
-			if(status == "router") then
-				obj.router = true
-			end
-			obj.ip6status = status2; 
-		end
-		table.insert(result, obj); 
-		line = proc:read("*l"); 
+	for _,n in ipairs(net.neighbors("inet6")) do 
+		table.insert(result, {
+			ip6addr = n.addr, 
+			ip6status = n.state,
+			device = n.device, 
+			macaddr = n.macaddr,
+			router = n.router
+		}); 
 	end
-	proc:close(); 
 	return result; 
 end 
 
@@ -167,11 +158,16 @@ end
 local function network_list_connected_clients(opts)
 		local clients_map = read_clients(); 
 	local clients_list = {}; 
+	local macs = {}; 
 	for mac,cl in pairs(clients_map) do 
-		--local js = juci.shell("/usr/lib/rpcd/cgi/juci.macdb lookup '{\"mac\": \""..mac.."\"}'"); 
-		--cl.manufacturer = json.decode(js)["manufacturer"]; 
+		table.insert(macs, mac); 
 		table.insert(clients_list, cl); 
 	end
+	-- one lookup for all clients instead of one per client
+	local vendors = macdb.lookup(macs) or {}; 
+	for _,cl in ipairs(clients_list) do 
+		cl.manufacturer = vendors[cl.macaddr]; 
+	end
 	return clients_list; 
 end
 
@@ -6,6 +6,8 @@
 local juci = require("juci/core"); 
 
 local function ubus_call(o, m, opts)
+	-- the server keeps a connection to ubusd open for us
+	if UBUS then return UBUS.call(o, m, opts or {}); end
 	local params = json.encode(opts); 
 	if params == "[]" then params = '{}'; end; 
 	local result = juci.shell("ubus call "..o.." "..m.." '"..params.."'"); 
@@ -5,8 +5,10 @@
 
 local juci = require("juci/core"); 
 
+-- configs are read through the native UCI api of the server which caches
+-- them. The shell is only used when running outside of the server. 
 local function uci_load(config)
-	print("dump: "..config); 
+	if(UCI) then return UCI.get(config) or {}; end
 	local lines = juci:shell("uci show %s", config); 
 	local result = {}; 
 	for line in lines:gmatch("[^\r\n]+") do 
@@ -27,6 +29,27 @@ local function uci_load(config)
 	return result; 
 end
 
+local function uci_get(config, section, option)
+	if(UCI) then return UCI.get(config, section, option); end
+	local conf = uci_load(config); 
+	if(not section) then return conf; end
+	if(not conf[section]) then return nil; end
+	if(not option) then return conf[section]; end
+	return conf[section][option]; 
+end
+
+local function uci_foreach(config, kind, fn)
+	if(UCI) then return UCI.foreach(config, kind, fn); end
+	for _,s in pairs(uci_load(config)) do
+		if(not kind or s[".type"] == kind) then 
+			if(fn(s) == false) then break; end
+		end
+	end
+	return true; 
+end
+
 return {
-	["load"] = uci_load
+	["load"] = uci_load, 
+	["get"] = uci_get, 
+	["foreach"] = uci_foreach
 }; 
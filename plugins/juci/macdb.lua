@@ -5,21 +5,16 @@
 -- This module is distributed under GNU GPLv3 with additional permission for signed images.
 -- See LICENSE file for more details 
 
-local juci = require("juci/core"); 
+local macdb = require("juci/macdb"); 
 
+-- lookup({mac = "..."}) or lookup({macs = {...}}) for many addresses at once
 function macdb_lookup(opts)
 	local res = {}; 
-	local mac = ""; 
-	if(opts["mac"]) then mac = string.upper(opts["mac"]); end
-	local f = assert(io.open("/usr/share/macdb/db.txt", "r")); 
-	mac = string.gsub(mac, ":", ""); 
-	mac = mac:sub(0, 6);
-	local line = f:read("*l");  
-	while line do
-		if(line:sub(0, 6) == mac) then res["manufacturer"] = line:sub(8); break; end
-		line = f:read("*l"); 
+	if(type(opts["macs"]) == "table") then 
+		res["manufacturers"] = macdb.lookup(opts["macs"]) or {}; 
+	elseif(opts["mac"]) then 
+		res["manufacturer"] = macdb.lookup(opts["mac"]); 
 	end
-	f:close(); 
 	return res; 
 end
 
@@ -20,8 +20,8 @@ local function get_status(opts)
 	return result; 
 end
 
-local function folder_tree()
-	return juci.file.folder_tree();
+local function folder_tree(opts)
+	return juci.file.folder_tree(opts);
 end
 
 local function autocomplete(opts)
@@ -9,16 +9,9 @@ local juci = require("juci/core");
 local PATH = "/tmp/usbnets"
 
 function list_modems()
-	local data = juci.shell("ls /dev/tty*S*");
-	local modems = {};
-	for line in data:gmatch("[^\r\n]+") do
-		table.insert(modems, line);
-	end
+	local modems = juci.fs.glob("/dev/tty*S*") or {};
 	if next(modems) == nil then
-		data = juci.shell("ls /dev/tts/*");
-		for line in data:gmatch("[\r\n]+") do
-			table.insert(modems, line);
-		end
+		modems = juci.fs.glob("/dev/tts/*") or {};
 	end
 	return { modems = modems };
 end
@@ -7,6 +7,7 @@
 
 local juci = require("juci/core"); 
 local network = require("juci/network"); 
+local net = require("juci/net"); 
 
 local function fields(str)
 	local words = {}; 
@@ -35,21 +36,28 @@ local function network_status_arp()
 	return { clients = clients }; 
 end
 
+-- flags in the form that route prints them
+local function route_flags(r, host_len)
+	local flags = "U"; 
+	if(r.gateway) then flags = flags.."G"; end
+	if(r.prefixlen == host_len) then flags = flags.."H"; end
+	return flags; 
+end
+
 local function network_status_ipv4routes()
-	local output = juci.shell("route -n"); 
 	local routes = {}; 
-	for line in output:gmatch("[^\r\n]+") do 
-		local words = fields(line); 
-		if(words[1] and words[1]:match("%d.%d.%d.%d")) then 
+	for _,r in ipairs(net.routes("inet")) do 
+		-- route -n only shows the main table
+		if(r.table == "main" and r.type == "unicast") then 
 			table.insert(routes, {
-				destination = words[1], 
-				gateway = words[2], 
-				mask = words[3], 
-				flags = words[4],
-				metric = words[5], 
-				ref = words[6], 
-				use = words[7], 
-				iface = words[8]
+				destination = r.destination, 
+				gateway = r.gateway or "0.0.0.0", 
+				mask = r.mask, 
+				flags = route_flags(r, 32),
+				metric = tostring(r.metric), 
+				ref = "0", 
+				use = "0", 
+				iface = r.device
 			}); 
 		end
 	end
@@ -57,21 +65,17 @@ local function network_status_ipv4routes()
 end
 
 local function network_status_ipv6routes()
-	local output = juci.shell("route -A inet6"); 
 	local routes = {}; 
-	for line in output:gmatch("[^\r\n]+") do 
-		local words = fields(line); 
-		if(words[1] and words[1]:match("[%a:]+/%d+")) then 
-			table.insert(routes, {
-				destination = words[1], 
-				next_hop = words[2], 
-				flags = words[3], 
-				metric = words[4], 
-				ref = words[5], 
-				use = words[6], 
-				iface = words[7]
-			}); 
-		end
+	for _,r in ipairs(net.routes("inet6")) do 
+		table.insert(routes, {
+			destination = r.destination.."/"..r.prefixlen, 
+			next_hop = r.gateway or "::", 
+			flags = route_flags(r, 128), 
+			metric = tostring(r.metric), 
+			ref = "0", 
+			use = "0", 
+			iface = r.device
+		}); 
 	end
 	return { routes = routes }; 
 end
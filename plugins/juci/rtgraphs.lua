@@ -5,13 +5,12 @@
 -- This module is distributed under GNU GPLv3 with additional permission for signed images.
 -- See LICENSE file for more details. 
 
-local juci = require("juci/core"); 
-local json = require("juci/json"); 
+local bandwidth = require("juci/bandwidth"); 
 
+-- samples are taken by the server (see config bandwidth in /etc/config/jucid)
 local function bwc_get_graph(opts)
 	if(not opts.ethdevice) then return { error = "No device specified" }; end
-	local graph = juci.shell("luci-bwc -i %s 2>/dev/null", opts.ethdevice); 
-	return { graph = json.decode("["..graph.."]") }; 
+	return { graph = bandwidth.history(opts.ethdevice) or {} }; 
 end
 
 return {
@@ -8,8 +8,8 @@
 local juci = require("juci.core");
 local json = require("juci.json");
 
-local function folder_tree()
-	return juci.file.folder_tree();
+local function folder_tree(opts)
+	return juci.file.folder_tree(opts);
 end
 
 local function autocomplete(opts)
@@ -1,58 +1,39 @@
 #!/usr/bin/lua
 
 local juci = require("juci/core"); 
+local log = require("juci/log"); 
 
 function system_filesystems(opts)
 	local res = {}; 
 	local lines = {}; 
 	res["filesystems"] = lines; 
-	local stdout = juci.shell("df | tail -n+2"); 
-	for line in stdout:gmatch("[^\r\n]+") do 
-		local filesystem,total,used,free,percent,path = line:match("([^%s]*)%s*([^%s]*)%s*([^%s]*)%s*([^%s]*)%s*([^%s]*)%s*([^%s]*)%s*"); 
-		local obj = {
-			["filesystem"] = filesystem, 
-			["total"] = total, 
-			["used"] = used, 
-			["free"] = free,
-			["path"] = path
-		}; 
-		table.insert(lines, obj); 
+	-- same as df: sizes in kB of all mounts that have any blocks
+	for line in io.lines("/proc/mounts") do 
+		local filesystem,path = line:match("^(%S+)%s+(%S+)"); 
+		local st = path and juci.fs.statvfs((path:gsub("\\040", " "))); 
+		if(st and st.total > 0) then 
+			local obj = {
+				["filesystem"] = filesystem, 
+				["total"] = tostring(math.floor(st.total / 1024)), 
+				["used"] = tostring(math.floor(st.used / 1024)), 
+				["free"] = tostring(math.floor(st.available / 1024)),
+				["path"] = path
+			}; 
+			table.insert(lines, obj); 
+		end
 	end
 	return res; 
 end
 
+-- pass the returned cursor back to only get lines that were logged since
 function system_logread(opts)
-	local filter = opts.filter;
-	local type = opts.type;
-	local res = {}; 
-	local lines = {}; 
-	local limit = 20
-	res["lines"] = lines; 
-	local stdout;
-	if opts.limit then limit = opts.limit; end
-	if limit > 200 then limit = 200; end
-	-- TODO: change so that filter and limit is sent in insted of concatenated does not work with | now
-	if ((not filter or filter == "") and (not type or type == "")) then
-		stdout = juci.shell("logread | tail -n %d 2>/dev/null", limit); 
-	elseif (not filter or filter == "") then
-		stdout = juci.shell("logread | awk '{if($6~/"..type.."/) print($0)}' | tail -n %d 2>/dev/null", limit);
-	elseif(not type or type == "") then
-		stdout = juci.shell("logread | awk '{if($7~/"..filter.."/) print($0)}' | tail -n %d 2>/dev/null", limit);
-	else
-		stdout = juci.shell("logread | awk '{if($6~/"..type.."/ && $7~/"..filter.."/) print($0)}' | tail -n %d 2>/dev/null", limit); 
-	end
-	for line in stdout:gmatch("[^\r\n]+") do 
-		local date,type,source,message = line:match("([^%s]*%s+[^%s]*%s+[^%s]*%s+[^%s]*%s+[^%s]*)%s+([^%s]*)%s+([^%s:]*):%s+(.*)"); 
-		string.gsub(message, "\n", ""); 
-		local obj = {
-			["date"] = date, 
-			["type"] = type, 
-			["source"] = source, 
-			["message"] = message
-		}; 
-		table.insert(lines, obj); 
-	end
-	return res; 
+	local res = log.read({
+		type = opts.type, 
+		source = opts.filter, 
+		limit = opts.limit, 
+		cursor = opts.cursor
+	}); 
+	return res or { lines = {} }; 
 end
 
 function system_reboot()
@@ -6,38 +6,26 @@
 -- See LICENSE file for more details. 
 
 
-local juci = require("juci/core"); 
+local proc = require("juci/proc"); 
 
-function fields(inputstr, sep)
-	if sep == nil then
-					sep = "%s"
-	end
-	local t={} ; i=1
-	for str in string.gmatch(inputstr, "([^"..sep.."]+)") do
-					t[i] = str
-					i = i + 1
-	end
-	return t
-end
+-- columns in the order top prints them, which is what the ui shows
+local FIELDS = { "PID", "PPID", "USER", "STAT", "VSZ", "%VSZ", "%CPU", "COMMAND" }; 
 
 function process_list()
 	local res = {};  
+	res["fields"] = FIELDS; 
 	res["list"] = {}; 
-	local stdout = juci.shell("top -b -n1"); 
-	local lc = 0; 
-	for line in stdout:gmatch("[^\r\n]+") do 
-		local arr = fields(line, "%s"); 
-		if(line:match("%s+PID.*")) then 
-			res["fields"] = arr; 
-		elseif(line:match("%d+.*") and res.fields) then
-			local obj = {}; 
-			for i,col in ipairs(res.fields) do 
-				obj[col] = arr[i]; 
-			end 
-			table.insert(res.list, obj); 
-		end
-		lc = lc + 1; 
-		
+	for _,p in ipairs(proc.list() or {}) do 
+		table.insert(res.list, {
+			["PID"] = tostring(p.pid), 
+			["PPID"] = tostring(p.ppid), 
+			["USER"] = tostring(p.user), 
+			["STAT"] = p.state, 
+			["VSZ"] = tostring(p.vsz), 
+			["%VSZ"] = string.format("%d%%", math.floor(p.vsz_percent + 0.5)), 
+			["%CPU"] = string.format("%d%%", math.floor(p.cpu + 0.5)), 
+			["COMMAND"] = p.command
+		}); 
 	end
 	return res; 
 end
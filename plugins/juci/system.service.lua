@@ -11,22 +11,16 @@ local json = require("juci/json");
 local ubus = require("juci/ubus"); 
 
 local function list_dir(dir) 
-	local lines = juci.shell("ls %s",dir); 
 	local files = {}; 
-	for file in lines:gmatch("[^\r\n]+") do
-		table.insert(files, file); 
+	for _,ent in ipairs(juci.fs.list(dir) or {}) do
+		table.insert(files, ent.name); 
 	end
 	return files; 
 end
 
 local function is_service(service)
-	local files = list_dir("/etc/init.d/");
-	for _,file in ipairs(files) do
-		if(file == service) then
-			return true
-		end	
-	end		
-	return false
+	if(type(service) ~= "string" or service:find("/") or service:sub(1,1) == ".") then return false; end
+	return juci.fs.stat("/etc/init.d/"..service) ~= nil; 
 end
 
 local function service_list()
@@ -1,19 +1,18 @@
 #!/usr/bin/lua
 
-local ubus = require("juci/ubus"); 
+local uci = require("juci/uci"); 
 local json = require("juci/json"); 
 
 local function juci_menu()
 	local menu = {}; 
-	local data = ubus.call("uci", "get", { config = "juci", type = "menu" }); 
-	for _,s in pairs(data.values) do
+	uci.foreach("juci", "menu", function(s)
 		if(SESSION.access("menu", s.path or "-", s.page or "-", "r") and 
 			not SESSION.access("-menu", s.path or "-", s.page or "-", "r")) then 
 			menu[s[".name"]] = s; 
 		else 
-			print("access to menu "..s.path.." denied!"); 
+			print("access to menu "..(s.path or "-").." denied!"); 
 		end
-	end
+	end); 
 	return menu;
 end
 
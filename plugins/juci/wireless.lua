@@ -28,10 +28,9 @@ local ubus = require("juci/ubus");
 
 local function wireless_get_80211_device_names()
 	-- this will get list of devices that support phy80211 interface. 
-	local output = juci.shell("find /sys/class/net/**/*phy80211* 2> /dev/null | awk 'BEGIN{FS=\"/\"} { print $5 }'"); 
 	local devices = {}; 
-	for wldev in output:gmatch("[^\r\n]+") do   
-		table.insert(devices, wldev); 
+	for _,path in ipairs(juci.fs.glob("/sys/class/net/*/phy80211") or {}) do   
+		table.insert(devices, path:match("^/sys/class/net/([^/]+)/")); 
 	end
 	return devices; 
 end
@@ -18,9 +18,12 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <time.h>
 #include <glob.h>
+#include <fnmatch.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <shadow.h>
 #include <sys/types.h>
@@ -34,7 +37,11 @@
 #include "juci.h"
 #include "juci_luaobject.h"
 #include "juci_lua.h"
+#include "juci_logread.h"
+#include "juci_bwmon.h"
+#include "juci_dirindex.h"
 #include "juci_user.h"
+#include "juci_uci.h"
 
 #include "sha1.h"
 
@@ -42,7 +49,6 @@
 
 int juci_debug_level = 0; 
 
-int juci_load_passwords(struct juci *self, const char *pwfile); 
 int juci_load_plugins(struct juci *self, const char *path, const char *base_path){
     int rv = 0; 
     if(!base_path) base_path = path; 
@@ -73,84 +79,344 @@ int juci_load_plugins(struct juci *self, const char *path, const char *base_path
 			if(strcmp(ext, ".lua") != 0) continue; 
 			objname[len - strlen(ext)] = 0; 
 			INFO("loading plugin %s of %s at base %s\n", objname, fname, base_path); 
-			struct juci_luaobject *obj = juci_luaobject_new(objname); 
+			struct juci_luaobject *obj = juci_luaobject_new(objname, self->lua_host); 
 			if(juci_luaobject_load(obj, fname) != 0 || avl_insert(&self->objects, &obj->avl) != 0){
 				ERROR("ERR: could not load plugin %s\n", fname); 
 				juci_luaobject_delete(&obj); 
 				continue; 
 			}
-			juci_lua_publish_json_api(obj->lua); 
-			juci_lua_publish_file_api(obj->lua); 
-			juci_lua_publish_session_api(obj->lua); 
+			for(int c = 0; c < obj->num_methods; c++){
+				juci_dispatch_add(&self->dispatch, obj, &obj->methods[c]); 
+			}
 		}
     }
     closedir(dir); 
     return rv; 
 }
 
-// taken from rpcd source code (session.c)
+/*
+ * Settings from /etc/config/jucid. The file is loaded once and every
+ * section is handed to the loader of its type.
+ */
+struct _config {
+	struct juci *self; 
+	struct uci_context *uci; 
+	unsigned bwmon_interval, bwmon_history; 
+	int file_roots; 
+}; 
 
-static void _juci_user_load_acls(struct juci_user *self, struct uci_section *s){
-	struct uci_option *o;
-	struct uci_element *e, *l;
+/*
+ * Memory limits of plugins are configured as: 
+ * 
+ * config memlimit
+ *	option object 'juci/wireless*'	(pattern, defaults to all objects)
+ *	option soft '2048'		(KiB, full gc after a call that goes above it)
+ *	option hard '4096'		(KiB, allocations beyond it fail the call)
+ * 
+ * Later sections override earlier ones. 
+ */
+static void _config_memlimit(struct _config *cfg, struct uci_section *s){
+	struct juci *self = cfg->self; 
+	const char *pattern = uci_lookup_option_string(cfg->uci, s, "object"); 
+	const char *soft = uci_lookup_option_string(cfg->uci, s, "soft"); 
+	const char *hard = uci_lookup_option_string(cfg->uci, s, "hard"); 
+	if(!pattern) pattern = "*"; 
 
-	uci_foreach_element(&s->options, e){
-		o = uci_to_option(e);
+	size_t soft_bytes = (soft)?strtoul(soft, NULL, 10) * 1024:0; 
+	size_t hard_bytes = (hard)?strtoul(hard, NULL, 10) * 1024:0; 
 
-		if (o->type != UCI_TYPE_LIST)
-			continue;
+	// in shared mode the limits apply to the one state that all objects live in
+	if(self->lua_host){
+		if(fnmatch(pattern, self->lua_host->name, FNM_NOESCAPE) == 0)
+			juci_luaobject_set_memory_limits(self->lua_host, soft_bytes, hard_bytes); 
+		return; 
+	}
+
+	struct juci_luaobject *obj; 
+	avl_for_each_element(&self->objects, obj, avl){
+		if(fnmatch(pattern, obj->name, FNM_NOESCAPE) != 0) continue; 
+		TRACE("JUCI: memory limits for %s: soft %lu hard %lu\n", obj->name, (unsigned long)soft_bytes, (unsigned long)hard_bytes); 
+		juci_luaobject_set_memory_limits(obj, soft_bytes, hard_bytes); 
+	}
+}
 
-		if (strcmp(o->e.name, "acls"))
+/*
+ * Session timeouts are configured as: 
+ * 
+ * config session
+ *	option idle_timeout '1800'	(seconds without any access, 0 = never)
+ *	option absolute_timeout '0'	(seconds after login, 0 = never)
+ *	option snapshot '/var/run/revorpcd/sessions'	(file sessions are saved to, '' = off)
+ *	option snapshot_interval '60'	(seconds between saves)
+ */
+static void _config_session(struct _config *cfg, struct uci_section *s){
+	struct juci *self = cfg->self; 
+	const char *idle = uci_lookup_option_string(cfg->uci, s, "idle_timeout"); 
+	const char *absolute = uci_lookup_option_string(cfg->uci, s, "absolute_timeout"); 
+	const char *snapshot = uci_lookup_option_string(cfg->uci, s, "snapshot"); 
+	const char *interval = uci_lookup_option_string(cfg->uci, s, "snapshot_interval"); 
+	if(idle) self->session_idle_timeout = strtoul(idle, NULL, 10); 
+	if(absolute) self->session_absolute_timeout = strtoul(absolute, NULL, 10); 
+	if(snapshot){
+		free(self->session_snapshot); 
+		self->session_snapshot = (*snapshot)?strdup(snapshot):NULL; 
+	}
+	if(interval) self->session_snapshot_interval = strtoul(interval, NULL, 10); 
+}
+
+/*
+ * The interface bandwidth sampler is configured as: 
+ * 
+ * config bandwidth
+ *	option interval '1'	(seconds between samples, 0 = off)
+ *	option history '120'	(samples kept for each interface)
+ */
+static void _config_bandwidth(struct _config *cfg, struct uci_section *s){
+	const char *interval = uci_lookup_option_string(cfg->uci, s, "interval"); 
+	const char *history = uci_lookup_option_string(cfg->uci, s, "history"); 
+	if(interval) cfg->bwmon_interval = strtoul(interval, NULL, 10); 
+	if(history) cfg->bwmon_history = strtoul(history, NULL, 10); 
+}
+
+/*
+ * The directories that file browser queries may look into are configured as: 
+ * 
+ * config files
+ *	list root '/mnt'	(defaults to /mnt)
+ */
+static void _config_files(struct _config *cfg, struct uci_section *s){
+	struct uci_element *o, *l; 
+
+	uci_foreach_element(&s->options, o){
+		struct uci_option *opt = uci_to_option(o); 
+
+		if (opt->type != UCI_TYPE_LIST || strcmp(opt->e.name, "root"))
 			continue;
-		
-		uci_foreach_element(&o->v.list, l) {
-			juci_user_add_acl(self, l->name); 
+
+		uci_foreach_element(&opt->v.list, l) {
+			int ret = juci_dirindex_add_root(l->name); 
+			if(ret == 0) cfg->file_roots++; 
+			else ERROR("could not add file root %s: %s\n", l->name, strerror(-ret)); 
 		}
 	}
 }
 
-static bool _juci_load_users(struct juci *self){
+/*
+ * Rate limits are configured as: 
+ * 
+ * config ratelimit
+ *	option object 'juci/system'	(pattern, defaults to all objects)
+ *	option method 'process_list'	(pattern, defaults to all methods)
+ *	option scope 'session'		(session, user or global)
+ *	option rate '1'			(calls per second, may be fractional)
+ *	option burst '5'		(calls allowed at once, defaults to one second worth)
+ * 
+ * Every matching rule has to allow a call. 
+ */
+static void _config_ratelimit(struct _config *cfg, struct uci_section *s){
+	struct juci *self = cfg->self; 
+	const char *object = uci_lookup_option_string(cfg->uci, s, "object"); 
+	const char *method = uci_lookup_option_string(cfg->uci, s, "method"); 
+	const char *scope_name = uci_lookup_option_string(cfg->uci, s, "scope"); 
+	const char *rate = uci_lookup_option_string(cfg->uci, s, "rate"); 
+	const char *burst = uci_lookup_option_string(cfg->uci, s, "burst"); 
+	enum juci_ratelimit_scope scope = JUCI_RATELIMIT_SESSION; 
+
+	if(scope_name && juci_ratelimit_parse_scope(scope_name, &scope) < 0){
+		ERROR("invalid rate limit scope %s\n", scope_name); 
+		return; 
+	}
+	if(!rate || juci_ratelimit_add_rule(&self->ratelimit, object, method, scope, strtod(rate, NULL), (burst)?strtoul(burst, NULL, 10):0) < 0){
+		ERROR("invalid rate limit for %s %s\n", (object)?object:"*", (method)?method:"*"); 
+	}
+}
+
+static const struct {
+	const char *type; 
+	void (*load)(struct _config *cfg, struct uci_section *s); 
+} _config_sections[] = {
+	{ "memlimit", _config_memlimit }, 
+	{ "session", _config_session }, 
+	{ "bandwidth", _config_bandwidth }, 
+	{ "files", _config_files }, 
+	{ "ratelimit", _config_ratelimit }
+}; 
+
+// applies the defaults and then the sections of jucid. Memory limits need the plugins to be loaded.
+static void _juci_load_config(struct juci *self){
+	struct _config cfg = { .self = self, .bwmon_interval = JUCI_BWMON_INTERVAL, .bwmon_history = JUCI_BWMON_HISTORY }; 
 	struct uci_package *p = NULL;
-	struct uci_section *s;
 	struct uci_element *e;
-	struct uci_ptr ptr = { .package = "jucid" };
-	struct uci_context *uci = uci_alloc_context(); 
 
-	uci_load(uci, ptr.package, &p);
+	self->session_idle_timeout = JUCI_SESSION_IDLE_TIMEOUT; 
+	self->session_absolute_timeout = JUCI_SESSION_ABSOLUTE_TIMEOUT; 
+	self->session_snapshot = strdup(JUCI_SESSION_SNAPSHOT_PATH); 
+	self->session_snapshot_interval = JUCI_SESSION_SNAPSHOT_INTERVAL; 
+	juci_dirindex_clear_roots(); 
 
-	if (!p)
-		return false;
+	cfg.uci = uci_alloc_context(); 
+	uci_load(cfg.uci, "jucid", &p);
 
-	uci_foreach_element(&p->sections, e)
-	{
-		s = uci_to_section(e);
+	if (p) {
+		uci_foreach_element(&p->sections, e){
+			struct uci_section *s = uci_to_section(e);
 
-		if (strcmp(s->type, "login"))
-			continue;
-		
-		struct juci_user *user = juci_user_new(s->e.name); 
+			for(int c = 0; c < sizeof(_config_sections) / sizeof(_config_sections[0]); c++){
+				if(strcmp(s->type, _config_sections[c].type) == 0) _config_sections[c].load(&cfg, s); 
+			}
+		}
+	}
 
-		_juci_user_load_acls(user, s); 
-		
-		TRACE("JUCI: loaded user config for user '%s'\n", s->e.name); 
+	juci_bwmon_configure(cfg.bwmon_interval, cfg.bwmon_history); 
+	if(!cfg.file_roots) juci_dirindex_add_root("/mnt"); 
+	uci_free_context(cfg.uci); 
+}
 
-		avl_insert(&self->users, &user->avl); 
+static uint64_t _monotonic_ms(void){
+	struct timespec ts; 
+	clock_gettime(CLOCK_MONOTONIC, &ts); 
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000; 
+}
+
+static uint64_t _monotonic_sec(void){
+	struct timespec ts; 
+	clock_gettime(CLOCK_MONOTONIC, &ts); 
+	return ts.tv_sec; 
+}
+
+// time at which the session expires if it is not accessed again (0 = never)
+static uint64_t _session_deadline(struct juci *self, struct juci_session *ses){
+	uint64_t deadline = 0; 
+	if(self->session_idle_timeout) deadline = juci_session_last_access(ses) + self->session_idle_timeout; 
+	if(self->session_absolute_timeout){
+		uint64_t abs = ses->created + self->session_absolute_timeout; 
+		if(!deadline || abs < deadline) deadline = abs; 
 	}
+	return deadline; 
+}
+
+static void _session_expire(struct juci *self, struct juci_session *ses){
+	DEBUG("session %s of user %s expired\n", ses->sid, ses->user->username); 
+	if(!list_empty(&ses->timer.list)) juci_timer_wheel_del(&self->session_timers, &ses->timer); 
+	juci_session_store_remove(&self->sessions, ses->id); 
+	self->sessions_expired++; 
+	self->sessions_dirty = true; 
+}
+
+static int _session_add(struct juci *self, struct juci_session *ses){
+	if(juci_session_store_insert(&self->sessions, ses) != 0) return -EEXIST; 
+	uint64_t deadline = _session_deadline(self, ses); 
+	if(deadline) juci_timer_wheel_add(&self->session_timers, &ses->timer, deadline); 
+	self->sessions_dirty = true; 
+	return 0; 
+}
+
+static struct juci_acl_set *_get_role(struct juci *self, struct juci_user *user); 
+
+/*
+ * Recreates the sessions of a snapshot. Times in the snapshot are relative
+ * to when it was written, so the time that passed since then is added to
+ * them. Sessions of users that no longer exist or whose acl list has
+ * changed are dropped. 
+ */
+static int _juci_restore_sessions(struct juci *self, struct juci_session_snapshot *snap){
+	int restored = 0; 
+	int64_t gap = juci_session_snapshot_age(snap); 
+	// boot time of the snapshot says nothing about how long ago it was taken
+	if(gap < 0) return 0; 
 
-	uci_free_context(uci); 
+	for(uint32_t c = 0; c < snap->header->count; c++){
+		const struct juci_session_snapshot_record *r = &snap->records[c]; 
+		const char *username = juci_session_snapshot_string(snap, r->user); 
+		const char *rolename = juci_session_snapshot_string(snap, r->role); 
+		if(!username || !rolename) continue; 
+
+		uint64_t age = r->age + gap, idle = r->idle + gap; 
+		if(age > self->now || idle > self->now) continue; 
+
+		// a session can be in both the snapshot file and a handoff from a running instance
+		struct juci_session *existing = juci_session_store_find(&self->sessions, r->id); 
+		if(existing){
+			if(self->now - idle > juci_session_last_access(existing)) juci_session_touch(existing, self->now - idle); 
+			continue; 
+		}
+
+		struct juci_user *user = juci_credentials_find_user(self->credentials, username); 
+		if(!user) continue; 
+		struct juci_acl_set *role = _get_role(self, user); 
+		if(strcmp(role->name, rolename) != 0) continue; 
+
+		struct juci_session *ses = juci_session_new_with_id(user, r->id); 
+		juci_session_set_role(ses, role); 
+		ses->created = self->now - age; 
+		juci_session_touch(ses, self->now - idle); 
+		uint64_t deadline = _session_deadline(self, ses); 
+		if((deadline && deadline <= self->now) || _session_add(self, ses) != 0){
+			juci_session_delete(&ses); 
+			continue; 
+		}
+		restored++; 
+	}
+	return restored; 
+}
 
-	return true; 
+static void _juci_load_sessions(struct juci *self){
+	struct juci_session_snapshot snap; 
+	if(!self->session_snapshot) return; 
+	if(juci_session_snapshot_open(&snap, self->session_snapshot) < 0) return; 
+	self->sessions_restored = _juci_restore_sessions(self, &snap); 
+	juci_session_snapshot_close(&snap); 
+	INFO("restored %lu sessions from %s\n", self->sessions_restored, self->session_snapshot); 
 }
 
-struct juci* juci_new(const char *plugin_path, const char *pwfile){
+static void _juci_save_sessions(struct juci *self){
+	if(!self->session_snapshot) return; 
+	int ret = juci_session_snapshot_save(self->session_snapshot, &self->sessions, self->now); 
+	if(ret < 0) ERROR("could not save sessions to %s: %s\n", self->session_snapshot, strerror(-ret)); 
+	self->sessions_dirty = false; 
+}
+
+int juci_export_sessions(struct juci *self, int fd){
+	int ret = juci_session_snapshot_write(fd, &self->sessions, self->now); 
+	if(ret < 0) return ret; 
+	if(lseek(fd, 0, SEEK_SET) != 0) return -errno; 
+	return 0; 
+}
+
+int juci_import_sessions(struct juci *self, int fd){
+	struct juci_session_snapshot snap; 
+	int ret = juci_session_snapshot_open_fd(&snap, fd); 
+	if(ret < 0) return ret; 
+	ret = _juci_restore_sessions(self, &snap); 
+	juci_session_snapshot_close(&snap); 
+	self->sessions_restored += ret; 
+	INFO("took over %d sessions\n", ret); 
+	return ret; 
+}
+
+void juci_stop_session_snapshots(struct juci *self){
+	free(self->session_snapshot); 
+	self->session_snapshot = NULL; 
+}
+
+struct juci* juci_new(const char *plugin_path, const char *pwfile, int flags){
 	struct juci *self = calloc(1, sizeof(struct juci)); 
 	assert(self); 
+	self->flags = flags; 
 	avl_init(&self->objects, avl_strcmp, false, NULL); 
-	avl_init(&self->sessions, avl_strcmp, false, NULL); 
-	avl_init(&self->users, avl_strcmp, false, NULL); 
+	juci_dispatch_init(&self->dispatch); 
+	juci_session_store_init(&self->sessions); 
+	self->session_reader = juci_session_store_reader_register(&self->sessions); 
+	assert(self->session_reader >= 0); 
+	avl_init(&self->roles, avl_strcmp, false, NULL); 
+	self->now = _monotonic_sec(); 
+	juci_timer_wheel_init(&self->session_timers, self->now); 
+	juci_ratelimit_init(&self->ratelimit); 
+	self->ratelimit_sweep_next = self->now + JUCI_RATELIMIT_SWEEP_INTERVAL; 
+	juci_ratelimit_init(&self->login_limit); 
+	juci_ratelimit_add_rule(&self->login_limit, "login", "*", JUCI_RATELIMIT_USER, JUCI_LOGIN_FAILURE_RATE, JUCI_LOGIN_FAILURE_BURST); 
+	juci_events_init(&self->events); 
 
-	// TODO: load users from config file
-	_juci_load_users(self); 
 	/*
 	struct juci_user *admin = juci_user_new("admin"); 
 	juci_user_add_acl(admin, "juci*"); 
@@ -165,10 +431,15 @@ struct juci* juci_new(const char *plugin_path, const char *pwfile){
 	self->plugin_path = strdup(plugin_path); 
 	self->pwfile = strdup(pwfile); 
 
-	if(juci_load_passwords(self, self->pwfile) != 0){
-		ERROR("could not load password file from %s\n", pwfile); 
+	self->credentials = juci_credentials_new(self->pwfile); 
+	if(self->flags & JUCI_FLAG_SHARED_LUA){
+		// all plugins are loaded into environments inside this one state
+		self->lua_host = juci_luaobject_new(JUCI_SHARED_LUA_NAME, NULL); 
 	}
 	juci_load_plugins(self, self->plugin_path, NULL); 
+	_juci_load_config(self); 
+	_juci_load_sessions(self); 
+	self->session_snapshot_next = self->now + self->session_snapshot_interval; 
 	
 
 	return self; 
@@ -177,17 +448,31 @@ struct juci* juci_new(const char *plugin_path, const char *pwfile){
 void juci_delete(struct juci **_self){
 	struct juci *self = *_self; 
 	struct juci_luaobject *obj, *nobj;
-    struct juci_session *ses, *nses;
-    struct juci_user *user, *nuser;
+	struct juci_acl_set *role, *nrole; 
 
+	juci_dispatch_free(&self->dispatch); 
 	avl_remove_all_elements(&self->objects, obj, avl, nobj)
 		juci_luaobject_delete(&obj); 
 
-    avl_remove_all_elements(&self->sessions, ses, avl, nses)
-		juci_session_delete(&ses); 
+	if(self->lua_host) juci_luaobject_delete(&self->lua_host); 
+
+	// saved on exit so that sessions survive a restart
+	_juci_save_sessions(self); 
+	juci_session_store_free(&self->sessions); 
+	free(self->session_snapshot); 
+
+	avl_remove_all_elements(&self->roles, role, avl, nrole)
+		juci_acl_set_unref(&role); 
+
+	juci_ratelimit_free(&self->ratelimit); 
+	juci_ratelimit_free(&self->login_limit); 
+	juci_events_free(&self->events); 
+	if(self->netwatch){
+		juci_netwatch_free(self->netwatch); 
+		free(self->netwatch); 
+	}
 
-    avl_remove_all_elements(&self->users, user, avl, nuser)
-		juci_user_delete(&user); 
+	juci_credentials_delete(&self->credentials); 
 	
 	free(self->pwfile); 
 	free(self->plugin_path); 
@@ -209,73 +494,104 @@ static char *_load_file(const char *path){
 	return text; 
 }
 
-int juci_load_passwords(struct juci *self, const char *pwfile){
-	DEBUG("loading passwords from %s\n", pwfile); 
-	char *passwords = _load_file(pwfile); 
-	if(!passwords) return -EACCES; 
-	char *cur = passwords; 
-	char user[32], hash[64]; 
-	while(sscanf(cur, "%s %s", user, hash) == 2){	
-		struct avl_node *node = avl_find(&self->users, user); 
-		if(node){
-			struct juci_user *user = container_of(node, struct juci_user, avl); 
-			if(user){
-				juci_user_set_pw_hash(user, hash); 
-			}
-		}
-		while(*cur != '\n' && *cur) cur++; 
-		while(*cur == '\n') cur++; 
-		if(*cur == 0) break; 
+// finds a session without counting it as used
+static struct juci_session* _peek_session(struct juci *self, const char *sid){
+	uint8_t id[JUCI_SESSION_ID_SIZE]; 
+	if(juci_session_parse_sid(sid, id) < 0) return NULL; 
+	struct juci_session *ses = juci_session_store_find(&self->sessions, id); 
+	if(!ses) return NULL; 
+	// the timer may not have fired yet for a session that is already past its deadline
+	uint64_t deadline = _session_deadline(self, ses); 
+	if(deadline && deadline <= self->now) {
+		_session_expire(self, ses); 
+		return NULL; 
 	}
-	free(passwords); 
-	return 0; 
+	return ses; 
 }
 
 static struct juci_session* _find_session(struct juci *self, const char *sid){
-	if(!sid || strlen(sid) == 0) return NULL; 
-	struct avl_node *id = avl_find(&self->sessions, sid); 	
-	if(!id) return NULL;  
-	return container_of(id, struct juci_session, avl); 
+	struct juci_session *ses = _peek_session(self, sid); 
+	if(!ses) return NULL; 
+	// touching only stores the time. The expiry timer is moved when it fires.
+	juci_session_touch(ses, self->now); 
+	return ses; 
 }
 
-static bool _try_auth(const char *sha1hash, const char *challenge, const char *response){
-	DEBUG("trying to authenticate hash %s using challenge %s and response %s\n", sha1hash, challenge, response); 
-	if(!sha1hash) return false; 
-	
-	unsigned char binhash[SHA1_BLOCK_SIZE+1] = {0}; 
+// expected response to a challenge is sha1(challenge + password hash)
+static void _auth_digest(const char *sha1hash, const char *challenge, unsigned char digest[SHA1_BLOCK_SIZE]){
 	SHA1_CTX ctx; 
 	sha1_init(&ctx); 
 	sha1_update(&ctx, (const unsigned char*)challenge, strlen(challenge)); 
 	sha1_update(&ctx, (const unsigned char*)sha1hash, strlen(sha1hash)); 
-	sha1_final(&ctx, binhash); 
-	char hash[64] = {0}; 
-	for(int c = 0; c < SHA1_BLOCK_SIZE; c++) sprintf(hash + (c * 2), "%02x", binhash[c]); 
+	sha1_final(&ctx, digest); 
+}
+
+static inline int _hex_nibble(char ch){
+	if(ch >= '0' && ch <= '9') return ch - '0'; 
+	if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10; 
+	if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10; 
+	return -1; 
+}
+
+// decodes a hex digest from the client. Returns false if it is not one.
+static bool _parse_response(const char *response, unsigned char digest[SHA1_BLOCK_SIZE]){
+	for(int c = 0; c < SHA1_BLOCK_SIZE; c++){
+		int hi = _hex_nibble(response[c * 2]); 
+		if(hi < 0) return false; 
+		int lo = _hex_nibble(response[c * 2 + 1]); 
+		if(lo < 0) return false; 
+		digest[c] = (hi << 4) | lo; 
+	}
+	return response[SHA1_BLOCK_SIZE * 2] == 0; 
+}
+
+// compares in time that does not depend on where the digests differ
+static bool _digest_equal(const unsigned char *a, const unsigned char *b){
+	unsigned char diff = 0; 
+	for(int c = 0; c < SHA1_BLOCK_SIZE; c++) diff |= a[c] ^ b[c]; 
+	return diff == 0; 
+}
 
-	DEBUG("authenticating against digest %s\n", hash); 
-	return !strcmp((const char*)hash, response); 
+static bool _try_auth(const char *sha1hash, const char *challenge, const char *response){
+	DEBUG("trying to authenticate using challenge %s\n", challenge); 
+	if(!sha1hash || !response) return false; 
+	
+	unsigned char expected[SHA1_BLOCK_SIZE], received[SHA1_BLOCK_SIZE]; 
+	if(!_parse_response(response, received)) return false; 
+	_auth_digest(sha1hash, challenge, expected); 
+	return _digest_equal(expected, received); 
 }
 
-int _load_session_acls(struct juci_session *ses, const char *pat){
+static const char *_acl_dir(void){
+	const char *dir = getenv("JUCI_ACL_DIR_PATH"); 
+	return (dir)?dir:JUCI_ACL_DIR_PATH; 
+}
+
+static int _load_role_acls(struct juci_acl_set *role, const char *pat){
 	glob_t glob_result;
 	char path[255]; 
-	char *dir = getenv("JUCI_ACL_DIR_PATH"); 
-	if(!dir) dir = JUCI_ACL_DIR_PATH; 
+	const char *dir = _acl_dir(); 
 	DEBUG("loading acls from %s/%s.acl\n", dir, pat); 
 	snprintf(path, sizeof(path), "%s/%s.acl", dir, pat); 
 	glob(path, GLOB_TILDE, NULL, &glob_result);
 	for(unsigned int i=0;i<glob_result.gl_pathc;++i){
 		char *text = _load_file(glob_result.gl_pathv[i]); 
+		// the file may have been removed since the glob, for example by a package upgrade
+		if(!text){
+			ERROR("could not read %s\n", glob_result.gl_pathv[i]); 
+			continue; 
+		}
 		char *cur = text; 	
 		char scope[255], object[255], method[255], perm[32]; 
 		int line = 1; 
 		while(true){	
 			int ret = sscanf(cur, "%s %s %s %s", scope, object, method, perm); 
 			if(ret == 4 && scope[0] == '!'){
-				DEBUG("revoking session acl '%s %s %s %s'\n", scope + 1, object, method, perm); 
-				juci_session_revoke(ses, scope + 1, object, method, perm); 
+				DEBUG("revoking role acl '%s %s %s %s'\n", scope + 1, object, method, perm); 
+				juci_acl_set_revoke(role, scope + 1, object, method); 
 			} else if(ret == 4){
-				DEBUG("granting session acl '%s %s %s %s'\n", scope, object, method, perm); 
-				juci_session_grant(ses, scope, object, method, perm); 
+				DEBUG("granting role acl '%s %s %s %s'\n", scope, object, method, perm); 
+				juci_acl_set_grant(role, scope, object, method, perm); 
 			} else {
 				ERROR("parse error on line %d of %s, scanned %d fields\n", line, glob_result.gl_pathv[i], ret); 	
 			} 
@@ -290,56 +606,240 @@ int _load_session_acls(struct juci_session *ses, const char *pat){
 	return 0; 
 }
 
-struct juci_session *juci_find_session(struct juci *self, const char *sid){ 
-	return _find_session(self, sid); 
+/*
+ * Users with the same list of acl names share one compiled acl set. The set
+ * is built the first time a user with that list logs in and stays cached
+ * until the acl files change (see _refresh_roles). 
+ */
+static struct juci_acl_set *_get_role(struct juci *self, struct juci_user *user){
+	struct juci_user_acl *acl; 
+	size_t len = 1; 
+	juci_user_for_each_acl(user, acl) len += strlen(acl->avl.key) + 1; 
+	char *key = alloca(len); 
+	key[0] = 0; 
+	juci_user_for_each_acl(user, acl){
+		if(key[0]) strcat(key, " "); 
+		strcat(key, acl->avl.key); 
+	}
+
+	struct juci_acl_set *role = avl_find_element(&self->roles, key, role, avl); 
+	if(role) return role; 
+
+	role = juci_acl_set_new(key); 
+	juci_user_for_each_acl(user, acl){
+		_load_role_acls(role, acl->avl.key); 
+	}
+	juci_acl_set_compile(role); 
+	avl_insert(&self->roles, &role->avl); 
+	return role; 
 }
 
-int juci_login(struct juci *self, const char *username, const char *challenge, const char *response, const char **new_sid){
-	struct avl_node *node = avl_find(&self->users, username); 
-	if(!node) return -EINVAL; 
-	struct juci_user *user = container_of(node, struct juci_user, avl); 
-	// update user hashes (TODO: perhaps this should be loaded into secure memory somehow and discarded after login?)
-	juci_load_passwords(self, self->pwfile); 
+// fnv-1a over the names, sizes and modification times of all acl files
+static uint64_t _acl_stamp(void){
+	char pattern[255]; 
+	glob_t gl; 
+	uint64_t h = 14695981039346656037ull; 
 
-	if(_try_auth(user->pwhash, challenge, response)){
-		struct juci_session *ses = juci_session_new(user); 	
-		struct juci_user_acl *acl; 
-		juci_user_for_each_acl(user, acl){
-			_load_session_acls(ses, acl->avl.key); 
+	snprintf(pattern, sizeof(pattern), "%s/*.acl", _acl_dir()); 
+	memset(&gl, 0, sizeof(gl)); 
+	if(glob(pattern, 0, NULL, &gl) == 0){
+		for(size_t c = 0; c < gl.gl_pathc; c++){
+			struct stat st; 
+			if(stat(gl.gl_pathv[c], &st) != 0) continue; 
+			uint64_t v[4] = { st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec }; 
+			const unsigned char *p = (const unsigned char*)gl.gl_pathv[c]; 
+			for(; *p; p++) h = (h ^ *p) * 1099511628211ull; 
+			for(size_t i = 0; i < sizeof(v); i++) h = (h ^ ((const unsigned char*)v)[i]) * 1099511628211ull; 
 		}
+	}
+	globfree(&gl); 
+	return h; 
+}
+
+/*
+ * Drops the compiled acl sets when any acl file has been added, removed or
+ * edited and gives every live session the set built from the new files, so
+ * that revoked permissions do not outlive the change. 
+ */
+static void _refresh_roles(struct juci *self){
+	struct juci_acl_set *role, *nrole; 
+	struct juci_session *ses; 
+	int shard, bucket; 
+
+	uint64_t stamp = _acl_stamp(); 
+	if(stamp == self->acl_stamp) return; 
+	self->acl_stamp = stamp; 
+	if(!self->roles.count) return; 
+
+	DEBUG("acl files changed, recompiling roles\n"); 
+	avl_remove_all_elements(&self->roles, role, avl, nrole)
+		juci_acl_set_unref(&role); 
+	juci_session_store_for_each(&self->sessions, shard, bucket, ses){
+		juci_session_set_role(ses, _get_role(self, ses->user)); 
+	}
+	self->role_reloads++; 
+}
+
+struct juci_session *juci_find_session(struct juci *self, const char *sid){ 
+	return _find_session(self, sid); 
+}
+
+static int _create_session(struct juci *self, struct juci_user *user, const char **new_sid){
+	// sessions of users with the same acls share one compiled acl set
+	struct juci_acl_set *role = _get_role(self, user); 
+	struct juci_session *ses = juci_session_new(user); 	
+	if(!ses) return -EIO; 
+	juci_session_set_role(ses, role); 
+	if(juci_debug_level >= JUCI_DBG_DEBUG){
 		struct blob buf; 
 		blob_init(&buf, 0, 0); 
 		juci_session_to_blob(ses, &buf); 
 		blob_dump_json(&buf); 
 		blob_free(&buf); 
-		if(avl_insert(&self->sessions, &ses->avl) != 0){
-			juci_session_delete(&ses); 
-			return -EINVAL; 
-		}
-		*new_sid = ses->sid; 
-		return 0; 
-	} else {
-		DEBUG("login failed for %s!\n", username); 
 	}
+	ses->created = self->now; 
+	juci_session_touch(ses, self->now); 
+	if(_session_add(self, ses) != 0){
+		juci_session_delete(&ses); 
+		return -EINVAL; 
+	}
+	*new_sid = ses->sid; 
+	return 0; 
+}
+
+/*
+ * Only failed logins take a token from the bucket of the user, so a user that
+ * knows the password is never slowed down while guessing it is. Unknown users
+ * have no password to guess and are not counted so that the buckets can not
+ * be used to fill up memory. 
+ */
+static int _login_throttled(struct juci *self, struct juci_user *user, uint64_t now_ms, uint32_t *retry_ms){
+	return juci_ratelimit_peek(&self->login_limit, NULL, user->username, "login", "", now_ms, retry_ms); 
+}
+
+static void _login_failed(struct juci *self, struct juci_user *user, uint64_t now_ms){
+	DEBUG("login failed for %s!\n", user->username); 
+	juci_ratelimit_charge(&self->login_limit, NULL, user->username, "login", "", now_ms); 
+	self->login_failures++; 
+}
+
+int juci_login(struct juci *self, const char *username, const char *challenge, const char *response, const char **new_sid){
+	// the user table is only parsed again if the files behind it have changed
+	juci_credentials_refresh(self->credentials); 
+	_refresh_roles(self); 
+	struct juci_user *user = juci_credentials_lookup(self->credentials, username); 
+	if(!user) return -EINVAL; 
+
+	self->retry_after = 0; 
+	uint64_t now_ms = _monotonic_ms(); 
+	if(_login_throttled(self, user, now_ms, &self->retry_after) < 0) return -EAGAIN; 
+	if(_try_auth(user->pwhash, challenge, response)){
+		return _create_session(self, user, new_sid); 
+	}
+	_login_failed(self, user, now_ms); 
 	return -EACCES; 
 }
 
+/*
+ * Authenticates a list of [username, response] pairs against one challenge
+ * and writes an array with one result per pair. Credentials are checked for
+ * changes once per batch and the expected digest of each user is computed
+ * only once even if the user appears many times. After the first wrong
+ * response for a user the remaining pairs of that user fail without being
+ * checked, so a batch tries at most one password per user. 
+ */
+int juci_login_batch(struct juci *self, const char *challenge, struct blob_field *logins, struct blob *out){
+	struct {
+		struct juci_user *user; 
+		unsigned char digest[SHA1_BLOCK_SIZE]; 
+		bool failed; 
+	} seen[JUCI_LOGIN_BATCH_MAX]; 
+	int num_seen = 0, pairs = 0, count = 0; 
+	struct blob_field *pair; 
+
+	blob_field_for_each_child(logins, pair) pairs++; 
+	if(pairs > JUCI_LOGIN_BATCH_MAX) return -E2BIG; 
+
+	juci_credentials_refresh(self->credentials); 
+	_refresh_roles(self); 
+	uint64_t now_ms = _monotonic_ms(); 
+
+	blob_offset_t a = blob_open_array(out); 
+	blob_field_for_each_child(logins, pair){
+		const char *username = NULL, *response = NULL, *sid = NULL; 
+		struct blob_field *f = blob_field_first_child(pair); 
+		if(f && blob_field_type(f) == BLOB_FIELD_STRING){
+			username = blob_field_get_string(f); 
+			f = blob_field_next_child(pair, f); 
+			if(f && blob_field_type(f) == BLOB_FIELD_STRING) response = blob_field_get_string(f); 
+		}
+
+		unsigned char received[SHA1_BLOCK_SIZE]; 
+		struct juci_user *user = (username)?juci_credentials_lookup(self->credentials, username):NULL; 
+		uint32_t retry_ms = 0; 
+		int ret = -EACCES; 
+		if(user && user->pwhash && response && _parse_response(response, received)){
+			int c; 
+			for(c = 0; c < num_seen; c++) if(seen[c].user == user) break; 
+			if(c == num_seen){
+				seen[c].user = user; 
+				seen[c].failed = false; 
+				_auth_digest(user->pwhash, challenge, seen[c].digest); 
+				num_seen++; 
+			}
+			if(seen[c].failed){
+				ret = -EACCES; 
+			} else if(_login_throttled(self, user, now_ms, &retry_ms) < 0){
+				ret = -EAGAIN; 
+			} else if(!_digest_equal(seen[c].digest, received)){
+				seen[c].failed = true; 
+				_login_failed(self, user, now_ms); 
+			} else {
+				ret = _create_session(self, user, &sid); 
+			}
+		}
+
+		blob_offset_t o = blob_open_table(out); 
+		if(ret == 0){
+			blob_put_string(out, "success"); 
+			blob_put_string(out, sid); 
+			count++; 
+		} else if(ret == -EAGAIN){
+			blob_put_string(out, "error"); 
+			blob_put_string(out, "EAGAIN"); 
+			blob_put_string(out, "retry_after"); 
+			blob_put_int(out, retry_ms); 
+		} else {
+			blob_put_string(out, "error"); 
+			blob_put_string(out, "EACCESS"); 
+		}
+		blob_close_table(out, o); 
+	}
+	blob_close_array(out, a); 
+	return count; 
+}
+
 int juci_logout(struct juci *self, const char *sid){
-	struct avl_node *node = avl_find(&self->sessions, sid); 
-	if(!node) return -EINVAL; 
-	struct juci_session *ses = container_of(node, struct juci_session, avl); 
-	avl_delete(&self->sessions, node); 
-	juci_session_delete(&ses); 
+	uint8_t id[JUCI_SESSION_ID_SIZE]; 
+	if(juci_session_parse_sid(sid, id) < 0) return -EINVAL; 
+	struct juci_session *ses = juci_session_store_find(&self->sessions, id); 
+	if(!ses) return -EINVAL; 
+	if(!list_empty(&ses->timer.list)) juci_timer_wheel_del(&self->session_timers, &ses->timer); 
+	// the session is freed once the main loop passes its next quiescent point
+	if(juci_session_store_remove(&self->sessions, id) < 0) return -EINVAL; 
+	self->sessions_dirty = true; 
 	return 0; 
 }
 
 int juci_call(struct juci *self, const char *sid, const char *object, const char *method, struct blob_field *args, struct blob *out){
-	struct avl_node *avl = avl_find(&self->objects, object); 
-	if(!avl) {
-		ERROR("object not found: %s\n", object); 
+	struct juci_luaobject *obj = NULL; 
+	// a plugin can return -EAGAIN too and then there is no retry time
+	self->retry_after = 0; 
+	struct juci_luaobject_method *m = juci_dispatch_find(&self->dispatch, object, method, &obj); 
+	if(!m) {
+		ERROR("method not found: %s %s\n", object, method); 
 		return -ENOENT; 
 	}
-	struct juci_luaobject *obj = container_of(avl, struct juci_luaobject, avl); 
 	self->current_session = _find_session(self, sid); 
 	if(self->current_session) {
 		DEBUG("found session for request: %s\n", sid); 
@@ -351,7 +851,15 @@ int juci_call(struct juci *self, const char *sid, const char *object, const char
 		ERROR("user %s does not have permission to execute rpc call: %s %s\n", self->current_session->user->username, object, method); 
 		return -EACCES; 
 	}
-	return juci_luaobject_call(obj, self->current_session, method, args, out); 
+	// throttled calls never get to enter the lua state
+	if(juci_ratelimit_enabled(&self->ratelimit)){
+		struct juci_session *ses = self->current_session; 
+		if(juci_ratelimit_check(&self->ratelimit, ses->sid, ses->user->username, object, method, _monotonic_ms(), &self->retry_after) < 0){
+			DEBUG("call %s %s of session %s throttled for %ums\n", object, method, ses->sid, self->retry_after); 
+			return -EAGAIN; 
+		}
+	}
+	return juci_luaobject_invoke(obj, self->current_session, m, args, out); 
 }
 
 int juci_list(struct juci *self, const char *sid, const char *path, struct blob *out){
@@ -365,4 +873,263 @@ int juci_list(struct juci *self, const char *sid, const char *path, struct blob
 	return 0; 
 }
 
+void juci_stats(struct juci *self, struct blob *out){
+	struct juci_luaobject *entry; 
+	blob_offset_t t = blob_open_table(out); 
+	blob_put_string(out, "objects"); 
+	blob_offset_t o = blob_open_table(out); 
+	avl_for_each_element(&self->objects, entry, avl){
+		blob_put_string(out, (char*)entry->avl.key); 
+		juci_luaobject_stats_to_blob(entry, out); 
+	}
+	blob_close_table(out, o); 
+	blob_put_string(out, "sessions"); 
+	blob_offset_t st = blob_open_table(out); 
+	blob_put_string(out, "active"); 
+	blob_put_int(out, juci_session_store_count(&self->sessions)); 
+	blob_put_string(out, "expired"); 
+	blob_put_int(out, self->sessions_expired); 
+	blob_put_string(out, "restored"); 
+	blob_put_int(out, self->sessions_restored); 
+	blob_put_string(out, "idle_timeout"); 
+	blob_put_int(out, self->session_idle_timeout); 
+	blob_put_string(out, "absolute_timeout"); 
+	blob_put_int(out, self->session_absolute_timeout); 
+	blob_close_table(out, st); 
+	blob_put_string(out, "roles"); 
+	blob_put_int(out, self->roles.count); 
+	blob_put_string(out, "role_reloads"); 
+	blob_put_int(out, self->role_reloads); 
+	blob_put_string(out, "users"); 
+	blob_put_int(out, juci_credentials_count(self->credentials)); 
+	blob_put_string(out, "credential_reloads"); 
+	blob_put_int(out, self->credentials->reloads); 
+	unsigned long uci_hits, uci_loads; 
+	juci_uci_cache_stats(&uci_hits, &uci_loads); 
+	blob_put_string(out, "uci"); 
+	blob_offset_t u = blob_open_table(out); 
+	blob_put_string(out, "hits"); 
+	blob_put_int(out, uci_hits); 
+	blob_put_string(out, "loads"); 
+	blob_put_int(out, uci_loads); 
+	blob_close_table(out, u); 
+	blob_put_string(out, "ratelimit"); 
+	juci_ratelimit_to_blob(&self->ratelimit, out); 
+	blob_put_string(out, "login_failures"); 
+	blob_put_int(out, self->login_failures); 
+	blob_put_string(out, "login_limit"); 
+	juci_ratelimit_to_blob(&self->login_limit, out); 
+	blob_put_string(out, "events"); 
+	juci_events_to_blob(&self->events, out); 
+	if(self->lua_host){
+		blob_put_string(out, "shared"); 
+		juci_luaobject_stats_to_blob(self->lua_host, out); 
+	}
+	blob_close_table(out, t); 
+}
+
+void juci_set_event_sender(struct juci *self, juci_event_sender_t send, void *arg){
+	self->events.send = send; 
+	self->events.send_arg = arg; 
+}
+
+void juci_publish(struct juci *self, const char *event, const char *action, struct blob_field *data){
+	struct juci_subscription *sub, *nsub; 
+	uint64_t last_peer = 0; 
+	bool sent = false; 
+	struct blob msg; 
+
+	if(!self->events.send || !self->events.count) return; 
+	self->events.published++; 
+
+	blob_init(&msg, 0, 0); 
+	blob_offset_t t = blob_open_table(&msg); 
+	blob_put_string(&msg, "jsonrpc"); 
+	blob_put_string(&msg, "2.0"); 
+	blob_put_string(&msg, "method"); 
+	blob_put_string(&msg, event); 
+	blob_put_string(&msg, "params"); 
+	blob_offset_t a = blob_open_array(&msg); 
+	blob_put_string(&msg, action); 
+	if(data) blob_put_attr(&msg, data); 
+	blob_close_array(&msg, a); 
+	blob_close_table(&msg, t); 
+
+	list_for_each_entry_safe(sub, nsub, &self->events.subscriptions, list){
+		// subscriptions of a peer are adjacent so one match per peer is enough
+		if(sent && sub->peer == last_peer) continue; 
+		if(!juci_subscription_matches(sub, event)) continue; 
+		struct juci_session *ses = _peek_session(self, sub->sid); 
+		if(!ses){
+			juci_events_remove_subscription(&self->events, sub); 
+			continue; 
+		}
+		if(!juci_session_access(ses, "event", event, "listen", "r")) continue; 
+		last_peer = sub->peer; 
+		sent = true; 
+		if(self->events.send(sub->peer, &msg, self->events.send_arg) < 0){
+			// the connection is gone. Its other subscriptions fail the same way.
+			juci_events_remove_subscription(&self->events, sub); 
+			continue; 
+		}
+		self->events.delivered++; 
+	}
+	blob_free(&msg); 
+}
+
+static void _netwatch_changed(const char *topic, const char *action, struct blob_field *entry, void *arg){
+	juci_publish((struct juci*)arg, topic, action, entry); 
+}
+
+static bool _netwatch_wanted(struct juci *self){
+	for(int type = 0; type < JUCI_NETWATCH_TYPES; type++){
+		if(juci_events_wanted(&self->events, juci_netwatch_topic(type))) return true; 
+	}
+	return false; 
+}
+
+static int _netwatch_start(struct juci *self){
+	struct juci_netwatch *watch = calloc(1, sizeof(struct juci_netwatch)); 
+	if(!watch) return -ENOMEM; 
+	int ret = juci_netwatch_init(watch); 
+	if(ret < 0){
+		ERROR("could not watch network changes: %s\n", strerror(-ret)); 
+		juci_netwatch_free(watch); 
+		free(watch); 
+		return ret; 
+	}
+	self->netwatch = watch; 
+	return 0; 
+}
+
+static void _netwatch_stop(struct juci *self){
+	juci_netwatch_free(self->netwatch); 
+	free(self->netwatch); 
+	self->netwatch = NULL; 
+}
+
+int juci_subscribe(struct juci *self, const char *sid, uint64_t peer, const char *topic, struct blob *out){
+	struct juci_session *ses = _find_session(self, sid); 
+	if(!ses || !topic) return -EACCES; 
+	if(!juci_session_access(ses, "event", topic, "listen", "r")) return -EACCES; 
+	int ret = juci_events_add(&self->events, peer, ses->sid, topic); 
+	if(ret < 0) return ret; 
+	if(!self->netwatch && _netwatch_wanted(self) && (ret = _netwatch_start(self)) < 0){
+		juci_events_remove(&self->events, peer, topic); 
+		return ret; 
+	}
+
+	// current state of the topics so that the client only has to apply the changes
+	blob_offset_t t = blob_open_table(out); 
+	for(int type = 0; self->netwatch && type < JUCI_NETWATCH_TYPES; type++){
+		const char *name = juci_netwatch_topic(type); 
+		if(fnmatch(topic, name, 0) != 0 || !juci_session_access(ses, "event", name, "listen", "r")) continue; 
+		blob_put_string(out, name); 
+		juci_netwatch_to_blob(self->netwatch, type, out); 
+	}
+	if(fnmatch(topic, JUCI_BWMON_TOPIC, 0) == 0 && juci_session_access(ses, "event", JUCI_BWMON_TOPIC, "listen", "r")){
+		blob_put_string(out, JUCI_BWMON_TOPIC); 
+		juci_bwmon_to_blob(out); 
+	}
+	blob_close_table(out, t); 
+	return 0; 
+}
+
+int juci_unsubscribe(struct juci *self, const char *sid, uint64_t peer, const char *topic){
+	if(!_find_session(self, sid)) return -EACCES; 
+	return juci_events_remove(&self->events, peer, topic); 
+}
+
+/*
+ * Called by the main loop when there are no requests to process. Runs bounded
+ * collection steps on plugin states in round robin order so that most of the
+ * garbage collection work happens between calls instead of during them. 
+ */
+void juci_idle(struct juci *self, unsigned long budget_us){
+	unsigned long spent = 0; 
+	if(self->lua_host){
+		while(spent < budget_us && juci_luaobject_gc_pending(self->lua_host))
+			spent += juci_luaobject_gc_step(self->lua_host); 
+		return; 
+	}
+	if(avl_is_empty(&self->objects)) return; 
+	unsigned int idle = 0; 
+	struct juci_luaobject *obj = self->gc_next; 
+	if(!obj) obj = avl_first_element(&self->objects, obj, avl); 
+	while(spent < budget_us && idle < self->objects.count){
+		if(juci_luaobject_gc_pending(obj)){
+			spent += juci_luaobject_gc_step(obj); 
+			idle = 0; 
+		} else {
+			idle++; 
+		}
+		if(avl_is_last(&self->objects, &obj->avl)) obj = avl_first_element(&self->objects, obj, avl); 
+		else obj = avl_next_element(obj, avl); 
+	}
+	self->gc_next = obj; 
+}
+
+void juci_quiescent(struct juci *self){
+	self->current_session = NULL; 
+	juci_session_store_quiescent(&self->sessions, self->session_reader); 
+}
+
+/*
+ * Called by the main loop on every iteration. Advances the session timer
+ * wheel and expires sessions whose deadline has passed. Sessions that were
+ * accessed since their timer was set are put back with their new deadline. 
+ */
+void juci_tick(struct juci *self){
+	struct juci_session *ses, *nses; 
+	LIST_HEAD(expired); 
+
+	self->now = _monotonic_sec(); 
+	juci_timer_wheel_advance(&self->session_timers, self->now, &expired); 
+	list_for_each_entry_safe(ses, nses, &expired, timer.list){
+		list_del_init(&ses->timer.list); 
+		uint64_t deadline = _session_deadline(self, ses); 
+		if(deadline > self->now) {
+			juci_timer_wheel_add(&self->session_timers, &ses->timer, deadline); 
+			continue; 
+		}
+		_session_expire(self, ses); 
+	}
+
+	if(self->netwatch){
+		// stop listening to the kernel once nobody is interested
+		if(self->events.removed){
+			self->events.removed = false; 
+			if(!_netwatch_wanted(self)) _netwatch_stop(self); 
+		}
+		if(self->netwatch) juci_netwatch_poll(self->netwatch, _netwatch_changed, self); 
+	}
+
+	// keep the pipe from the log reader empty so that it never blocks
+	juci_logread_poll(); 
+
+	if(juci_bwmon_poll(_monotonic_ms()) > 0 && juci_events_wanted(&self->events, JUCI_BWMON_TOPIC)){
+		struct blob buf; 
+		blob_init(&buf, 0, 0); 
+		juci_bwmon_latest_to_blob(&buf); 
+		juci_publish(self, JUCI_BWMON_TOPIC, "sample", blob_field_first_child(blob_head(&buf))); 
+		blob_free(&buf); 
+	}
 
+	if(self->now >= self->acl_check_next){
+		_refresh_roles(self); 
+		self->acl_check_next = self->now + JUCI_ACL_CHECK_INTERVAL; 
+	}
+
+	if(self->now >= self->ratelimit_sweep_next){
+		juci_ratelimit_sweep(&self->ratelimit, _monotonic_ms()); 
+		juci_ratelimit_sweep(&self->login_limit, _monotonic_ms()); 
+		self->ratelimit_sweep_next = self->now + JUCI_RATELIMIT_SWEEP_INTERVAL; 
+	}
+
+	// sessions are also saved when nothing changed but some were in use since
+	// otherwise they would come back with their idle time at the last save
+	if(self->session_snapshot && self->session_snapshot_interval && self->now >= self->session_snapshot_next){
+		if(self->sessions_dirty || juci_session_store_count(&self->sessions)) _juci_save_sessions(self); 
+		self->session_snapshot_next = self->now + self->session_snapshot_interval; 
+	}
+}
@@ -25,26 +25,116 @@
 #endif
 
 #include "juci_session.h"
+#include "juci_dispatch.h"
+#include "juci_session_store.h"
+#include "juci_credentials.h"
+#include "juci_session_snapshot.h"
+#include "juci_ratelimit.h"
+#include "juci_events.h"
+#include "juci_netwatch.h"
+
+// load all plugins into one shared lua state (low memory mode)
+#define JUCI_FLAG_SHARED_LUA (1 << 0)
+
+#define JUCI_SHARED_LUA_NAME "@shared"
+
+// default session timeouts in seconds (0 = never)
+#define JUCI_SESSION_IDLE_TIMEOUT 1800
+#define JUCI_SESSION_ABSOLUTE_TIMEOUT 0
+// sessions are saved here periodically and restored at startup, the directory must be private to us
+#define JUCI_SESSION_SNAPSHOT_PATH "/var/run/revorpcd/sessions"
+#define JUCI_SESSION_SNAPSHOT_INTERVAL 60
+// seconds between removing rate limit buckets that are full again
+#define JUCI_RATELIMIT_SWEEP_INTERVAL 10
+// wrong passwords a user may send at once and per second before logins are throttled
+#define JUCI_LOGIN_FAILURE_BURST 5
+#define JUCI_LOGIN_FAILURE_RATE 0.1
+// pairs a single login_batch call may contain
+#define JUCI_LOGIN_BATCH_MAX 8
+// seconds between checks of the acl files for changes
+#define JUCI_ACL_CHECK_INTERVAL 5
+
+struct juci_luaobject; 
 
 struct juci {
 	struct avl_tree objects; 
-	struct avl_tree sessions; 
-	struct avl_tree users; 
+	// (object, method) -> method of a loaded object
+	struct juci_dispatch dispatch; 
+	struct juci_session_store sessions; 
+	// reader slot of the main loop in the session store
+	int session_reader; 
+	struct juci_timer_wheel session_timers; 
+	unsigned long session_idle_timeout; 
+	unsigned long session_absolute_timeout; 
+	unsigned long sessions_expired; 
+	unsigned long sessions_restored; 
+	char *session_snapshot; 
+	unsigned long session_snapshot_interval; 
+	uint64_t session_snapshot_next; 
+	bool sessions_dirty; 
+	// monotonic seconds, updated once per main loop iteration
+	uint64_t now; 
+	struct juci_credentials *credentials; 
+	// compiled acl sets keyed by the acl list of a user
+	struct avl_tree roles; 
+	// digest of the acl files that the roles were compiled from
+	uint64_t acl_stamp; 
+	uint64_t acl_check_next; 
+	unsigned long role_reloads; 
+	struct juci_ratelimit ratelimit; 
+	uint64_t ratelimit_sweep_next; 
+	// only charged for failed logins so guessing is slowed down but logging in is not
+	struct juci_ratelimit login_limit; 
+	unsigned long login_failures; 
+	// ms after which the last call or login may be retried, 0 if it was not throttled
+	uint32_t retry_after; 
+	struct juci_events events; 
+	// started by the first subscription to a network.* topic
+	struct juci_netwatch *netwatch; 
 	
 	char *plugin_path; 	
 	char *pwfile; 
 
 	struct juci_session *current_session; 
+
+	int flags; 
+	// owner of the lua state that all objects share in shared mode
+	struct juci_luaobject *lua_host; 
+
+	// next object that the idle garbage collector will look at
+	struct juci_luaobject *gc_next; 
 }; 
 
-struct juci* juci_new(const char *plugin_path, const char *pwfile); 
+struct juci* juci_new(const char *plugin_path, const char *pwfile, int flags); 
 void juci_delete(struct juci **_self); 
 
+// returns -EAGAIN when the user has had too many failed logins, see retry_after
 int juci_login(struct juci *self, const char *username, const char *challenge, const char *response, const char **new_sid); 
+// returns -E2BIG when there are more than JUCI_LOGIN_BATCH_MAX logins
+int juci_login_batch(struct juci *self, const char *challenge, struct blob_field *logins, struct blob *out); 
 int juci_logout(struct juci *self, const char *sid); 
 struct juci_session* juci_find_session(struct juci *self, const char *sid); 
+// returns -EAGAIN when the call is rate limited, see retry_after
 int juci_call(struct juci *self, const char *sid, const char *object, const char *method, struct blob_field *args, struct blob *out); 
 int juci_list(struct juci *self, const char *sid, const char *path, struct blob *out); 
+void juci_stats(struct juci *self, struct blob *out); 
+// events are handed to send which delivers them to the connection of a peer
+void juci_set_event_sender(struct juci *self, juci_event_sender_t send, void *arg); 
+// subscribes a connection to a topic pattern and writes the current state of matching topics to out
+int juci_subscribe(struct juci *self, const char *sid, uint64_t peer, const char *topic, struct blob *out); 
+int juci_unsubscribe(struct juci *self, const char *sid, uint64_t peer, const char *topic); 
+// sends {"method":event,"params":[action,data]} to all subscribers that may see it
+void juci_publish(struct juci *self, const char *event, const char *action, struct blob_field *data); 
+void juci_idle(struct juci *self, unsigned long budget_us); 
+// serialize sessions to an fd and restore them from one (hot restart)
+int juci_export_sessions(struct juci *self, int fd); 
+int juci_import_sessions(struct juci *self, int fd); 
+// an instance that has handed over must not overwrite the snapshot of its successor
+void juci_stop_session_snapshots(struct juci *self); 
+// called by the main loop on every iteration to expire sessions
+void juci_tick(struct juci *self); 
+// called by the main loop once it no longer holds any session pointers
+void juci_quiescent(struct juci *self); 
    
 static inline bool url_scanf(const char *url, char *proto, char *host, int *port, char *page){
     if (sscanf(url, "%99[^:]://%99[^:]:%i/%199[^\n]", proto, host, port, page) == 4) return true; 
@@ -0,0 +1,329 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "internal.h"
+#include "juci_acl.h"
+
+enum {
+	JUCI_GLOB_CHAR,
+	JUCI_GLOB_ANY,
+	JUCI_GLOB_STAR,
+	JUCI_GLOB_CLASS
+};
+
+struct juci_glob_op {
+	uint8_t type;
+	uint8_t ch;
+	uint16_t cls;
+};
+
+// pattern compiled with the same rules as fnmatch(FNM_NOESCAPE)
+struct juci_glob {
+	struct juci_glob_op *ops;
+	uint32_t (*classes)[8]; // 256 bit character sets
+	uint16_t nops;
+	bool literal;
+};
+
+struct juci_acl_entry {
+	struct juci_acl_entry *next;
+	struct juci_glob object; // pattern after the literal prefix
+	struct juci_glob method;
+	uint64_t perms[2];
+	bool deny; // matches but grants nothing
+};
+
+struct juci_acl_node {
+	struct juci_acl_node *child;
+	struct juci_acl_node *sibling;
+	struct juci_acl_entry *entries; // in the order they are checked
+	char ch;
+};
+
+static const struct {
+	const char *name;
+	int (*fn)(int);
+} _char_classes[] = {
+	{ "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank }, { "cntrl", iscntrl },
+	{ "digit", isdigit }, { "graph", isgraph }, { "lower", islower }, { "print", isprint },
+	{ "punct", ispunct }, { "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit }
+};
+
+static inline void _set_bit(uint32_t *set, uint8_t ch){ set[ch >> 5] |= 1u << (ch & 31); }
+static inline bool _test_bit(const uint32_t *set, uint8_t ch){ return set[ch >> 5] & (1u << (ch & 31)); }
+
+// parses a bracket expression starting at '['. Returns length consumed or 0 if it is not terminated.
+static int _parse_class(const char *pat, uint32_t *set){
+	const char *p = pat + 1;
+	bool negate = false;
+	memset(set, 0, sizeof(uint32_t) * 8);
+	if(*p == '!' || *p == '^'){ negate = true; p++; }
+	bool first = true;
+	while(*p && (*p != ']' || first)){
+		first = false;
+		if(p[0] == '[' && p[1] == ':'){
+			const char *end = strstr(p + 2, ":]");
+			if(end){
+				for(int c = 0; c < sizeof(_char_classes) / sizeof(_char_classes[0]); c++){
+					if(strlen(_char_classes[c].name) != (size_t)(end - p - 2) || strncmp(_char_classes[c].name, p + 2, end - p - 2)) continue;
+					for(int ch = 1; ch < 256; ch++) if(_char_classes[c].fn(ch)) _set_bit(set, ch);
+				}
+				p = end + 2;
+				continue;
+			}
+		}
+		uint8_t lo = *p++, hi = lo;
+		if(p[0] == '-' && p[1] && p[1] != ']'){
+			hi = p[1];
+			p += 2;
+		}
+		for(int ch = lo; ch <= hi; ch++) _set_bit(set, ch);
+	}
+	if(*p != ']') return 0;
+	if(negate) for(int c = 0; c < 8; c++) set[c] = ~set[c];
+	return p - pat + 1;
+}
+
+static int _glob_compile(struct juci_glob *self, const char *pat){
+	size_t len = strlen(pat);
+	memset(self, 0, sizeof(*self));
+	self->ops = calloc(len + 1, sizeof(struct juci_glob_op));
+	if(!self->ops) return -ENOMEM;
+	self->literal = true;
+	uint32_t set[8];
+	uint16_t ncls = 0;
+	for(const char *p = pat; *p;){
+		struct juci_glob_op *op = &self->ops[self->nops];
+		int clen;
+		if(*p == '*'){
+			// consecutive stars are the same as one
+			if(self->nops == 0 || self->ops[self->nops - 1].type != JUCI_GLOB_STAR) { op->type = JUCI_GLOB_STAR; self->nops++; }
+			self->literal = false;
+			p++;
+			continue;
+		} else if(*p == '?'){
+			op->type = JUCI_GLOB_ANY;
+			self->literal = false;
+			p++;
+		} else if(*p == '[' && (clen = _parse_class(p, set)) > 0){
+			void *classes = realloc(self->classes, (ncls + 1) * sizeof(*self->classes));
+			if(!classes) return -ENOMEM;
+			self->classes = classes;
+			memcpy(self->classes[ncls], set, sizeof(set));
+			op->type = JUCI_GLOB_CLASS;
+			op->cls = ncls++;
+			self->literal = false;
+			p += clen;
+		} else {
+			op->type = JUCI_GLOB_CHAR;
+			op->ch = *p++;
+		}
+		self->nops++;
+	}
+	return 0;
+}
+
+static void _glob_free(struct juci_glob *self){
+	free(self->ops);
+	free(self->classes);
+}
+
+static inline bool _glob_op_match(const struct juci_glob *self, const struct juci_glob_op *op, uint8_t ch){
+	switch(op->type){
+		case JUCI_GLOB_CHAR: return op->ch == ch;
+		case JUCI_GLOB_ANY: return true;
+		case JUCI_GLOB_CLASS: return _test_bit(self->classes[op->cls], ch);
+	}
+	return false;
+}
+
+static bool _glob_match(const struct juci_glob *self, const char *str){
+	const struct juci_glob_op *ops = self->ops;
+	int n = self->nops, p = 0, star = -1;
+	const char *s = str, *star_s = NULL;
+	if(self->literal){
+		for(; p < n; p++, s++) if(ops[p].ch != (uint8_t)*s) return false;
+		return *s == 0;
+	}
+	// only the most recent star needs to be retried because any earlier
+	// star can absorb whatever a later one would have matched
+	while(*s){
+		if(p < n && ops[p].type != JUCI_GLOB_STAR && _glob_op_match(self, &ops[p], *s)){
+			p++; s++;
+		} else if(p < n && ops[p].type == JUCI_GLOB_STAR){
+			star = p++;
+			star_s = s;
+		} else if(star >= 0){
+			p = star + 1;
+			s = ++star_s;
+		} else {
+			return false;
+		}
+	}
+	while(p < n && ops[p].type == JUCI_GLOB_STAR) p++;
+	return p == n;
+}
+
+static inline void _perm_mask(const char *perm, uint64_t mask[2]){
+	mask[0] = mask[1] = 0;
+	for(const char *c = perm; *c; c++) mask[(*c >> 6) & 1] |= 1ull << (*c & 63);
+}
+
+static struct juci_acl_node *_node_child(struct juci_acl_node *node, char ch){
+	for(struct juci_acl_node *c = node->child; c; c = c->sibling)
+		if(c->ch == ch) return c;
+	return NULL;
+}
+
+static void _node_delete(struct juci_acl_node *node){
+	struct juci_acl_node *child, *nchild;
+	for(child = node->child; child; child = nchild){
+		nchild = child->sibling;
+		_node_delete(child);
+	}
+	struct juci_acl_entry *e, *ne;
+	for(e = node->entries; e; e = ne){
+		ne = e->next;
+		_glob_free(&e->object);
+		_glob_free(&e->method);
+		free(e);
+	}
+	free(node);
+}
+
+struct juci_acl_matcher *juci_acl_matcher_new(void){
+	struct juci_acl_matcher *self = calloc(1, sizeof(struct juci_acl_matcher));
+	assert(self);
+	self->root = calloc(1, sizeof(struct juci_acl_node));
+	assert(self->root);
+	return self;
+}
+
+void juci_acl_matcher_delete(struct juci_acl_matcher **_self){
+	struct juci_acl_matcher *self = *_self;
+	_node_delete(self->root);
+	free(self);
+	*_self = NULL;
+}
+
+int juci_acl_matcher_add(struct juci_acl_matcher *self, const char *object, const char *method, const char *perms){
+	size_t prefix = strcspn(object, "*?[");
+	struct juci_acl_node *node = self->root;
+	for(size_t c = 0; c < prefix; c++){
+		struct juci_acl_node *child = _node_child(node, object[c]);
+		if(!child){
+			child = calloc(1, sizeof(struct juci_acl_node));
+			if(!child) return -ENOMEM;
+			child->ch = object[c];
+			child->sibling = node->child;
+			node->child = child;
+		}
+		node = child;
+	}
+
+	struct juci_acl_entry *e = calloc(1, sizeof(struct juci_acl_entry));
+	if(!e) return -ENOMEM;
+	if(_glob_compile(&e->object, object + prefix) < 0 || _glob_compile(&e->method, method) < 0){
+		_glob_free(&e->object);
+		_glob_free(&e->method);
+		free(e);
+		return -ENOMEM;
+	}
+	if(perms) _perm_mask(perms, e->perms);
+	else e->deny = true;
+
+	// the acl tree is searched backwards so later entries take precedence
+	e->next = node->entries;
+	node->entries = e;
+	self->entries++;
+	return 0;
+}
+
+// returns 1 if allowed, 0 if denied and -1 if no entry matched
+static int _match_node(struct juci_acl_node *node, const char *object, size_t depth, const char *method, const uint64_t want[2]){
+	if(object[depth]){
+		struct juci_acl_node *child = _node_child(node, object[depth]);
+		if(child){
+			int ret = _match_node(child, object, depth + 1, method, want);
+			if(ret >= 0) return ret;
+		}
+	}
+	for(struct juci_acl_entry *e = node->entries; e; e = e->next){
+		if(!_glob_match(&e->object, object + depth) || !_glob_match(&e->method, method)) continue;
+		if(e->deny) return 0;
+		return ((e->perms[0] & want[0]) == want[0] && (e->perms[1] & want[1]) == want[1]);
+	}
+	return -1;
+}
+
+int juci_acl_matcher_match(struct juci_acl_matcher *self, const char *object, const char *method, const char *perm){
+	uint64_t want[2];
+	_perm_mask(perm, want);
+	return _match_node(self->root, object, 0, method, want);
+}
+
+// fnv-1a over the key parts including their terminators
+static uint32_t _cache_key(char *key, uint16_t *key_len, const char *parts[4]){
+	uint32_t h = 2166136261u;
+	size_t len = 0;
+	for(int c = 0; c < 4; c++){
+		size_t plen = strlen(parts[c]) + 1;
+		if(len + plen > JUCI_ACL_CACHE_KEY_SIZE) return 0;
+		memcpy(key + len, parts[c], plen);
+		for(size_t i = 0; i < plen; i++) h = (h ^ (uint8_t)parts[c][i]) * 16777619u;
+		len += plen;
+	}
+	*key_len = len;
+	// zero means that the key does not fit into the cache
+	return (h)?h:1;
+}
+
+int juci_acl_cache_lookup(struct juci_acl_cache *self, uint32_t generation, const char *scope, const char *object, const char *method, const char *perm, bool *allowed){
+	char key[JUCI_ACL_CACHE_KEY_SIZE];
+	uint16_t key_len = 0;
+	const char *parts[4] = { scope, object, method, perm };
+	uint32_t hash = _cache_key(key, &key_len, parts);
+	if(!hash) return 0;
+	struct juci_acl_cache_entry *e = &self->entries[hash & (JUCI_ACL_CACHE_SIZE - 1)];
+	if(e->hash != hash || e->generation != generation || e->key_len != key_len || memcmp(e->key, key, key_len)){
+		self->misses++;
+		return 0;
+	}
+	self->hits++;
+	*allowed = e->allowed;
+	return 1;
+}
+
+void juci_acl_cache_store(struct juci_acl_cache *self, uint32_t generation, const char *scope, const char *object, const char *method, const char *perm, bool allowed){
+	char key[JUCI_ACL_CACHE_KEY_SIZE];
+	uint16_t key_len = 0;
+	const char *parts[4] = { scope, object, method, perm };
+	uint32_t hash = _cache_key(key, &key_len, parts);
+	if(!hash) return;
+	struct juci_acl_cache_entry *e = &self->entries[hash & (JUCI_ACL_CACHE_SIZE - 1)];
+	e->hash = hash;
+	e->generation = generation;
+	e->key_len = key_len;
+	e->allowed = allowed;
+	memcpy(e->key, key, key_len);
+}
@@ -0,0 +1,69 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct juci_acl_node;
+
+/*
+ * Compiled form of the acl entries of one session scope. Entries are stored
+ * in a trie keyed by the literal prefix of their object pattern (everything
+ * up to the first wildcard) and the remaining object and method patterns are
+ * compiled into small glob programs. Lookup visits the trie nodes along the
+ * object name from the deepest one up and the first entry that matches
+ * decides, which is the same order the acl tree is searched in.
+ */
+struct juci_acl_matcher {
+	struct juci_acl_node *root;
+	uint32_t entries;
+};
+
+struct juci_acl_matcher *juci_acl_matcher_new(void);
+void juci_acl_matcher_delete(struct juci_acl_matcher **self);
+// entries must be added in the order they are stored in the acl tree. NULL perms adds an entry that denies access.
+int juci_acl_matcher_add(struct juci_acl_matcher *self, const char *object, const char *method, const char *perms);
+// returns 1 if the first matching entry grants perm, 0 if it does not and -1 if no entry matches
+int juci_acl_matcher_match(struct juci_acl_matcher *self, const char *object, const char *method, const char *perm);
+
+#define JUCI_ACL_CACHE_SIZE 16 // must be a power of two
+#define JUCI_ACL_CACHE_KEY_SIZE 96
+
+struct juci_acl_cache_entry {
+	uint32_t hash;
+	uint32_t generation;
+	uint16_t key_len;
+	bool allowed;
+	char key[JUCI_ACL_CACHE_KEY_SIZE];
+};
+
+/*
+ * Direct mapped cache of access decisions. Entries are tagged with the acl
+ * generation of the session so that any change to the acls invalidates them
+ * without touching the cache.
+ */
+struct juci_acl_cache {
+	struct juci_acl_cache_entry entries[JUCI_ACL_CACHE_SIZE];
+	uint32_t hits;
+	uint32_t misses;
+};
+
+// returns 1 and sets allowed on a hit, 0 on a miss
+int juci_acl_cache_lookup(struct juci_acl_cache *self, uint32_t generation, const char *scope, const char *object, const char *method, const char *perm, bool *allowed);
+void juci_acl_cache_store(struct juci_acl_cache *self, uint32_t generation, const char *scope, const char *object, const char *method, const char *perm, bool allowed);
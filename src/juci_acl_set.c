@@ -0,0 +1,268 @@
+/*
+	JUCI Backend Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	Based on code by: 
+	Copyright (C) 2013 Felix Fietkau <nbd@openwrt.org>
+	Copyright (C) 2013-2014 Jo-Philipp Wich <jow@openwrt.org>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <alloca.h>
+
+#include <libutype/avl-cmp.h>
+
+#include "internal.h"
+#include "juci_acl.h"
+#include "juci_acl_set.h"
+
+struct juci_acl_set_scope {
+	struct avl_node avl;
+	struct avl_tree acls;
+	// compiled from acls on first use, dropped whenever acls change
+	struct juci_acl_matcher *matcher;
+};
+
+struct juci_acl_set_entry {
+	struct avl_node avl;
+	const char *object;
+	const char *function;
+	const char *perms; // NULL for deny entries
+};
+
+/*
+ * Keys in the AVL tree contain all pattern characters up to the first wildcard.
+ * To look up entries, start with the last entry that has a key less than or
+ * equal to the method name, then work backwards as long as the AVL key still
+ * matches its counterpart in the object name
+ */
+#define uh_foreach_matching_acl_prefix(_acl, _avl, _obj, _func)     \
+    for (_acl = avl_find_le_element(_avl, _obj, _acl, avl);         \
+         _acl;                                                      \
+         _acl = avl_is_first(_avl, &(_acl)->avl) ? NULL :           \
+            avl_prev_element((_acl), avl))
+
+struct juci_acl_set *juci_acl_set_new(const char *name){
+	struct juci_acl_set *self = calloc(1, sizeof(struct juci_acl_set));
+	assert(self);
+	self->name = strdup(name);
+	self->avl.key = self->name;
+	self->refcount = 1;
+	avl_init(&self->scopes, avl_strcmp, false, NULL);
+	return self;
+}
+
+struct juci_acl_set *juci_acl_set_ref(struct juci_acl_set *self){
+	__atomic_add_fetch(&self->refcount, 1, __ATOMIC_RELAXED);
+	return self;
+}
+
+static void _scope_delete(struct juci_acl_set *self, struct juci_acl_set_scope *acl_scope){
+	struct juci_acl_set_entry *acl, *nacl;
+
+	avl_remove_all_elements(&acl_scope->acls, acl, avl, nacl)
+		free(acl);
+
+	if(acl_scope->matcher) juci_acl_matcher_delete(&acl_scope->matcher);
+	avl_delete(&self->scopes, &acl_scope->avl);
+	free(acl_scope);
+}
+
+void juci_acl_set_unref(struct juci_acl_set **_self){
+	struct juci_acl_set *self = *_self;
+	struct juci_acl_set_scope *acl_scope, *nacl_scope;
+
+	*_self = NULL;
+	if(__atomic_sub_fetch(&self->refcount, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+	avl_for_each_element_safe(&self->scopes, acl_scope, avl, nacl_scope)
+		_scope_delete(self, acl_scope);
+
+	free(self->name);
+	free(self);
+}
+
+int juci_acl_set_grant(struct juci_acl_set *self, const char *scope, const char *object, const char *function, const char *perm){
+    struct juci_acl_set_entry *acl;
+    struct juci_acl_set_scope *acl_scope;
+    char *new_scope, *new_obj, *new_func, *new_id, *new_perms = NULL;
+    int id_len;
+
+    if (!object || !function)
+        return -EINVAL;
+
+    acl_scope = avl_find_element(&self->scopes, scope, acl_scope, avl);
+
+    if (acl_scope) {
+        uh_foreach_matching_acl_prefix(acl, &acl_scope->acls, object, function) {
+            if (!strcmp(acl->object, object) &&
+                !strcmp(acl->function, function)) {
+                // a grant replaces a deny entry and the other way around
+                if (!acl->perms == !perm)
+                    return 0;
+                avl_delete(&acl_scope->acls, &acl->avl);
+                free(acl);
+                break;
+            }
+        }
+    }
+
+    if (!acl_scope) {
+        acl_scope = calloc_a(sizeof(*acl_scope),
+                             &new_scope, strlen(scope) + 1);
+
+        if (!acl_scope)
+            return -1;
+
+        acl_scope->avl.key = strcpy(new_scope, scope);
+        avl_init(&acl_scope->acls, avl_strcmp, true, NULL);
+        avl_insert(&self->scopes, &acl_scope->avl);
+    }
+
+    id_len = strcspn(object, "*?[");
+    acl = calloc_a(sizeof(*acl),
+        &new_obj, strlen(object) + 1,
+        &new_func, strlen(function) + 1,
+        &new_id, id_len + 1,
+		&new_perms, (perm)?strlen(perm) + 1:0);
+
+    if (!acl)
+        return -1;
+
+    acl->object = strcpy(new_obj, object);
+    acl->function = strcpy(new_func, function);
+	acl->perms = (perm)?strcpy(new_perms, perm):NULL;
+    acl->avl.key = strncpy(new_id, object, id_len);
+    avl_insert(&acl_scope->acls, &acl->avl);
+
+	if(acl_scope->matcher) juci_acl_matcher_delete(&acl_scope->matcher);
+    return 0;
+}
+
+int juci_acl_set_revoke(struct juci_acl_set *self, const char *scope, const char *object, const char *function){
+    struct juci_acl_set_entry *acl, *next;
+    struct juci_acl_set_scope *acl_scope;
+    int id_len;
+    char *id;
+
+    acl_scope = avl_find_element(&self->scopes, scope, acl_scope, avl);
+
+    if (!acl_scope)
+        return 0;
+
+    if (!object && !function) {
+        _scope_delete(self, acl_scope);
+        return 0;
+    }
+
+    if (!object || !function)
+        return -EINVAL;
+
+    if (acl_scope->matcher)
+        juci_acl_matcher_delete(&acl_scope->matcher);
+
+    id_len = strcspn(object, "*?[");
+    id = alloca(id_len + 1);
+	assert(id);
+    strncpy(id, object, id_len);
+    id[id_len] = 0;
+
+    acl = avl_find_element(&acl_scope->acls, id, acl, avl);
+    while (acl) {
+        if (!avl_is_last(&acl_scope->acls, &acl->avl))
+            next = avl_next_element(acl, avl);
+        else
+            next = NULL;
+
+        if (strcmp(id, acl->avl.key) != 0)
+            break;
+
+        if (!strcmp(acl->object, object) &&
+            !strcmp(acl->function, function)) {
+            avl_delete(&acl_scope->acls, &acl->avl);
+            free(acl);
+        }
+        acl = next;
+    }
+
+    if (avl_is_empty(&acl_scope->acls))
+        _scope_delete(self, acl_scope);
+
+    return 0;
+}
+
+static struct juci_acl_matcher *_scope_compile(struct juci_acl_set_scope *acl_scope){
+	struct juci_acl_set_entry *acl;
+
+	if(acl_scope->matcher) return acl_scope->matcher;
+
+	acl_scope->matcher = juci_acl_matcher_new();
+	avl_for_each_element(&acl_scope->acls, acl, avl){
+		juci_acl_matcher_add(acl_scope->matcher, acl->object, acl->function, acl->perms);
+	}
+	return acl_scope->matcher;
+}
+
+void juci_acl_set_compile(struct juci_acl_set *self){
+	struct juci_acl_set_scope *acl_scope;
+
+	avl_for_each_element(&self->scopes, acl_scope, avl)
+		_scope_compile(acl_scope);
+}
+
+int juci_acl_set_match(struct juci_acl_set *self, const char *scope, const char *obj, const char *fun, const char *perm){
+	struct juci_acl_set_scope *acl_scope;
+
+	acl_scope = avl_find_element(&self->scopes, scope, acl_scope, avl);
+	if (!acl_scope)
+		return -1;
+
+	// every character of perm must be granted by the first acl that matches.
+	// if no perms are specified then any matching acl allows access.
+	return juci_acl_matcher_match(_scope_compile(acl_scope), obj, fun, perm);
+}
+
+void juci_acl_set_to_blob(struct juci_acl_set *self, struct blob *buf){
+	struct juci_acl_set_entry *acl;
+    struct juci_acl_set_scope *acl_scope;
+
+	blob_offset_t r = blob_open_table(buf);
+    avl_for_each_element(&self->scopes, acl_scope, avl) {
+		blob_put_string(buf, acl_scope->avl.key);
+		blob_offset_t s = blob_open_table(buf);
+        avl_for_each_element(&acl_scope->acls, acl, avl){
+			blob_put_string(buf, acl->avl.key);
+			blob_offset_t a = blob_open_table(buf);
+			blob_put_string(buf, "object");
+			blob_put_string(buf, acl->object);
+			blob_put_string(buf, "method");
+			blob_put_string(buf, acl->function);
+			if(acl->perms){
+				blob_put_string(buf, "perms");
+				blob_put_string(buf, acl->perms);
+			} else {
+				blob_put_string(buf, "deny");
+				blob_put_bool(buf, true);
+			}
+			blob_close_table(buf, a);
+		}
+		blob_close_table(buf, s);
+    }
+	blob_close_table(buf, r);
+}
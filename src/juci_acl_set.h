@@ -0,0 +1,49 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <libutype/avl.h>
+#include <blobpack/blobpack.h>
+
+/*
+ * A named set of acl entries grouped by scope. Sets that are built from acl
+ * files are shared by all sessions of users with the same acl list. They are
+ * reference counted and must not be modified once they have been shared.
+ */
+struct juci_acl_set {
+	struct avl_node avl; // used by the role cache in struct juci
+	char *name;
+	int refcount;
+	struct avl_tree scopes;
+};
+
+struct juci_acl_set *juci_acl_set_new(const char *name);
+struct juci_acl_set *juci_acl_set_ref(struct juci_acl_set *self);
+void juci_acl_set_unref(struct juci_acl_set **self);
+
+// a NULL perm adds an entry that denies whatever it matches
+int juci_acl_set_grant(struct juci_acl_set *self, const char *scope, const char *object, const char *method, const char *perm);
+// removes entries with exactly this object and method (or the whole scope if both are NULL)
+int juci_acl_set_revoke(struct juci_acl_set *self, const char *scope, const char *object, const char *method);
+// compiles the matchers of all scopes (otherwise done on first use)
+void juci_acl_set_compile(struct juci_acl_set *self);
+// returns 1 if allowed, 0 if denied and -1 if no entry in the set applies
+int juci_acl_set_match(struct juci_acl_set *self, const char *scope, const char *object, const char *method, const char *perm);
+
+void juci_acl_set_to_blob(struct juci_acl_set *self, struct blob *buf);
@@ -0,0 +1,323 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "internal.h"
+#include "juci_alloc.h"
+
+static const uint32_t _class_sizes[JUCI_ALLOC_NUM_CLASSES] = {
+	16, 24, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512
+};
+
+struct juci_alloc_slab {
+	struct list_head list;
+	struct juci_alloc_class *cls;
+	void *freelist; // objects that have been freed
+	char *bump; // start of the never used area
+	char *end;
+	uint32_t used;
+	uint32_t capacity;
+};
+
+// objects start after the slab header aligned to 16 bytes
+#define JUCI_ALLOC_SLAB_HDR ((sizeof(struct juci_alloc_slab) + 15) & ~15)
+
+/*
+ * Header in front of blocks that are served by libc. A shrink that can not
+ * get a block of the smaller size leaves the old block in place, so the size
+ * lua passes in later does not always tell where a block lives. Small blocks
+ * are found through their slab, libc blocks that were left behind like this
+ * are kept on a list.
+ */
+struct juci_alloc_large {
+	struct list_head list;
+	size_t size;
+} __attribute__((aligned(16)));
+
+static inline struct juci_alloc_large *_large_of(void *ptr){
+	return (struct juci_alloc_large*)ptr - 1;
+}
+
+static inline struct juci_alloc_slab *_slab_of(void *ptr){
+	return (struct juci_alloc_slab*)((uintptr_t)ptr & ~((uintptr_t)JUCI_ALLOC_SLAB_SIZE - 1));
+}
+
+static inline int _class_index(size_t size){
+	// lua objects are mostly tiny so a linear scan is faster than anything clever here
+	for(int c = 0; c < JUCI_ALLOC_NUM_CLASSES; c++){
+		if(size <= _class_sizes[c]) return c;
+	}
+	return -1;
+}
+
+static struct juci_alloc_slab *_slab_new(struct juci_alloc_class *cls){
+	// map twice the size and trim so that the slab ends up aligned to its own size
+	size_t len = JUCI_ALLOC_SLAB_SIZE * 2;
+	char *mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED) return NULL;
+	char *start = (char*)(((uintptr_t)mem + JUCI_ALLOC_SLAB_SIZE - 1) & ~((uintptr_t)JUCI_ALLOC_SLAB_SIZE - 1));
+	if(start > mem) munmap(mem, start - mem);
+	if(start + JUCI_ALLOC_SLAB_SIZE < mem + len) munmap(start + JUCI_ALLOC_SLAB_SIZE, (mem + len) - (start + JUCI_ALLOC_SLAB_SIZE));
+
+	struct juci_alloc_slab *slab = (struct juci_alloc_slab*)start;
+	INIT_LIST_HEAD(&slab->list);
+	slab->cls = cls;
+	slab->freelist = NULL;
+	slab->bump = start + JUCI_ALLOC_SLAB_HDR;
+	slab->capacity = (JUCI_ALLOC_SLAB_SIZE - JUCI_ALLOC_SLAB_HDR) / cls->size;
+	slab->end = slab->bump + slab->capacity * cls->size;
+	slab->used = 0;
+	cls->slabs++;
+	return slab;
+}
+
+static void _slab_delete(struct juci_alloc_slab *slab){
+	slab->cls->slabs--;
+	list_del(&slab->list);
+	munmap(slab, JUCI_ALLOC_SLAB_SIZE);
+}
+
+static void *_class_alloc(struct juci_alloc_class *cls){
+	struct juci_alloc_slab *slab;
+	if(list_empty(&cls->partial)){
+		slab = _slab_new(cls);
+		if(!slab) return NULL;
+		list_add(&slab->list, &cls->partial);
+	} else {
+		slab = list_first_entry(&cls->partial, struct juci_alloc_slab, list);
+	}
+
+	void *obj;
+	if(slab->freelist){
+		obj = slab->freelist;
+		slab->freelist = *(void**)obj;
+	} else {
+		obj = slab->bump;
+		slab->bump += cls->size;
+	}
+
+	if(++slab->used == slab->capacity){
+		list_del(&slab->list);
+		list_add(&slab->list, &cls->full);
+	}
+	cls->allocs++;
+	cls->live++;
+	return obj;
+}
+
+static void _class_free(struct juci_alloc_class *cls, void *ptr){
+	struct juci_alloc_slab *slab = _slab_of(ptr);
+	assert(slab->cls == cls);
+
+	*(void**)ptr = slab->freelist;
+	slab->freelist = ptr;
+
+	if(slab->used-- == slab->capacity){
+		list_del(&slab->list);
+		list_add(&slab->list, &cls->partial);
+	}
+	cls->frees++;
+	cls->live--;
+
+	// give the slab back to the kernel once it is empty, but keep one slab
+	// around per class so that alloc/free cycles do not thrash mmap.
+	if(slab->used == 0 && (cls->partial.next != &slab->list || cls->partial.prev != &slab->list)){
+		_slab_delete(slab);
+	}
+}
+
+static inline void _account(struct juci_alloc *self, size_t osize, size_t nsize){
+	self->used = self->used - osize + nsize;
+	if(self->used > self->peak) self->peak = self->used;
+}
+
+struct juci_alloc *juci_alloc_new(void){
+	struct juci_alloc *self = calloc(1, sizeof(struct juci_alloc));
+	assert(self);
+	for(int c = 0; c < JUCI_ALLOC_NUM_CLASSES; c++){
+		INIT_LIST_HEAD(&self->classes[c].partial);
+		INIT_LIST_HEAD(&self->classes[c].full);
+		self->classes[c].size = _class_sizes[c];
+	}
+	INIT_LIST_HEAD(&self->misfiled);
+	return self;
+}
+
+void juci_alloc_delete(struct juci_alloc **_self){
+	struct juci_alloc *self = *_self;
+	struct juci_alloc_slab *slab, *nslab;
+	for(int c = 0; c < JUCI_ALLOC_NUM_CLASSES; c++){
+		struct juci_alloc_class *cls = &self->classes[c];
+		list_for_each_entry_safe(slab, nslab, &cls->partial, list) _slab_delete(slab);
+		list_for_each_entry_safe(slab, nslab, &cls->full, list) _slab_delete(slab);
+	}
+	free(self);
+	*_self = NULL;
+}
+
+static void *_large_alloc(struct juci_alloc *self, size_t size){
+	struct juci_alloc_large *hdr = malloc(sizeof(struct juci_alloc_large) + size);
+	if(!hdr) return NULL;
+	INIT_LIST_HEAD(&hdr->list);
+	hdr->size = size;
+	self->large_allocs++;
+	self->large_bytes += size;
+	return hdr + 1;
+}
+
+static void _large_free(struct juci_alloc *self, void *ptr){
+	struct juci_alloc_large *hdr = _large_of(ptr);
+	list_del(&hdr->list);
+	self->large_frees++;
+	self->large_bytes -= hdr->size;
+	free(hdr);
+}
+
+// index of the class that holds a block, or -1 when libc holds it
+static int _owner_class(struct juci_alloc *self, void *ptr, size_t osize){
+	if(_class_index(osize) < 0) return -1;
+	if(!list_empty(&self->misfiled)){
+		struct juci_alloc_large *hdr;
+		list_for_each_entry(hdr, &self->misfiled, list){
+			if(ptr == hdr + 1) return -1;
+		}
+	}
+	return _slab_of(ptr)->cls - self->classes;
+}
+
+void *juci_alloc_lua(void *ud, void *ptr, size_t osize, size_t nsize){
+	struct juci_alloc *self = (struct juci_alloc*)ud;
+	// when ptr is NULL lua may pass a type tag in osize so treat it as zero
+	if(!ptr) osize = 0;
+	int oc = (ptr)?_owner_class(self, ptr, osize):-1;
+
+	if(nsize == 0){
+		if(!ptr) return NULL;
+		self->used -= osize;
+		if(oc >= 0) _class_free(&self->classes[oc], ptr);
+		else _large_free(self, ptr);
+		return NULL;
+	}
+
+	// only growing can fail. lua requires that shrinking a block always succeeds.
+	if(nsize > osize && self->hard_limit && self->used + (nsize - osize) > self->hard_limit){
+		self->failed++;
+		return NULL;
+	}
+
+	int nc = _class_index(nsize);
+
+	// both sizes are large: let libc resize in place if it can
+	if(ptr && oc < 0 && nc < 0){
+		struct juci_alloc_large *hdr = _large_of(ptr);
+		size_t size = hdr->size;
+		bool misfiled = !list_empty(&hdr->list);
+		// realloc may move the block so it can not stay linked
+		list_del_init(&hdr->list);
+		struct juci_alloc_large *nhdr = realloc(hdr, sizeof(struct juci_alloc_large) + nsize);
+		if(!nhdr){
+			if(nsize > osize){
+				if(misfiled) list_add(&hdr->list, &self->misfiled);
+				return NULL;
+			}
+			// the old block is big enough
+			_account(self, osize, nsize);
+			return ptr;
+		}
+		INIT_LIST_HEAD(&nhdr->list);
+		nhdr->size = nsize;
+		self->large_bytes = self->large_bytes - size + nsize;
+		_account(self, osize, nsize);
+		return nhdr + 1;
+	}
+
+	// block already fits in the class it lives in
+	if(ptr && oc >= 0 && oc == nc) {
+		_account(self, osize, nsize);
+		return ptr;
+	}
+
+	void *nptr = (nc >= 0)?_class_alloc(&self->classes[nc]):_large_alloc(self, nsize);
+	if(!nptr){
+		if(!ptr || nsize > osize) return NULL;
+		// keep the bigger block rather than fail a shrink
+		if(oc < 0) list_move(&_large_of(ptr)->list, &self->misfiled);
+		_account(self, osize, nsize);
+		return ptr;
+	}
+
+	if(ptr){
+		memcpy(nptr, ptr, (osize < nsize)?osize:nsize);
+		if(oc >= 0) _class_free(&self->classes[oc], ptr);
+		else _large_free(self, ptr);
+	}
+	_account(self, osize, nsize);
+	return nptr;
+}
+
+void juci_alloc_set_limits(struct juci_alloc *self, size_t soft, size_t hard){
+	self->soft_limit = soft;
+	self->hard_limit = hard;
+}
+
+size_t juci_alloc_mapped_bytes(struct juci_alloc *self){
+	size_t total = self->large_bytes;
+	for(int c = 0; c < JUCI_ALLOC_NUM_CLASSES; c++){
+		total += (size_t)self->classes[c].slabs * JUCI_ALLOC_SLAB_SIZE;
+	}
+	return total;
+}
+
+void juci_alloc_to_blob(struct juci_alloc *self, struct blob *buf){
+	blob_offset_t t = blob_open_table(buf);
+	blob_put_string(buf, "used");
+	blob_put_int(buf, self->used);
+	blob_put_string(buf, "peak");
+	blob_put_int(buf, self->peak);
+	blob_put_string(buf, "soft_limit");
+	blob_put_int(buf, self->soft_limit);
+	blob_put_string(buf, "hard_limit");
+	blob_put_int(buf, self->hard_limit);
+	blob_put_string(buf, "failed");
+	blob_put_int(buf, self->failed);
+	blob_put_string(buf, "mapped");
+	blob_put_int(buf, juci_alloc_mapped_bytes(self));
+	blob_put_string(buf, "classes");
+	blob_offset_t a = blob_open_array(buf);
+	for(int c = 0; c < JUCI_ALLOC_NUM_CLASSES; c++){
+		struct juci_alloc_class *cls = &self->classes[c];
+		blob_offset_t o = blob_open_table(buf);
+		blob_put_string(buf, "size"); blob_put_int(buf, cls->size);
+		blob_put_string(buf, "allocs"); blob_put_int(buf, cls->allocs);
+		blob_put_string(buf, "frees"); blob_put_int(buf, cls->frees);
+		blob_put_string(buf, "live"); blob_put_int(buf, cls->live);
+		blob_put_string(buf, "bytes"); blob_put_int(buf, (size_t)cls->live * cls->size);
+		blob_put_string(buf, "slabs"); blob_put_int(buf, cls->slabs);
+		blob_close_table(buf, o);
+	}
+	blob_close_array(buf, a);
+	blob_put_string(buf, "large");
+	blob_offset_t l = blob_open_table(buf);
+	blob_put_string(buf, "allocs"); blob_put_int(buf, self->large_allocs);
+	blob_put_string(buf, "frees"); blob_put_int(buf, self->large_frees);
+	blob_put_string(buf, "bytes"); blob_put_int(buf, self->large_bytes);
+	blob_close_table(buf, l);
+	blob_close_table(buf, t);
+}
@@ -0,0 +1,79 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <blobpack/blobpack.h>
+#include <libutype/list.h>
+
+// size of one slab. Slabs are mapped aligned to their size so that the owning
+// slab of any object can be found by masking the object pointer.
+#define JUCI_ALLOC_SLAB_SIZE (16 * 1024)
+#define JUCI_ALLOC_NUM_CLASSES 14
+
+struct juci_alloc_class {
+	struct list_head partial; // slabs with at least one free object
+	struct list_head full;
+	uint32_t size;
+
+	// statistics
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t live;
+	uint32_t slabs;
+};
+
+/*
+ * Per lua state allocator. Small objects are carved out of size class slabs
+ * that are mapped directly from the kernel so lua objects never share heap
+ * pages with the rest of the daemon. Slabs that become completely free are
+ * unmapped and all remaining slabs are unmapped when the allocator is deleted.
+ */
+struct juci_alloc {
+	struct juci_alloc_class classes[JUCI_ALLOC_NUM_CLASSES];
+
+	// allocations that are served by libc
+	struct list_head misfiled; // libc blocks that lua believes to be small after a failed shrink
+	uint32_t large_allocs;
+	uint32_t large_frees;
+	size_t large_bytes;
+
+	// bytes currently requested by lua and the high water mark
+	size_t used;
+	size_t peak;
+
+	// growing past the hard limit fails the allocation (0 = unlimited)
+	size_t soft_limit;
+	size_t hard_limit;
+	uint32_t failed;
+};
+
+struct juci_alloc *juci_alloc_new(void);
+void juci_alloc_delete(struct juci_alloc **self);
+
+// lua_Alloc compatible allocation function. ud must point to a juci_alloc.
+void *juci_alloc_lua(void *ud, void *ptr, size_t osize, size_t nsize);
+
+void juci_alloc_set_limits(struct juci_alloc *self, size_t soft, size_t hard);
+static inline bool juci_alloc_over_soft_limit(struct juci_alloc *self){ return self->soft_limit && self->used > self->soft_limit; }
+static inline bool juci_alloc_over_hard_limit(struct juci_alloc *self){ return self->hard_limit && self->used >= self->hard_limit; }
+
+size_t juci_alloc_mapped_bytes(struct juci_alloc *self);
+void juci_alloc_to_blob(struct juci_alloc *self, struct blob *buf);
@@ -0,0 +1,203 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <net/if.h>
+
+#include <libutype/avl.h>
+#include <libutype/avl-cmp.h>
+
+#include "internal.h"
+#include "juci_bwmon.h"
+
+#define JUCI_BWMON_STATS "/proc/net/dev"
+
+struct juci_bwmon_iface {
+	struct avl_node avl;
+	char name[IFNAMSIZ];
+	// round in which the interface was last seen
+	unsigned long round;
+	unsigned head;
+	unsigned count;
+	struct juci_bwmon_sample samples[];
+};
+
+static struct {
+	struct avl_tree ifaces;
+	bool initialized;
+	unsigned interval;
+	unsigned history;
+	uint64_t next;
+	unsigned long round;
+} _bwmon = { .interval = JUCI_BWMON_INTERVAL, .history = JUCI_BWMON_HISTORY };
+
+static void _bwmon_init(void){
+	if(_bwmon.initialized) return;
+	avl_init(&_bwmon.ifaces, avl_strcmp, false, NULL);
+	_bwmon.initialized = true;
+}
+
+static void _bwmon_drop_all(void){
+	struct juci_bwmon_iface *iface, *tmp;
+	avl_remove_all_elements(&_bwmon.ifaces, iface, avl, tmp)
+		free(iface);
+}
+
+void juci_bwmon_configure(unsigned interval, unsigned history){
+	_bwmon_init();
+	if(history < 1) history = 1;
+	if(history != _bwmon.history) _bwmon_drop_all();
+	_bwmon.interval = interval;
+	_bwmon.history = history;
+	_bwmon.next = 0;
+	if(!interval) _bwmon_drop_all();
+}
+
+static struct juci_bwmon_iface *_bwmon_iface(const char *name){
+	struct juci_bwmon_iface *iface = avl_find_element(&_bwmon.ifaces, name, iface, avl);
+	size_t len = strlen(name);
+	if(iface) return iface;
+	if(len >= IFNAMSIZ) return NULL;
+	iface = calloc(1, sizeof(struct juci_bwmon_iface) + _bwmon.history * sizeof(struct juci_bwmon_sample));
+	if(!iface) return NULL;
+	memcpy(iface->name, name, len + 1);
+	iface->avl.key = iface->name;
+	avl_insert(&_bwmon.ifaces, &iface->avl);
+	return iface;
+}
+
+static void _bwmon_add(struct juci_bwmon_iface *iface, const struct juci_bwmon_sample *sample){
+	if(iface->count == _bwmon.history){
+		iface->samples[iface->head] = *sample;
+		iface->head = (iface->head + 1) % _bwmon.history;
+	} else {
+		iface->samples[(iface->head + iface->count) % _bwmon.history] = *sample;
+		iface->count++;
+	}
+}
+
+static inline const struct juci_bwmon_sample *_bwmon_at(struct juci_bwmon_iface *iface, unsigned idx){
+	return &iface->samples[(iface->head + idx) % _bwmon.history];
+}
+
+static int _bwmon_sample(void){
+	char line[512];
+	FILE *file = fopen(JUCI_BWMON_STATS, "re");
+	if(!file) return -errno;
+
+	struct juci_bwmon_sample sample = { .time = time(NULL) };
+	_bwmon.round++;
+	while(fgets(line, sizeof(line), file)){
+		char *colon = strchr(line, ':');
+		if(!colon) continue; // header lines
+		*colon = 0;
+		char *name = line;
+		while(*name == ' ') name++;
+		unsigned long long rxb, rxp, txb, txp;
+		if(sscanf(colon + 1, "%llu %llu %*u %*u %*u %*u %*u %*u %llu %llu", &rxb, &rxp, &txb, &txp) != 4) continue;
+		struct juci_bwmon_iface *iface = _bwmon_iface(name);
+		if(!iface) continue;
+		sample.rx_bytes = rxb;
+		sample.rx_packets = rxp;
+		sample.tx_bytes = txb;
+		sample.tx_packets = txp;
+		_bwmon_add(iface, &sample);
+		iface->round = _bwmon.round;
+	}
+	fclose(file);
+
+	struct juci_bwmon_iface *iface, *tmp;
+	avl_for_each_element_safe(&_bwmon.ifaces, iface, avl, tmp){
+		if(iface->round == _bwmon.round) continue;
+		avl_delete(&_bwmon.ifaces, &iface->avl);
+		free(iface);
+	}
+	return 0;
+}
+
+int juci_bwmon_poll(uint64_t now_ms){
+	_bwmon_init();
+	if(!_bwmon.interval || now_ms < _bwmon.next) return 0;
+	// stay on the interval grid unless the loop fell behind by more than a sample
+	_bwmon.next += _bwmon.interval * 1000ULL;
+	if(_bwmon.next <= now_ms) _bwmon.next = now_ms + _bwmon.interval * 1000ULL;
+	int ret = _bwmon_sample();
+	if(ret < 0){
+		DEBUG("bwmon: could not read %s: %s\n", JUCI_BWMON_STATS, strerror(-ret));
+		return ret;
+	}
+	return 1;
+}
+
+int juci_bwmon_foreach(const char *device, juci_bwmon_cb cb, void *arg){
+	struct juci_bwmon_iface *iface;
+	_bwmon_init();
+	if(!device){
+		avl_for_each_element(&_bwmon.ifaces, iface, avl){
+			if(iface->count) cb(iface->name, _bwmon_at(iface, iface->count - 1), arg);
+		}
+		return 0;
+	}
+	iface = avl_find_element(&_bwmon.ifaces, device, iface, avl);
+	if(!iface) return -ENOENT;
+	for(unsigned c = 0; c < iface->count; c++){
+		cb(iface->name, _bwmon_at(iface, c), arg);
+	}
+	return 0;
+}
+
+static void _bwmon_put_sample(struct blob *out, const struct juci_bwmon_sample *sample){
+	blob_offset_t a = blob_open_array(out);
+	blob_put_int(out, sample->time);
+	blob_put_int(out, sample->rx_bytes);
+	blob_put_int(out, sample->rx_packets);
+	blob_put_int(out, sample->tx_bytes);
+	blob_put_int(out, sample->tx_packets);
+	blob_close_array(out, a);
+}
+
+void juci_bwmon_latest_to_blob(struct blob *out){
+	struct juci_bwmon_iface *iface;
+	_bwmon_init();
+	blob_offset_t t = blob_open_table(out);
+	avl_for_each_element(&_bwmon.ifaces, iface, avl){
+		if(!iface->count) continue;
+		blob_put_string(out, iface->name);
+		_bwmon_put_sample(out, _bwmon_at(iface, iface->count - 1));
+	}
+	blob_close_table(out, t);
+}
+
+void juci_bwmon_to_blob(struct blob *out){
+	struct juci_bwmon_iface *iface;
+	_bwmon_init();
+	blob_offset_t t = blob_open_table(out);
+	avl_for_each_element(&_bwmon.ifaces, iface, avl){
+		blob_put_string(out, iface->name);
+		blob_offset_t a = blob_open_array(out);
+		for(unsigned c = 0; c < iface->count; c++){
+			_bwmon_put_sample(out, _bwmon_at(iface, c));
+		}
+		blob_close_array(out, a);
+	}
+	blob_close_table(out, t);
+}
@@ -0,0 +1,57 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <blobpack/blobpack.h>
+
+#define JUCI_BWMON_TOPIC "network.bandwidth"
+// seconds between samples
+#define JUCI_BWMON_INTERVAL 1
+// samples kept for each interface
+#define JUCI_BWMON_HISTORY 120
+
+struct juci_bwmon_sample {
+	// unix time
+	uint32_t time;
+	uint64_t rx_bytes;
+	uint64_t rx_packets;
+	uint64_t tx_bytes;
+	uint64_t tx_packets;
+};
+
+typedef void (*juci_bwmon_cb)(const char *device, const struct juci_bwmon_sample *sample, void *arg);
+
+/*
+ * Interface counters are read from /proc/net/dev by the main loop every
+ * interval seconds into a ring of the last history samples of each
+ * interface, so graphs of all clients are served from the same samples.
+ * Interfaces that disappear are dropped with their samples.
+ */
+
+// changes the interval (0 stops sampling) and history length, dropping the samples on a new length
+void juci_bwmon_configure(unsigned interval, unsigned history);
+// takes a sample when one is due, returns 1 if it did
+int juci_bwmon_poll(uint64_t now_ms);
+// calls cb for the samples of a device (oldest first) or the latest sample of each device when device is NULL
+int juci_bwmon_foreach(const char *device, juci_bwmon_cb cb, void *arg);
+// table of the latest sample of each device as {device: [time, rx_bytes, rx_packets, tx_bytes, tx_packets]}
+void juci_bwmon_latest_to_blob(struct blob *out);
+// table of all samples of each device as {device: [[time, rx_bytes, ...], ...]}
+void juci_bwmon_to_blob(struct blob *out);
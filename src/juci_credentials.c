@@ -0,0 +1,203 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <uci.h>
+#include <libutype/avl-cmp.h>
+
+#include "internal.h"
+#include "juci_credentials.h"
+
+#define JUCI_UCI_PACKAGE "jucid"
+
+static void _file_stamp(const char *path, struct juci_file_stamp *stamp){
+	struct stat st;
+	memset(stamp, 0, sizeof(*stamp));
+	if(stat(path, &st) != 0) return;
+	stamp->exists = true;
+	stamp->dev = st.st_dev;
+	stamp->ino = st.st_ino;
+	stamp->size = st.st_size;
+	stamp->mtime = st.st_mtim;
+}
+
+static bool _file_stamp_equal(const struct juci_file_stamp *a, const struct juci_file_stamp *b){
+	return a->exists == b->exists && a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+		a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+// taken from rpcd source code (session.c)
+
+static void _juci_user_load_acls(struct juci_user *self, struct uci_section *s){
+	struct uci_option *o;
+	struct uci_element *e, *l;
+
+	uci_foreach_element(&s->options, e){
+		o = uci_to_option(e);
+
+		if (o->type != UCI_TYPE_LIST)
+			continue;
+
+		if (strcmp(o->e.name, "acls"))
+			continue;
+
+		uci_foreach_element(&o->v.list, l) {
+			juci_user_add_acl(self, l->name);
+		}
+	}
+}
+
+static bool _juci_load_users(struct avl_tree *users){
+	struct uci_package *p = NULL;
+	struct uci_section *s;
+	struct uci_element *e;
+	struct uci_ptr ptr = { .package = JUCI_UCI_PACKAGE };
+	struct uci_context *uci = uci_alloc_context();
+
+	uci_load(uci, ptr.package, &p);
+
+	if (!p){
+		uci_free_context(uci);
+		return false;
+	}
+
+	uci_foreach_element(&p->sections, e)
+	{
+		s = uci_to_section(e);
+
+		if (strcmp(s->type, "login"))
+			continue;
+
+		struct juci_user *user = juci_user_new(s->e.name);
+
+		_juci_user_load_acls(user, s);
+
+		TRACE("JUCI: loaded user config for user '%s'\n", s->e.name);
+
+		if(avl_insert(users, &user->avl) != 0) juci_user_unref(&user);
+	}
+
+	uci_free_context(uci);
+
+	return true;
+}
+
+static int _juci_load_passwords(struct avl_tree *users, const char *pwfile){
+	DEBUG("loading passwords from %s\n", pwfile);
+	int fd = open(pwfile, O_RDONLY);
+	if(fd == -1) return -EACCES;
+	FILE *file = fdopen(fd, "r");
+	if(!file) {
+		close(fd);
+		return -EACCES;
+	}
+	char line[256], username[32], hash[64];
+	while(fgets(line, sizeof(line), file)){
+		if(sscanf(line, "%31s %63s", username, hash) != 2) continue;
+		struct juci_user *user = avl_find_element(users, username, user, avl);
+		if(user) juci_user_set_pw_hash(user, hash);
+	}
+	fclose(file);
+	return 0;
+}
+
+static void _free_users(struct avl_tree *users){
+	struct juci_user *user, *nuser;
+	avl_remove_all_elements(users, user, avl, nuser)
+		juci_user_unref(&user);
+	free(users);
+}
+
+static int _reload(struct juci_credentials *self){
+	struct avl_tree *users = calloc(1, sizeof(struct avl_tree));
+	assert(users);
+	avl_init(users, avl_strcmp, false, NULL);
+
+	// stamp before reading so that a change during the read triggers another reload
+	struct juci_file_stamp pw_stamp, uci_stamp;
+	_file_stamp(self->pwfile, &pw_stamp);
+	_file_stamp(self->uci_file, &uci_stamp);
+
+	if(!_juci_load_users(users) && self->users){
+		ERROR("could not load users, keeping previous user table\n");
+		_free_users(users);
+		return -EIO;
+	}
+	if(_juci_load_passwords(users, self->pwfile) != 0){
+		ERROR("could not load password file from %s\n", self->pwfile);
+	}
+
+	// swap in the complete new table. Sessions hold references to their users.
+	if(self->users) _free_users(self->users);
+	self->users = users;
+	self->pw_stamp = pw_stamp;
+	self->uci_stamp = uci_stamp;
+	self->reloads++;
+	return 0;
+}
+
+struct juci_credentials *juci_credentials_new(const char *pwfile){
+	struct juci_credentials *self = calloc(1, sizeof(struct juci_credentials));
+	assert(self);
+	self->pwfile = strdup(pwfile);
+
+	struct uci_context *uci = uci_alloc_context();
+	size_t len = strlen(uci->confdir) + strlen(JUCI_UCI_PACKAGE) + 2;
+	self->uci_file = calloc(1, len);
+	assert(self->uci_file);
+	snprintf(self->uci_file, len, "%s/%s", uci->confdir, JUCI_UCI_PACKAGE);
+	uci_free_context(uci);
+
+	_reload(self);
+	return self;
+}
+
+void juci_credentials_delete(struct juci_credentials **_self){
+	struct juci_credentials *self = *_self;
+	if(self->users) _free_users(self->users);
+	free(self->uci_file);
+	free(self->pwfile);
+	free(self);
+	*_self = NULL;
+}
+
+int juci_credentials_refresh(struct juci_credentials *self){
+	struct juci_file_stamp pw_stamp, uci_stamp;
+	_file_stamp(self->pwfile, &pw_stamp);
+	_file_stamp(self->uci_file, &uci_stamp);
+	if(_file_stamp_equal(&pw_stamp, &self->pw_stamp) && _file_stamp_equal(&uci_stamp, &self->uci_stamp)) return 0;
+	DEBUG("credentials changed, reloading\n");
+	return _reload(self);
+}
+
+struct juci_user *juci_credentials_lookup(struct juci_credentials *self, const char *username){
+	struct juci_user *user = avl_find_element(self->users, username, user, avl);
+	return user;
+}
+
+struct juci_user *juci_credentials_find_user(struct juci_credentials *self, const char *username){
+	juci_credentials_refresh(self);
+	return juci_credentials_lookup(self, username);
+}
@@ -0,0 +1,60 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+#include <libutype/avl.h>
+
+#include "juci_user.h"
+
+// identity of a file version. Any change of these means the file must be read again.
+struct juci_file_stamp {
+	bool exists;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+};
+
+/*
+ * Users from the jucid uci config together with their password hashes. The
+ * table is parsed once and only parsed again when one of the source files
+ * changes, in which case a complete new table is built and swapped in. Users
+ * are reference counted so that sessions keep the user they logged in as
+ * even after the table has been replaced.
+ */
+struct juci_credentials {
+	struct avl_tree *users;
+	char *pwfile;
+	char *uci_file;
+	struct juci_file_stamp pw_stamp;
+	struct juci_file_stamp uci_stamp;
+	unsigned int reloads;
+};
+
+struct juci_credentials *juci_credentials_new(const char *pwfile);
+void juci_credentials_delete(struct juci_credentials **self);
+
+// reloads the table if the password file or the uci config have changed
+int juci_credentials_refresh(struct juci_credentials *self);
+struct juci_user *juci_credentials_find_user(struct juci_credentials *self, const char *username);
+// same as find_user but without checking the files for changes
+struct juci_user *juci_credentials_lookup(struct juci_credentials *self, const char *username);
+static inline unsigned int juci_credentials_count(struct juci_credentials *self){ return self->users->count; }
@@ -0,0 +1,389 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <libutype/avl-cmp.h>
+
+#include "internal.h"
+#include "juci_dirindex.h"
+
+#define JUCI_DIRINDEX_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+static struct {
+	int fd;
+	// becomes readable with POLLPRI when something is mounted or unmounted
+	int mounts_fd;
+	struct avl_tree watches;
+	struct juci_dirnode *roots[JUCI_DIRINDEX_ROOTS];
+	int count;
+	unsigned long nodes;
+	// watches held by nodes and how many of them the index may use
+	unsigned long watched, max_watched;
+	bool initialized;
+} _index = { .fd = -1, .mounts_fd = -1 };
+
+static int _wd_cmp(const void *k1, const void *k2, void *ptr){
+	int a = *(const int*)k1, b = *(const int*)k2;
+	return (a > b) - (a < b);
+}
+
+// the watch limit is per user, so leave most of it to the other processes running as root
+static unsigned long _watch_budget(void){
+	unsigned long budget = JUCI_DIRINDEX_MAX_WATCHES, user_max = 0;
+	FILE *file = fopen("/proc/sys/fs/inotify/max_user_watches", "re");
+	if(!file) return budget;
+	if(fscanf(file, "%lu", &user_max) == 1 && user_max / 4 < budget) budget = user_max / 4;
+	fclose(file);
+	return budget;
+}
+
+static void _index_init(void){
+	if(_index.initialized) return;
+	_index.initialized = true;
+	avl_init(&_index.watches, _wd_cmp, false, NULL);
+	_index.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(_index.fd < 0) ERROR("dirindex: inotify is not available, directories will be read on every query\n");
+	_index.max_watched = _watch_budget();
+	DEBUG("dirindex: using at most %lu inotify watches\n", _index.max_watched);
+	_index.mounts_fd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+}
+
+static bool _index_full(void){
+	return _index.nodes >= JUCI_DIRINDEX_MAX_NODES || (_index.fd >= 0 && _index.watched >= _index.max_watched);
+}
+
+static struct juci_dirnode *_node_new(struct juci_dirnode *parent, const char *name){
+	if(_index.nodes >= JUCI_DIRINDEX_MAX_NODES) return NULL;
+	struct juci_dirnode *self = calloc(1, sizeof(struct juci_dirnode) + strlen(name) + 1);
+	if(!self) return NULL;
+	strcpy(self->name, name);
+	self->avl.key = self->name;
+	self->wd_avl.key = &self->wd;
+	self->wd = -1;
+	self->parent = parent;
+	avl_init(&self->children, avl_strcmp, false, NULL);
+	if(parent) avl_insert(&parent->children, &self->avl);
+	_index.nodes++;
+	return self;
+}
+
+static void _node_unwatch(struct juci_dirnode *self){
+	if(self->wd < 0) return;
+	inotify_rm_watch(_index.fd, self->wd);
+	avl_delete(&_index.watches, &self->wd_avl);
+	self->wd = -1;
+	_index.watched--;
+}
+
+static void _node_delete(struct juci_dirnode *self);
+
+// forgets the subdirectories of a node so that they are read again when needed
+static void _node_clear(struct juci_dirnode *self){
+	struct juci_dirnode *child, *tmp;
+	avl_for_each_element_safe(&self->children, child, avl, tmp){
+		_node_delete(child);
+	}
+	self->scanned = false;
+}
+
+static void _node_delete(struct juci_dirnode *self){
+	_node_clear(self);
+	_node_unwatch(self);
+	if(self->parent) avl_delete(&self->parent->children, &self->avl);
+	_index.nodes--;
+	free(self);
+}
+
+static void _index_drop_all(void){
+	for(int c = 0; c < _index.count; c++){
+		_node_clear(_index.roots[c]);
+		_node_unwatch(_index.roots[c]);
+	}
+}
+
+int juci_dirindex_path(struct juci_dirnode *node, char *buf, size_t size){
+	size_t len = 0;
+	if(node->parent){
+		int ret = juci_dirindex_path(node->parent, buf, size);
+		if(ret < 0) return ret;
+		len = ret;
+	} else if(strcmp(node->name, "/") == 0){
+		// the name of a root is its path
+		if(size < 2) return -ENAMETOOLONG;
+		strcpy(buf, "/");
+		return 1;
+	}
+	int ret = snprintf(buf + len, size - len, "%s/", node->name);
+	if(ret < 0 || ret >= size - len) return -ENAMETOOLONG;
+	return len + ret;
+}
+
+// returns -ENOSPC when the watch budget of the index or of the user is used up
+static int _node_watch(struct juci_dirnode *self, const char *path){
+	if(self->wd >= 0 || _index.fd < 0) return 0;
+	if(_index.watched >= _index.max_watched) return -ENOSPC;
+	int wd = inotify_add_watch(_index.fd, path, JUCI_DIRINDEX_EVENTS);
+	if(wd < 0) return -errno;
+	self->wd = wd;
+	// the same directory reached through two roots can only be tracked by one of them
+	if(avl_insert(&_index.watches, &self->wd_avl) != 0){
+		self->wd = -1;
+		return 0;
+	}
+	_index.watched++;
+	return 0;
+}
+
+static bool _is_dir(const char *dir, struct dirent *ent){
+	if(ent->d_type != DT_UNKNOWN) return ent->d_type == DT_DIR;
+	char path[PATH_MAX];
+	struct stat st;
+	size_t dlen = strlen(dir), nlen = strlen(ent->d_name);
+	if(dlen + nlen >= sizeof(path)) return false;
+	memcpy(path, dir, dlen);
+	memcpy(path + dlen, ent->d_name, nlen + 1);
+	return lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// reads the subdirectories of a node, keeping as many as fit into the index
+static int _node_read(struct juci_dirnode *self){
+	char path[PATH_MAX];
+	int ret;
+
+	if(juci_dirindex_path(self, path, sizeof(path)) < 0) return -ENAMETOOLONG;
+	_node_clear(self);
+	// watch first so that nothing that happens while reading is missed
+	if((ret = _node_watch(self, path)) == -ENOSPC){
+		self->truncated = true;
+		return ret;
+	}
+	ret = 0;
+	DIR *dir = opendir(path);
+	if(!dir){
+		ret = -errno;
+		_node_unwatch(self);
+		return ret;
+	}
+	struct dirent *ent;
+	while((ent = readdir(dir))){
+		if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+		if(!_is_dir(path, ent)) continue;
+		if(!_node_new(self, ent->d_name)){
+			ret = -ENOSPC;
+			break;
+		}
+	}
+	closedir(dir);
+	self->truncated = (ret == -ENOSPC);
+	// a directory that is not watched can change unnoticed and is read again next time
+	self->scanned = (self->wd >= 0);
+	return ret;
+}
+
+// reads the subdirectories of a node unless they are already known, then depth - 1 levels below
+static int _node_scan(struct juci_dirnode *self, int depth){
+	struct juci_dirnode *child;
+	int ret = 0;
+
+	if(depth <= 0) return 0;
+	if(!self->scanned || self->truncated){
+		// nothing is read while the index is full so that every query does not read the same directories again
+		if(_index_full()){
+			self->truncated = true;
+			ret = -ENOSPC;
+		} else if((ret = _node_read(self)) < 0 && ret != -ENOSPC){
+			return ret;
+		}
+	}
+	if(depth == 1) return ret;
+	avl_for_each_element(&self->children, child, avl){
+		if(_node_scan(child, depth - 1) != -ENOSPC) continue;
+		ret = -ENOSPC;
+		// stop descending once the budget is used up
+		if(_index_full()) break;
+	}
+	return ret;
+}
+
+static void _index_event(struct inotify_event *ev){
+	struct juci_dirnode *node, *child;
+	if(ev->mask & IN_Q_OVERFLOW){
+		_index_drop_all();
+		return;
+	}
+	node = avl_find_element(&_index.watches, &ev->wd, node, wd_avl);
+	if(!node) return;
+	if(ev->mask & (IN_IGNORED | IN_UNMOUNT)){
+		// the kernel has removed the watch
+		avl_delete(&_index.watches, &node->wd_avl);
+		node->wd = -1;
+		node->scanned = false;
+		_index.watched--;
+		return;
+	}
+	if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)){
+		// other directories are removed through the event of their parent
+		if(!node->parent){
+			_node_clear(node);
+			_node_unwatch(node);
+		}
+		return;
+	}
+	if(!(ev->mask & IN_ISDIR) || !ev->len || !node->scanned) return;
+	child = avl_find_element(&node->children, ev->name, child, avl);
+	if(ev->mask & (IN_CREATE | IN_MOVED_TO)){
+		if(!child && !_node_new(node, ev->name)) node->truncated = true;
+	} else if(ev->mask & (IN_DELETE | IN_MOVED_FROM)){
+		if(child) _node_delete(child);
+	}
+}
+
+static void _index_update(void){
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	if(_index.mounts_fd >= 0){
+		struct pollfd pfd = { .fd = _index.mounts_fd, .events = POLLPRI };
+		if(poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLERR | POLLPRI))){
+			DEBUG("dirindex: mount table changed\n");
+			_index_drop_all();
+		}
+	}
+	if(_index.fd < 0) return;
+	while(1){
+		ssize_t len = read(_index.fd, buf, sizeof(buf));
+		if(len < 0 && errno == EINTR) continue;
+		if(len <= 0) break;
+		for(char *ptr = buf; ptr < buf + len; ){
+			struct inotify_event *ev = (struct inotify_event*)ptr;
+			_index_event(ev);
+			ptr += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+}
+
+// copies an absolute path without empty and trailing components, rejecting . and ..
+static int _normalize(const char *path, char *out, size_t size){
+	size_t len = 0;
+	if(!path || path[0] != '/') return -EINVAL;
+	for(const char *ptr = path; *ptr; ){
+		while(*ptr == '/') ptr++;
+		const char *end = strchr(ptr, '/');
+		if(!end) end = ptr + strlen(ptr);
+		size_t n = end - ptr;
+		if(!n) break;
+		if((n == 1 && ptr[0] == '.') || (n == 2 && ptr[0] == '.' && ptr[1] == '.')) return -EINVAL;
+		if(len + n + 2 > size) return -ENAMETOOLONG;
+		out[len++] = '/';
+		memcpy(out + len, ptr, n);
+		len += n;
+		ptr = end;
+	}
+	if(!len) out[len++] = '/';
+	out[len] = 0;
+	return 0;
+}
+
+int juci_dirindex_add_root(const char *path){
+	char norm[PATH_MAX];
+	int ret = _normalize(path, norm, sizeof(norm));
+	if(ret < 0) return ret;
+	_index_init();
+	if(_index.count == JUCI_DIRINDEX_ROOTS) return -ENOSPC;
+	for(int c = 0; c < _index.count; c++){
+		if(strcmp(_index.roots[c]->name, norm) == 0) return -EEXIST;
+	}
+	struct juci_dirnode *root = _node_new(NULL, norm);
+	if(!root) return -ENOMEM;
+	_index.roots[_index.count++] = root;
+	return 0;
+}
+
+void juci_dirindex_clear_roots(void){
+	for(int c = 0; c < _index.count; c++){
+		_node_delete(_index.roots[c]);
+	}
+	_index.count = 0;
+}
+
+struct juci_dirnode *juci_dirindex_root(int index){
+	if(index < 0 || index >= _index.count) return NULL;
+	return _index.roots[index];
+}
+
+// the root that a path is in, preferring the deepest one when roots are nested
+static struct juci_dirnode *_find_root(const char *path, const char **rest){
+	struct juci_dirnode *found = NULL;
+	size_t found_len = 0;
+	for(int c = 0; c < _index.count; c++){
+		const char *name = _index.roots[c]->name;
+		size_t len = (strcmp(name, "/") == 0)?0:strlen(name);
+		if(strncmp(path, name, len) != 0 || (path[len] != '/' && path[len] != 0)) continue;
+		if(found && len < found_len) continue;
+		found = _index.roots[c];
+		found_len = len;
+	}
+	if(found) *rest = path + found_len;
+	return found;
+}
+
+struct juci_dirnode *juci_dirindex_lookup(const char *path, int depth, int *err){
+	char norm[PATH_MAX];
+	const char *rest = NULL;
+	int ret = _normalize(path, norm, sizeof(norm));
+	if(ret < 0){
+		*err = ret;
+		return NULL;
+	}
+	_index_init();
+	_index_update();
+
+	struct juci_dirnode *node = _find_root(norm, &rest);
+	if(!node){
+		*err = -EACCES;
+		return NULL;
+	}
+	for(char *name = strtok((char*)rest, "/"); name; name = strtok(NULL, "/")){
+		if((ret = _node_scan(node, 1)) < 0 && ret != -ENOSPC){
+			*err = ret;
+			return NULL;
+		}
+		struct juci_dirnode *child = avl_find_element(&node->children, name, child, avl);
+		if(!child){
+			// it may be one of the directories left out of a full index
+			*err = node->truncated?-ENOSPC:-ENOENT;
+			return NULL;
+		}
+		node = child;
+	}
+	if((ret = _node_scan(node, depth)) < 0 && ret != -ENOSPC){
+		*err = ret;
+		return NULL;
+	}
+	*err = ret;
+	return node;
+}
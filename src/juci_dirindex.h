@@ -0,0 +1,75 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <libutype/avl.h>
+
+// directories kept in the index of all roots together
+#ifndef JUCI_DIRINDEX_MAX_NODES
+#define JUCI_DIRINDEX_MAX_NODES 20000
+#endif
+// inotify watches used by the index, further limited to a quarter of fs.inotify.max_user_watches
+#ifndef JUCI_DIRINDEX_MAX_WATCHES
+#define JUCI_DIRINDEX_MAX_WATCHES 2048
+#endif
+#define JUCI_DIRINDEX_ROOTS 8
+
+struct juci_dirnode {
+	struct avl_node avl;
+	// by inotify watch descriptor
+	struct avl_node wd_avl;
+	struct juci_dirnode *parent;
+	// subdirectories by name
+	struct avl_tree children;
+	int wd;
+	// the children are known and kept up to date
+	bool scanned;
+	// some children were left out because the index was full
+	bool truncated;
+	char name[];
+};
+
+/*
+ * Index of the directories below a few configured roots (such as the mount
+ * points that are shared by samba and minidlna). Directories are read when
+ * a query first needs them and are watched with inotify from then on so
+ * that later queries are answered from memory. Changes to the mount table
+ * drop the index since inotify does not see filesystems being mounted.
+ * Once the watch or node budget is used up directories are no longer read
+ * and queries below them report -ENOSPC; they are read again when the
+ * budget frees up. Without inotify every query reads the directories.
+ */
+
+// adds a root directory to the index (at most JUCI_DIRINDEX_ROOTS)
+int juci_dirindex_add_root(const char *path);
+void juci_dirindex_clear_roots(void);
+// the node of a root in the order they were added, NULL past the last one
+struct juci_dirnode *juci_dirindex_root(int index);
+
+/*
+ * Returns the node of a directory below a root with its subdirectories
+ * read depth levels down, or NULL with the error in *err when the path is
+ * not below a root or does not exist. *err is -ENOSPC when the index is
+ * full and some of the subdirectories are missing.
+ */
+struct juci_dirnode *juci_dirindex_lookup(const char *path, int depth, int *err);
+
+// writes the absolute path of a node with a trailing slash
+int juci_dirindex_path(struct juci_dirnode *node, char *buf, size_t size);
@@ -0,0 +1,96 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images). 
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal.h"
+#include "juci_dispatch.h"
+#include "juci_luaobject.h"
+
+#define JUCI_DISPATCH_MIN_SIZE 64
+
+// fnv-1a over "object\0method"
+static uint32_t _hash(const char *object, const char *method){
+	uint32_t h = 2166136261u; 
+	for(const char *c = object; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u; 
+	h = (h ^ 0) * 16777619u; 
+	for(const char *c = method; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u; 
+	// zero marks an empty slot
+	return (h)?h:1; 
+}
+
+static void _insert(struct juci_dispatch_entry *entries, uint32_t size, const struct juci_dispatch_entry *e){
+	for(uint32_t i = e->hash & (size - 1);; i = (i + 1) & (size - 1)){
+		if(!entries[i].hash){
+			entries[i] = *e; 
+			return; 
+		}
+	}
+}
+
+static int _resize(struct juci_dispatch *self, uint32_t size){
+	struct juci_dispatch_entry *entries = calloc(size, sizeof(struct juci_dispatch_entry)); 
+	if(!entries) return -ENOMEM; 
+	for(uint32_t c = 0; c < self->size; c++){
+		if(self->entries[c].hash) _insert(entries, size, &self->entries[c]); 
+	}
+	free(self->entries); 
+	self->entries = entries; 
+	self->size = size; 
+	return 0; 
+}
+
+void juci_dispatch_init(struct juci_dispatch *self){
+	memset(self, 0, sizeof(*self)); 
+}
+
+void juci_dispatch_free(struct juci_dispatch *self){
+	free(self->entries); 
+	memset(self, 0, sizeof(*self)); 
+}
+
+int juci_dispatch_add(struct juci_dispatch *self, struct juci_luaobject *obj, struct juci_luaobject_method *method){
+	// keep the load factor at or below one half so probe sequences stay short
+	if((self->count + 1) * 2 > self->size){
+		int ret = _resize(self, (self->size)?self->size * 2:JUCI_DISPATCH_MIN_SIZE); 
+		if(ret < 0) return ret; 
+	}
+	struct juci_luaobject *existing = NULL; 
+	if(juci_dispatch_find(self, obj->name, method->name, &existing)) return -EEXIST; 
+	struct juci_dispatch_entry e = {
+		.hash = _hash(obj->name, method->name), 
+		.obj = obj, 
+		.method = method
+	}; 
+	_insert(self->entries, self->size, &e); 
+	self->count++; 
+	return 0; 
+}
+
+struct juci_luaobject_method *juci_dispatch_find(struct juci_dispatch *self, const char *object, const char *method, struct juci_luaobject **obj){
+	if(!self->size) return NULL; 
+	uint32_t hash = _hash(object, method); 
+	for(uint32_t i = hash & (self->size - 1);; i = (i + 1) & (self->size - 1)){
+		struct juci_dispatch_entry *e = &self->entries[i]; 
+		if(!e->hash) return NULL; 
+		if(e->hash == hash && !strcmp(e->method->name, method) && !strcmp(e->obj->name, object)){
+			*obj = e->obj; 
+			return e->method; 
+		}
+	}
+}
@@ -0,0 +1,45 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images). 
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+struct juci_luaobject; 
+struct juci_luaobject_method; 
+
+struct juci_dispatch_entry {
+	uint32_t hash; 
+	struct juci_luaobject *obj; 
+	struct juci_luaobject_method *method; 
+}; 
+
+/*
+ * Open addressing hash table that maps (object, method) name pairs directly
+ * to the method of a loaded object so that a call needs one probe instead of
+ * a tree walk and a lookup inside the lua state. 
+ */
+struct juci_dispatch {
+	struct juci_dispatch_entry *entries; 
+	uint32_t size; // always a power of two
+	uint32_t count; 
+}; 
+
+void juci_dispatch_init(struct juci_dispatch *self); 
+void juci_dispatch_free(struct juci_dispatch *self); 
+int juci_dispatch_add(struct juci_dispatch *self, struct juci_luaobject *obj, struct juci_luaobject_method *method); 
+struct juci_luaobject_method *juci_dispatch_find(struct juci_dispatch *self, const char *object, const char *method, struct juci_luaobject **obj); 
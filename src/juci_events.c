@@ -0,0 +1,101 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "juci_events.h"
+
+void juci_events_init(struct juci_events *self){
+	memset(self, 0, sizeof(*self));
+	INIT_LIST_HEAD(&self->subscriptions);
+}
+
+void juci_events_free(struct juci_events *self){
+	struct juci_subscription *sub, *nsub;
+	list_for_each_entry_safe(sub, nsub, &self->subscriptions, list){
+		list_del(&sub->list);
+		free(sub);
+	}
+	self->count = 0;
+}
+
+int juci_events_add(struct juci_events *self, uint64_t peer, const char *sid, const char *topic){
+	struct juci_subscription *sub, *last = NULL;
+	int count = 0;
+
+	if(!sid || !topic || !*topic || strlen(sid) >= sizeof(sub->sid)) return -EINVAL;
+	list_for_each_entry(sub, &self->subscriptions, list){
+		if(sub->peer != peer) continue;
+		if(strcmp(sub->topic, topic) == 0){
+			// subscribing again moves the subscription to the new session
+			strcpy(sub->sid, sid);
+			return 0;
+		}
+		last = sub;
+		count++;
+	}
+	if(count >= JUCI_EVENTS_MAX_PER_PEER) return -ENOSPC;
+
+	sub = calloc(1, sizeof(struct juci_subscription) + strlen(topic) + 1);
+	if(!sub) return -ENOMEM;
+	sub->peer = peer;
+	strcpy(sub->sid, sid);
+	strcpy(sub->topic, topic);
+	if(last) list_add(&sub->list, &last->list);
+	else list_add_tail(&sub->list, &self->subscriptions);
+	self->count++;
+	return 0;
+}
+
+void juci_events_remove_subscription(struct juci_events *self, struct juci_subscription *sub){
+	list_del(&sub->list);
+	free(sub);
+	self->count--;
+	self->removed = true;
+}
+
+int juci_events_remove(struct juci_events *self, uint64_t peer, const char *topic){
+	struct juci_subscription *sub, *nsub;
+	int ret = -ENOENT;
+	list_for_each_entry_safe(sub, nsub, &self->subscriptions, list){
+		if(sub->peer != peer || (topic && strcmp(sub->topic, topic) != 0)) continue;
+		juci_events_remove_subscription(self, sub);
+		ret = 0;
+	}
+	return ret;
+}
+
+bool juci_events_wanted(struct juci_events *self, const char *event){
+	struct juci_subscription *sub;
+	list_for_each_entry(sub, &self->subscriptions, list){
+		if(juci_subscription_matches(sub, event)) return true;
+	}
+	return false;
+}
+
+void juci_events_to_blob(struct juci_events *self, struct blob *out){
+	blob_offset_t t = blob_open_table(out);
+	blob_put_string(out, "subscriptions");
+	blob_put_int(out, self->count);
+	blob_put_string(out, "published");
+	blob_put_int(out, self->published);
+	blob_put_string(out, "delivered");
+	blob_put_int(out, self->delivered);
+	blob_close_table(out, t);
+}
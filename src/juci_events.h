@@ -0,0 +1,71 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <fnmatch.h>
+#include <libutype/list.h>
+#include <blobpack/blobpack.h>
+
+#include "juci_session.h"
+
+// most topics (or patterns) a single connection can subscribe to
+#define JUCI_EVENTS_MAX_PER_PEER 32
+
+// delivers an event message to a peer. A negative return drops its subscriptions.
+typedef int (*juci_event_sender_t)(uint64_t peer, struct blob *msg, void *arg);
+
+struct juci_subscription {
+	struct list_head list;
+	uint64_t peer;
+	// session the subscription was made with. It ends with the session.
+	juci_sid_t sid;
+	char topic[];
+};
+
+/*
+ * Event subscriptions of connected clients. A subscription is a topic
+ * pattern that is matched against the names of published events.
+ * Subscriptions of the same peer are kept next to each other so that a peer
+ * with several matching patterns only gets an event once.
+ */
+struct juci_events {
+	struct list_head subscriptions;
+	unsigned int count;
+	// set when subscriptions go away so that unused event sources can be stopped
+	bool removed;
+	juci_event_sender_t send;
+	void *send_arg;
+	unsigned long published;
+	unsigned long delivered;
+};
+
+void juci_events_init(struct juci_events *self);
+void juci_events_free(struct juci_events *self);
+int juci_events_add(struct juci_events *self, uint64_t peer, const char *sid, const char *topic);
+// removes the subscriptions of a peer to a topic or all of them when topic is NULL
+int juci_events_remove(struct juci_events *self, uint64_t peer, const char *topic);
+void juci_events_remove_subscription(struct juci_events *self, struct juci_subscription *sub);
+// true when some subscription matches the event name
+bool juci_events_wanted(struct juci_events *self, const char *event);
+void juci_events_to_blob(struct juci_events *self, struct blob *out);
+
+static inline bool juci_subscription_matches(struct juci_subscription *self, const char *event){
+	return fnmatch(self->topic, event, 0) == 0;
+}
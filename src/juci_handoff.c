@@ -0,0 +1,216 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "internal.h"
+#include "juci_handoff.h"
+
+// new instance: its plugins are loaded and it waits for the sessions
+#define JUCI_HANDOFF_READY 'R'
+// old instance: the sessions are in the state file
+#define JUCI_HANDOFF_STATE 'S'
+
+// new instance: socket to the old instance while a handoff is in progress
+static int _handoff_sock = -1;
+
+// old instance: the new instance while it is starting up
+static struct {
+	int sock;
+	pid_t pid;
+	uint64_t deadline;
+} _child = { .sock = -1 };
+
+static uint64_t _now_ms(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int _send_fds(int sock, int *fds, int count){
+	char data = 0;
+	struct iovec iov = { .iov_base = &data, .iov_len = 1 };
+	char control[CMSG_SPACE(sizeof(int) * 2)];
+	memset(control, 0, sizeof(control));
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = CMSG_SPACE(sizeof(int) * count)
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+	if(sendmsg(sock, &msg, 0) != 1) return -errno;
+	return 0;
+}
+
+static int _recv_fds(int sock, int *fds, int count){
+	char data;
+	struct iovec iov = { .iov_base = &data, .iov_len = 1 };
+	char control[CMSG_SPACE(sizeof(int) * 2)];
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control,
+		.msg_controllen = CMSG_SPACE(sizeof(int) * count)
+	};
+	if(recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -EIO;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if(!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+		cmsg->cmsg_len != CMSG_LEN(sizeof(int) * count)) return -EINVAL;
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+	return 0;
+}
+
+int juci_handoff_state_fd(void){
+	int fd = -1;
+#ifdef SYS_memfd_create
+	fd = syscall(SYS_memfd_create, "revorpcd-state", 1 /* MFD_CLOEXEC */);
+#endif
+	if(fd >= 0) return fd;
+	// kernels without memfd: use a file that is deleted right away
+	char path[] = "/tmp/revorpcd-state-XXXXXX";
+	fd = mkstemp(path);
+	if(fd < 0) return -errno;
+	unlink(path);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+void juci_handoff_abort(void){
+	if(_child.sock < 0) return;
+	close(_child.sock);
+	_child.sock = -1;
+	// do not leave a half started instance around
+	kill(_child.pid, SIGTERM);
+	waitpid(_child.pid, NULL, 0);
+}
+
+int juci_handoff_start(char **argv, int listen_fd, int state_fd){
+	int sv[2];
+	if(_child.sock >= 0) return -EBUSY;
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) return -errno;
+
+	pid_t pid = fork();
+	if(pid < 0){
+		close(sv[0]);
+		close(sv[1]);
+		return -errno;
+	}
+	if(pid == 0){
+		// our end of the pair must survive the exec
+		char fd_str[16];
+		fcntl(sv[1], F_SETFD, 0);
+		snprintf(fd_str, sizeof(fd_str), "%d", sv[1]);
+		setenv(JUCI_HANDOFF_ENV, fd_str, 1);
+		// exec the binary by name so that an upgraded binary is started
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	close(sv[1]);
+
+	_child.sock = sv[0];
+	_child.pid = pid;
+	_child.deadline = _now_ms() + JUCI_HANDOFF_TIMEOUT_MS;
+	int fds[2] = { listen_fd, state_fd };
+	int ret = _send_fds(sv[0], fds, 2);
+	if(ret < 0) juci_handoff_abort();
+	return ret;
+}
+
+int juci_handoff_poll(void){
+	char ready = 0;
+	if(_child.sock < 0) return -ENOENT;
+	ssize_t len = recv(_child.sock, &ready, 1, MSG_DONTWAIT);
+	if(len == 1 && ready == JUCI_HANDOFF_READY) return 1;
+	if(len < 0 && (errno == EAGAIN || errno == EINTR) && _now_ms() < _child.deadline) return 0;
+	ERROR("new instance did not take over\n");
+	juci_handoff_abort();
+	return (len < 0)?-ETIMEDOUT:-EIO;
+}
+
+int juci_handoff_finish(void){
+	char state = JUCI_HANDOFF_STATE;
+	if(_child.sock < 0) return -ENOENT;
+	if(send(_child.sock, &state, 1, MSG_NOSIGNAL) != 1){
+		int ret = -errno;
+		ERROR("could not hand over sessions: %s\n", strerror(-ret));
+		juci_handoff_abort();
+		return ret;
+	}
+	close(_child.sock);
+	_child.sock = -1;
+	return 0;
+}
+
+int juci_handoff_receive(int *listen_fd, int *state_fd){
+	const char *env = getenv(JUCI_HANDOFF_ENV);
+	if(!env) return -ENOENT;
+	int sock = atoi(env);
+	unsetenv(JUCI_HANDOFF_ENV);
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+	int fds[2];
+	int ret = _recv_fds(sock, fds, 2);
+	if(ret < 0){
+		close(sock);
+		return ret;
+	}
+	*listen_fd = fds[0];
+	*state_fd = fds[1];
+	_handoff_sock = sock;
+	return 0;
+}
+
+int juci_handoff_ready(void){
+	char msg = JUCI_HANDOFF_READY;
+	int ret = 0;
+	if(_handoff_sock < 0) return -ENOENT;
+	uint64_t deadline = _now_ms() + JUCI_HANDOFF_TIMEOUT_MS;
+	if(send(_handoff_sock, &msg, 1, MSG_NOSIGNAL) != 1) ret = -errno;
+	while(ret == 0){
+		struct pollfd pfd = { .fd = _handoff_sock, .events = POLLIN };
+		uint64_t now = _now_ms();
+		if(now >= deadline){
+			ret = -ETIMEDOUT;
+			break;
+		}
+		int count = poll(&pfd, 1, deadline - now);
+		if(count < 0 && errno == EINTR) continue;
+		if(count != 1 || read(_handoff_sock, &msg, 1) != 1 || msg != JUCI_HANDOFF_STATE) ret = -EIO;
+		break;
+	}
+	if(ret < 0) ERROR("old instance did not hand over its sessions: %s\n", strerror(-ret));
+	close(_handoff_sock);
+	_handoff_sock = -1;
+	return ret;
+}
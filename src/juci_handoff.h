@@ -0,0 +1,48 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+/*
+ * Hot restart. The running server starts a new instance of itself and passes
+ * it the listening socket and an empty state file over a unix socket
+ * (SCM_RIGHTS). The old instance keeps serving while the new one loads its
+ * plugins. Once the new instance reports that it is ready, the old one writes
+ * its sessions into the state file, stops accepting connections and exits
+ * when its clients have disconnected.
+ */
+
+// environment variable that tells the new instance which fd to receive from
+#define JUCI_HANDOFF_ENV "REVORPCD_HANDOFF_FD"
+// how long either instance waits for the other one
+#define JUCI_HANDOFF_TIMEOUT_MS 10000
+
+// old instance: execs argv and hands over the two fds. Returns 0 when the new instance has been started.
+int juci_handoff_start(char **argv, int listen_fd, int state_fd);
+// old instance: does not block. Returns 1 once the new instance is ready, 0 while it is starting up and
+// a negative error when it failed or timed out, in which case it has been stopped.
+int juci_handoff_poll(void);
+// old instance: tells the new instance that the sessions have been written to the state file
+int juci_handoff_finish(void);
+// old instance: stops a new instance that has not been told to finish
+void juci_handoff_abort(void);
+// new instance: returns 0 and the received fds if we were started by juci_handoff_start
+int juci_handoff_receive(int *listen_fd, int *state_fd);
+// new instance: tells the old instance that it is ready and waits until the state file can be read
+int juci_handoff_ready(void);
+// anonymous file for passing state between instances
+int juci_handoff_state_fd(void);
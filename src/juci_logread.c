@@ -0,0 +1,291 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#define _GNU_SOURCE /* pipe2, F_SETPIPE_SZ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <regex.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "internal.h"
+#include "juci_logread.h"
+
+#ifndef JUCI_LOGREAD_COMMAND
+#define JUCI_LOGREAD_COMMAND "logread"
+#endif
+// seconds to wait before logread is started again after it has exited
+#define JUCI_LOGREAD_RETRY 10
+// how long the first query waits at most for logread to print the current log (ms)
+#define JUCI_LOGREAD_STARTUP_WAIT 500
+// the current log is complete once nothing has been printed for this long (ms)
+#define JUCI_LOGREAD_SETTLE_WAIT 20
+
+struct juci_log_entry {
+	struct juci_log_line line;
+	char text[];
+};
+
+static struct {
+	struct juci_log_entry *ring[JUCI_LOGREAD_LINES];
+	// index of the oldest line and number of lines in the ring
+	int head;
+	int count;
+	uint64_t cursor;
+	pid_t pid;
+	int fd;
+	time_t started;
+	char partial[JUCI_LOGREAD_LINE_MAX];
+	size_t partial_len;
+} _log = { .fd = -1 };
+
+static time_t _monotonic_sec(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static uint64_t _monotonic_ms(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char *_skip_field(const char *str){
+	while(*str && !isspace((unsigned char)*str)) str++;
+	while(isspace((unsigned char)*str)) str++;
+	return str;
+}
+
+/*
+ * Lines look like "Thu Oct 18 20:05:01 2026 daemon.info dnsmasq[812]: text".
+ * The fields are copied one after another into the text of the entry. Lines
+ * that do not look like that are kept as a message without the other fields.
+ */
+static struct juci_log_entry *_log_entry_new(const char *str, size_t len){
+	struct juci_log_entry *self = calloc(1, sizeof(struct juci_log_entry) + len + 4);
+	if(!self) return NULL;
+	char *text = self->text;
+	const char *type = str;
+	for(int c = 0; c < 5 && *type; c++) type = _skip_field(type);
+	const char *source = _skip_field(type);
+	const char *message = strchr(source, ':');
+	if(!*type || !*source || !message || message == source){
+		self->line.date = self->line.type = self->line.source = text;
+		memcpy(text + 1, str, len);
+		self->line.message = text + 1;
+		return self;
+	}
+	const char *date_end = type;
+	while(date_end > str && isspace((unsigned char)date_end[-1])) date_end--;
+	memcpy(text, str, date_end - str);
+	self->line.date = text;
+	text += date_end - str + 1;
+
+	const char *type_end = type;
+	while(*type_end && !isspace((unsigned char)*type_end)) type_end++;
+	memcpy(text, type, type_end - type);
+	self->line.type = text;
+	text += type_end - type + 1;
+
+	memcpy(text, source, message - source);
+	self->line.source = text;
+	text += message - source + 1;
+
+	message++;
+	while(isspace((unsigned char)*message)) message++;
+	strcpy(text, message);
+	self->line.message = text;
+	return self;
+}
+
+static void _log_add(const char *str, size_t len){
+	struct juci_log_entry *entry = _log_entry_new(str, len);
+	if(!entry) return;
+	entry->line.cursor = ++_log.cursor;
+	if(_log.count == JUCI_LOGREAD_LINES){
+		free(_log.ring[_log.head]);
+		_log.ring[_log.head] = entry;
+		_log.head = (_log.head + 1) % JUCI_LOGREAD_LINES;
+		return;
+	}
+	_log.ring[(_log.head + _log.count) % JUCI_LOGREAD_LINES] = entry;
+	_log.count++;
+}
+
+// splits what was read into lines, keeping an unterminated last line for the next read
+static void _log_feed(const char *buf, size_t len){
+	for(size_t c = 0; c < len; c++){
+		if(buf[c] == '\n'){
+			_log.partial[_log.partial_len] = 0;
+			if(_log.partial_len) _log_add(_log.partial, _log.partial_len);
+			_log.partial_len = 0;
+		} else if(_log.partial_len < sizeof(_log.partial) - 1 && buf[c] != '\r'){
+			// the end of lines that are too long is dropped
+			_log.partial[_log.partial_len++] = buf[c];
+		}
+	}
+}
+
+static void _log_detach(void){
+	if(_log.fd >= 0) close(_log.fd);
+	_log.fd = -1;
+	if(_log.pid > 0){
+		kill(_log.pid, SIGTERM);
+		waitpid(_log.pid, NULL, 0);
+	}
+	_log.pid = 0;
+	_log.partial_len = 0;
+}
+
+static void _log_clear(void){
+	for(int c = 0; c < _log.count; c++){
+		free(_log.ring[(_log.head + c) % JUCI_LOGREAD_LINES]);
+	}
+	_log.head = 0;
+	_log.count = 0;
+}
+
+static int _log_attach(void){
+	int fds[2];
+	if(pipe2(fds, O_CLOEXEC) < 0) return -errno;
+	pid_t pid = fork();
+	if(pid < 0){
+		int err = -errno;
+		close(fds[0]);
+		close(fds[1]);
+		return err;
+	}
+	if(pid == 0){
+		int null = open("/dev/null", O_RDWR);
+		dup2(null, STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		execlp(JUCI_LOGREAD_COMMAND, JUCI_LOGREAD_COMMAND, "-f", (char*)NULL);
+		_exit(127);
+	}
+	close(fds[1]);
+	// logread prints the whole log again so lines from a previous run would be doubled
+	_log_clear();
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+	// room for a full ring of lines between two polls of the main loop
+	fcntl(fds[0], F_SETPIPE_SZ, JUCI_LOGREAD_LINES * 256);
+#endif
+	_log.fd = fds[0];
+	_log.pid = pid;
+	_log.started = _monotonic_sec();
+
+	// the current log is printed right away, wait for it so that the first query sees it
+	struct pollfd pfd = { .fd = _log.fd, .events = POLLIN };
+	uint64_t now = _monotonic_ms(), deadline = now + JUCI_LOGREAD_STARTUP_WAIT;
+	int timeout = JUCI_LOGREAD_STARTUP_WAIT;
+	// a log that keeps flowing is not waited for any longer than an empty one
+	while(_log.fd >= 0 && now < deadline && poll(&pfd, 1, timeout) > 0){
+		if(juci_logread_poll() <= 0) break;
+		now = _monotonic_ms();
+		timeout = (deadline - now < JUCI_LOGREAD_SETTLE_WAIT)?(int)(deadline - now):JUCI_LOGREAD_SETTLE_WAIT;
+	}
+	return 0;
+}
+
+int juci_logread_poll(void){
+	char buf[4096];
+	int lines = 0;
+	if(_log.fd < 0) return 0;
+	while(1){
+		ssize_t ret = read(_log.fd, buf, sizeof(buf));
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret < 0 && errno == EAGAIN) break;
+		if(ret <= 0){
+			// logread has exited (or could not be started), try again later
+			DEBUG("logread: log reader exited\n");
+			_log_detach();
+			return -EPIPE;
+		}
+		uint64_t cursor = _log.cursor;
+		_log_feed(buf, ret);
+		lines += _log.cursor - cursor;
+	}
+	return lines;
+}
+
+int juci_logread_filter_init(struct juci_logread_filter *self, const char *type, const char *source){
+	self->has_type = self->has_source = false;
+	if(type && *type){
+		if(regcomp(&self->type, type, REG_EXTENDED | REG_NOSUB) != 0) return -EINVAL;
+		self->has_type = true;
+	}
+	if(source && *source){
+		if(regcomp(&self->source, source, REG_EXTENDED | REG_NOSUB) != 0){
+			juci_logread_filter_free(self);
+			return -EINVAL;
+		}
+		self->has_source = true;
+	}
+	return 0;
+}
+
+void juci_logread_filter_free(struct juci_logread_filter *self){
+	if(self->has_type) regfree(&self->type);
+	if(self->has_source) regfree(&self->source);
+	self->has_type = self->has_source = false;
+}
+
+static bool _log_match(struct juci_log_entry *entry, const struct juci_logread_filter *filter){
+	if(filter->has_type && regexec(&filter->type, entry->line.type, 0, NULL, 0) != 0) return false;
+	if(filter->has_source && regexec(&filter->source, entry->line.source, 0, NULL, 0) != 0) return false;
+	return true;
+}
+
+int juci_logread_query(const struct juci_logread_filter *filter, uint64_t cursor, int limit, juci_logread_cb cb, void *arg, uint64_t *last){
+	int ret;
+
+	if(_log.fd < 0 && (!_log.started || _monotonic_sec() - _log.started >= JUCI_LOGREAD_RETRY)){
+		if((ret = _log_attach()) < 0) ERROR("logread: could not start %s: %s\n", JUCI_LOGREAD_COMMAND, strerror(-ret));
+	}
+	juci_logread_poll();
+
+	// a cursor from before a restart of the server starts over
+	if(cursor > _log.cursor) cursor = 0;
+
+	// walk back from the newest line to find where the result starts
+	int first = _log.count, found = 0;
+	while(first > 0 && found < limit){
+		struct juci_log_entry *entry = _log.ring[(_log.head + first - 1) % JUCI_LOGREAD_LINES];
+		if(entry->line.cursor <= cursor) break;
+		first--;
+		if(_log_match(entry, filter)) found++;
+	}
+	for(int c = first; c < _log.count && found; c++){
+		struct juci_log_entry *entry = _log.ring[(_log.head + c) % JUCI_LOGREAD_LINES];
+		if(!_log_match(entry, filter)) continue;
+		cb(&entry->line, arg);
+		found--;
+	}
+	*last = _log.cursor;
+	return 0;
+}
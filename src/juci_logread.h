@@ -0,0 +1,66 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <regex.h>
+
+// number of recent lines that are kept
+#ifndef JUCI_LOGREAD_LINES
+#define JUCI_LOGREAD_LINES 1000
+#endif
+#define JUCI_LOGREAD_LINE_MAX 1024
+
+struct juci_log_line {
+	// increases by one for every line read since the server was started
+	uint64_t cursor;
+	const char *date;
+	const char *type;
+	const char *source;
+	const char *message;
+};
+
+typedef void (*juci_logread_cb)(const struct juci_log_line *line, void *arg);
+
+struct juci_logread_filter {
+	regex_t type, source;
+	bool has_type, has_source;
+};
+
+/*
+ * The system log is read by a single "logread -f" child that is started on
+ * the first query and kept running. Its output is split into fields and the
+ * latest lines are kept in a ring so that queries never need to run logread
+ * again. The ring is drained from the main loop through juci_logread_poll().
+ */
+
+// reads the lines that logread has written since the last call (if it is running)
+int juci_logread_poll(void);
+
+// compiles the extended regular expressions that type and source must match (NULL or "" matches everything)
+int juci_logread_filter_init(struct juci_logread_filter *self, const char *type, const char *source);
+void juci_logread_filter_free(struct juci_logread_filter *self);
+
+/*
+ * Calls cb, oldest first, for the last limit lines that are newer than cursor
+ * and that match the filter. A cursor of 0, or one that is not known, returns
+ * the latest lines. *last is set to the cursor to pass next time. Nothing is
+ * held while cb runs so it may longjmp out (the filter belongs to the caller).
+ */
+int juci_logread_query(const struct juci_logread_filter *filter, uint64_t cursor, int limit, juci_logread_cb cb, void *arg, uint64_t *last);
@@ -173,7 +173,7 @@ void juci_lua_publish_json_api(lua_State *L){
 	lua_pushstring(L, "parse"); 
 	lua_pushcfunction(L, l_json_parse); 
 	lua_settable(L, -3); 
-	lua_setglobal(L, "JSON"); 
+	lua_setfield(L, -2, "JSON"); 
 }
 
 #include "base64.h"
@@ -221,15 +221,14 @@ void juci_lua_publish_file_api(lua_State *L){
 	lua_pushstring(L, "writeFragment"); 
 	lua_pushcfunction(L, l_file_write_fragment); 
 	lua_settable(L, -3); 
-	lua_setglobal(L, "fs"); 
+	lua_setfield(L, -2, "fs"); 
 }
 
 static struct juci_session *l_get_session_ptr(lua_State *L){
-	lua_getglobal(L, "SESSION"); 
-	luaL_checktype(L, -1, LUA_TTABLE); 
-	lua_getfield(L, -1, "_self"); 
+	// the SESSION table the function belongs to is its first upvalue
+	lua_getfield(L, lua_upvalueindex(1), "_self"); 
 	struct juci_session *self = (struct juci_session *)lua_touserdata(L, -1); 
-	lua_pop(L, 2); // pop JUCI and _self
+	lua_pop(L, 1); // pop _self
 	if(!self){
 		ERROR("Invalid SESSION._self pointer!\n"); 
 		return NULL; 
@@ -267,15 +266,41 @@ static int l_session_get(lua_State *L){
 
 void juci_lua_publish_session_api(lua_State *L){
 	lua_newtable(L); 
-	lua_pushstring(L, "access"); lua_pushcfunction(L, l_session_access); lua_settable(L, -3); 
-	lua_pushstring(L, "get"); lua_pushcfunction(L, l_session_get); lua_settable(L, -3); 
-	lua_setglobal(L, "SESSION"); 
+	lua_pushstring(L, "access"); lua_pushvalue(L, -2); lua_pushcclosure(L, l_session_access, 1); lua_settable(L, -3); 
+	lua_pushstring(L, "get"); lua_pushvalue(L, -2); lua_pushcclosure(L, l_session_get, 1); lua_settable(L, -3); 
+	lua_setfield(L, -2, "SESSION"); 
 }
 
 void juci_lua_set_session(lua_State *L, struct juci_session *self){
-	lua_getglobal(L, "SESSION"); 
 	luaL_checktype(L, -1, LUA_TTABLE); 
 	lua_pushstring(L, "_self"); lua_pushlightuserdata(L, self); lua_settable(L, -3); 
-	lua_pop(L, 1); 
 }
 
+void juci_lua_new_module(lua_State *L, const luaL_Reg *funcs){
+	lua_newtable(L); 
+	for(; funcs->name; funcs++){
+		lua_pushcfunction(L, funcs->func); 
+		lua_setfield(L, -2, funcs->name); 
+	}
+}
+
+static const luaL_Reg _native_modules[] = {
+	{ "juci/proc", juci_lua_open_proc }, 
+	{ "juci/net", juci_lua_open_net }, 
+	{ "juci/macdb", juci_lua_open_macdb }, 
+	{ "juci/log", juci_lua_open_log }, 
+	{ "juci/bandwidth", juci_lua_open_bwmon }, 
+	{ "juci/fs", juci_lua_open_fs }, 
+	{ "juci/dirindex", juci_lua_open_dirindex }, 
+	{ NULL, NULL }
+}; 
+
+void juci_lua_preload_modules(lua_State *L){
+	lua_getglobal(L, "package"); 
+	lua_getfield(L, -1, "preload"); 
+	for(const luaL_Reg *mod = _native_modules; mod->name; mod++){
+		lua_pushcfunction(L, mod->func); 
+		lua_setfield(L, -2, mod->name); 
+	}
+	lua_pop(L, 2); 
+}
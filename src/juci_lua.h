@@ -18,12 +18,55 @@
 #pragma once
 
 struct juci_session; 
+struct blob; 
+struct blob_field; 
+
+// calls func with ud as a light userdata in protected mode, allocating nothing outside of the protected call
+static inline int juci_lua_cpcall(lua_State *L, lua_CFunction func, void *ud){
+#if LUA_VERSION_NUM >= 502
+	// light c functions are not allocated
+	lua_pushcfunction(L, func); 
+	lua_pushlightuserdata(L, ud); 
+	return lua_pcall(L, 1, 0, 0); 
+#else
+	return lua_cpcall(L, func, ud); 
+#endif
+}
+
+static inline void juci_lua_push_globals(lua_State *L){
+#if LUA_VERSION_NUM >= 502
+	lua_pushglobaltable(L); 
+#else
+	lua_pushvalue(L, LUA_GLOBALSINDEX); 
+#endif
+}
+
+// the publish functions add their api to the table on top of the stack
 
 void juci_lua_publish_json_api(lua_State *L); 
 void juci_lua_publish_file_api(lua_State *L); 
+// UCI.get/section/foreach served from a cache of parsed configs
+void juci_lua_publish_uci_api(lua_State *L); 
+// UBUS.call over a connection to ubusd that is kept open
+void juci_lua_publish_ubus_api(lua_State *L); 
 
 int juci_lua_table_to_blob(lua_State *L, struct blob *b, bool table); 
 void juci_lua_blob_to_table(lua_State *lua, struct blob_field *msg, bool table); 
 
 void juci_lua_publish_session_api(lua_State *L); 
+// sets the session of the SESSION table on top of the stack
 void juci_lua_set_session(lua_State *L, struct juci_session *self); 
+
+// creates a table with the functions of a module on top of the stack
+void juci_lua_new_module(lua_State *L, const luaL_Reg *funcs); 
+// makes the native modules available to require() in a state
+void juci_lua_preload_modules(lua_State *L); 
+
+// native modules (require("juci/<name>"))
+int juci_lua_open_proc(lua_State *L); 
+int juci_lua_open_net(lua_State *L); 
+int juci_lua_open_macdb(lua_State *L); 
+int juci_lua_open_log(lua_State *L); 
+int juci_lua_open_bwmon(lua_State *L); 
+int juci_lua_open_fs(lua_State *L); 
+int juci_lua_open_dirindex(lua_State *L); 
@@ -0,0 +1,77 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_bwmon.h"
+
+struct _bwmon_result {
+	lua_State *L;
+	int index;
+	bool by_device;
+};
+
+// samples use the row format of luci-bwc: {time, rx_bytes, rx_packets, tx_bytes, tx_packets}
+static void _push_sample(const char *device, const struct juci_bwmon_sample *sample, void *arg){
+	struct _bwmon_result *res = (struct _bwmon_result*)arg;
+	lua_State *L = res->L;
+	lua_createtable(L, 5, 0);
+	lua_pushnumber(L, sample->time); lua_rawseti(L, -2, 1);
+	lua_pushnumber(L, sample->rx_bytes); lua_rawseti(L, -2, 2);
+	lua_pushnumber(L, sample->rx_packets); lua_rawseti(L, -2, 3);
+	lua_pushnumber(L, sample->tx_bytes); lua_rawseti(L, -2, 4);
+	lua_pushnumber(L, sample->tx_packets); lua_rawseti(L, -2, 5);
+	if(res->by_device) lua_setfield(L, -2, device);
+	else lua_rawseti(L, -2, ++res->index);
+}
+
+// bandwidth.history(device) returns the samples of a device, oldest first
+static int l_bwmon_history(lua_State *L){
+	const char *device = luaL_checkstring(L, 1);
+	struct _bwmon_result res = { .L = L };
+	lua_newtable(L);
+	if(juci_bwmon_foreach(device, _push_sample, &res) < 0){
+		lua_pop(L, 1);
+		lua_pushnil(L);
+		lua_pushstring(L, "no such device");
+		return 2;
+	}
+	return 1;
+}
+
+// bandwidth.latest() returns the last sample of every device keyed by device
+static int l_bwmon_latest(lua_State *L){
+	struct _bwmon_result res = { .L = L, .by_device = true };
+	lua_newtable(L);
+	juci_bwmon_foreach(NULL, _push_sample, &res);
+	return 1;
+}
+
+int juci_lua_open_bwmon(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "history", l_bwmon_history },
+		{ "latest", l_bwmon_latest },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
@@ -0,0 +1,138 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_dirindex.h"
+
+#define JUCI_LUA_DIRINDEX_DEPTH 16
+#define JUCI_LUA_DIRINDEX_LIMIT 10000
+#define JUCI_LUA_DIRINDEX_COMPLETIONS 100
+
+static int _push_error(lua_State *L, int err){
+	lua_pushnil(L);
+	lua_pushstring(L, strerror(err));
+	return 2;
+}
+
+// pushes {name = {path, children}} for the subdirectories of a node
+static void _push_tree(lua_State *L, struct juci_dirnode *node, int depth, int *left, bool *truncated){
+	char path[PATH_MAX];
+	struct juci_dirnode *child;
+
+	// one level of recursion holds the tree, the entry of a child and its path
+	luaL_checkstack(L, 3, "directory tree too deep");
+	lua_newtable(L);
+	if(depth <= 0) return;
+	if(node->truncated) *truncated = true;
+	avl_for_each_element(&node->children, child, avl){
+		if(*left <= 0){
+			*truncated = true;
+			return;
+		}
+		if(juci_dirindex_path(child, path, sizeof(path)) < 0) continue;
+		(*left)--;
+		lua_newtable(L);
+		lua_pushstring(L, path); lua_setfield(L, -2, "path");
+		_push_tree(L, child, depth - 1, left, truncated);
+		lua_setfield(L, -2, "children");
+		lua_setfield(L, -2, child->name);
+	}
+}
+
+// dirindex.tree(path[, depth[, limit]]) returns the directories below path and whether the result was cut short
+static int l_dirindex_tree(lua_State *L){
+	const char *path = luaL_checkstring(L, 1);
+	int depth = luaL_optinteger(L, 2, JUCI_LUA_DIRINDEX_DEPTH);
+	int left = luaL_optinteger(L, 3, JUCI_LUA_DIRINDEX_LIMIT);
+	bool truncated = false;
+	int err = 0;
+
+	if(depth > JUCI_LUA_DIRINDEX_DEPTH) depth = JUCI_LUA_DIRINDEX_DEPTH;
+	struct juci_dirnode *node = juci_dirindex_lookup(path, depth, &err);
+	if(!node) return _push_error(L, -err);
+	_push_tree(L, node, depth, &left, &truncated);
+	// the index itself is full
+	if(err == -ENOSPC) truncated = true;
+	lua_pushboolean(L, truncated);
+	return 2;
+}
+
+// dirindex.complete(prefix[, limit]) returns the paths of the directories whose path starts with prefix
+static int l_dirindex_complete(lua_State *L){
+	const char *prefix = luaL_checkstring(L, 1);
+	int limit = luaL_optinteger(L, 2, JUCI_LUA_DIRINDEX_COMPLETIONS);
+	char dir[PATH_MAX], path[PATH_MAX];
+	struct juci_dirnode *node, *child;
+	int err = 0, count = 0;
+
+	const char *base = strrchr(prefix, '/');
+	if(!base) return _push_error(L, EINVAL);
+	base++;
+	if(base - prefix >= sizeof(dir)) return _push_error(L, ENAMETOOLONG);
+	memcpy(dir, prefix, base - prefix);
+	dir[base - prefix] = 0;
+
+	size_t len = strlen(base);
+	node = juci_dirindex_lookup(dir, 1, &err);
+	lua_newtable(L);
+	if(!node) return 1;
+	avl_for_each_element(&node->children, child, avl){
+		if(count == limit) break;
+		// hidden directories only when asked for
+		if(child->name[0] == '.' && base[0] != '.') continue;
+		if(strncmp(child->name, base, len) != 0) continue;
+		if(juci_dirindex_path(child, path, sizeof(path)) < 0) continue;
+		lua_pushstring(L, path);
+		lua_rawseti(L, -2, ++count);
+	}
+	return 1;
+}
+
+// dirindex.roots() returns the paths of the configured roots with a trailing slash
+static int l_dirindex_roots(lua_State *L){
+	char path[PATH_MAX];
+	struct juci_dirnode *root;
+	int count = 0;
+
+	lua_newtable(L);
+	for(int c = 0; (root = juci_dirindex_root(c)); c++){
+		if(juci_dirindex_path(root, path, sizeof(path)) < 0) continue;
+		lua_pushstring(L, path);
+		lua_rawseti(L, -2, ++count);
+	}
+	return 1;
+}
+
+int juci_lua_open_dirindex(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "roots", l_dirindex_roots },
+		{ "tree", l_dirindex_tree },
+		{ "complete", l_dirindex_complete },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
@@ -0,0 +1,196 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+
+static int _push_error(lua_State *L, int err){
+	lua_pushnil(L);
+	lua_pushstring(L, strerror(err));
+	return 2;
+}
+
+static const char *_mode_type(mode_t mode){
+	if(S_ISREG(mode)) return "file";
+	if(S_ISDIR(mode)) return "dir";
+	if(S_ISLNK(mode)) return "link";
+	if(S_ISCHR(mode)) return "char";
+	if(S_ISBLK(mode)) return "block";
+	if(S_ISFIFO(mode)) return "fifo";
+	if(S_ISSOCK(mode)) return "socket";
+	return "unknown";
+}
+
+static const char *_dirent_type(const char *dir, struct dirent *ent){
+	switch(ent->d_type){
+		case DT_REG: return "file";
+		case DT_DIR: return "dir";
+		case DT_LNK: return "link";
+		case DT_CHR: return "char";
+		case DT_BLK: return "block";
+		case DT_FIFO: return "fifo";
+		case DT_SOCK: return "socket";
+	}
+	// not every filesystem fills in d_type
+	char path[PATH_MAX];
+	struct stat st;
+	snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+	if(lstat(path, &st) < 0) return "unknown";
+	return _mode_type(st.st_mode);
+}
+
+static int _skip_dots(const struct dirent *ent){
+	return strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0;
+}
+
+// fs.list(dir) returns the entries of a directory sorted by name as {name, type}
+/*
+ * The entries that scandir and glob return are turned into tables in a
+ * protected call so that they can still be freed when lua runs out of
+ * memory halfway. The function is pushed before the entries are read since
+ * pushing it can raise an error too.
+ */
+struct _listing {
+	const char *dir;
+	struct dirent **list;
+	int count;
+	glob_t glob;
+};
+
+static int _list_rows(lua_State *L){
+	struct _listing *self = lua_touserdata(L, 1);
+	lua_createtable(L, self->count, 0);
+	for(int c = 0; c < self->count; c++){
+		lua_createtable(L, 0, 2);
+		lua_pushstring(L, self->list[c]->d_name); lua_setfield(L, -2, "name");
+		lua_pushstring(L, _dirent_type(self->dir, self->list[c])); lua_setfield(L, -2, "type");
+		lua_rawseti(L, -2, c + 1);
+	}
+	return 1;
+}
+
+static int l_fs_list(lua_State *L){
+	struct _listing ls = { .dir = luaL_checkstring(L, 1) };
+	lua_pushcfunction(L, _list_rows);
+	lua_pushlightuserdata(L, &ls);
+	ls.count = scandir(ls.dir, &ls.list, _skip_dots, alphasort);
+	if(ls.count < 0) return _push_error(L, errno);
+	int ret = lua_pcall(L, 1, 1, 0);
+	for(int c = 0; c < ls.count; c++) free(ls.list[c]);
+	free(ls.list);
+	if(ret != 0) return lua_error(L);
+	return 1;
+}
+
+// fs.glob(pattern) returns the sorted paths that match a shell pattern
+static int _glob_rows(lua_State *L){
+	struct _listing *self = lua_touserdata(L, 1);
+	lua_createtable(L, self->count, 0);
+	for(int c = 0; c < self->count; c++){
+		lua_pushstring(L, self->glob.gl_pathv[c]);
+		lua_rawseti(L, -2, c + 1);
+	}
+	return 1;
+}
+
+static int l_fs_glob(lua_State *L){
+	const char *pattern = luaL_checkstring(L, 1);
+	struct _listing ls = { .count = 0 };
+	lua_pushcfunction(L, _glob_rows);
+	lua_pushlightuserdata(L, &ls);
+	int ret = glob(pattern, 0, NULL, &ls.glob);
+	if(ret != 0 && ret != GLOB_NOMATCH){
+		globfree(&ls.glob);
+		return _push_error(L, (ret == GLOB_NOSPACE)?ENOMEM:EIO);
+	}
+	if(ret == 0) ls.count = ls.glob.gl_pathc;
+	ret = lua_pcall(L, 1, 1, 0);
+	globfree(&ls.glob);
+	if(ret != 0) return lua_error(L);
+	return 1;
+}
+
+// fs.stat(path[, nofollow]) returns {type, size, mode, uid, gid, mtime}
+static int l_fs_stat(lua_State *L){
+	const char *path = luaL_checkstring(L, 1);
+	struct stat st;
+	int ret = (lua_toboolean(L, 2))?lstat(path, &st):stat(path, &st);
+	if(ret < 0) return _push_error(L, errno);
+	lua_createtable(L, 0, 6);
+	lua_pushstring(L, _mode_type(st.st_mode)); lua_setfield(L, -2, "type");
+	lua_pushnumber(L, st.st_size); lua_setfield(L, -2, "size");
+	lua_pushinteger(L, st.st_mode & 07777); lua_setfield(L, -2, "mode");
+	lua_pushinteger(L, st.st_uid); lua_setfield(L, -2, "uid");
+	lua_pushinteger(L, st.st_gid); lua_setfield(L, -2, "gid");
+	lua_pushnumber(L, st.st_mtime); lua_setfield(L, -2, "mtime");
+	return 1;
+}
+
+// fs.statvfs(path) returns the size and usage of the filesystem of a path in bytes
+static int l_fs_statvfs(lua_State *L){
+	const char *path = luaL_checkstring(L, 1);
+	struct statvfs st;
+	if(statvfs(path, &st) < 0) return _push_error(L, errno);
+	double unit = st.f_frsize;
+	lua_createtable(L, 0, 7);
+	lua_pushnumber(L, st.f_frsize); lua_setfield(L, -2, "block_size");
+	lua_pushnumber(L, st.f_blocks * unit); lua_setfield(L, -2, "total");
+	lua_pushnumber(L, (st.f_blocks - st.f_bfree) * unit); lua_setfield(L, -2, "used");
+	lua_pushnumber(L, st.f_bfree * unit); lua_setfield(L, -2, "free");
+	// what is free for users that are not root
+	lua_pushnumber(L, st.f_bavail * unit); lua_setfield(L, -2, "available");
+	lua_pushnumber(L, st.f_files); lua_setfield(L, -2, "files");
+	lua_pushnumber(L, st.f_ffree); lua_setfield(L, -2, "files_free");
+	return 1;
+}
+
+// fs.readlink(path) returns the target of a symbolic link
+static int l_fs_readlink(lua_State *L){
+	const char *path = luaL_checkstring(L, 1);
+	char buf[PATH_MAX];
+	ssize_t len = readlink(path, buf, sizeof(buf));
+	if(len < 0) return _push_error(L, errno);
+	if(len == sizeof(buf)) return _push_error(L, ENAMETOOLONG);
+	lua_pushlstring(L, buf, len);
+	return 1;
+}
+
+int juci_lua_open_fs(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "list", l_fs_list },
+		{ "glob", l_fs_glob },
+		{ "stat", l_fs_stat },
+		{ "statvfs", l_fs_statvfs },
+		{ "readlink", l_fs_readlink },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
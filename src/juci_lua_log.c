@@ -0,0 +1,119 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_logread.h"
+
+#define JUCI_LUA_LOG_LIMIT 20
+#define JUCI_LUA_LOG_MAX_LIMIT 200
+
+struct _log_result {
+	lua_State *L;
+	int index;
+	struct juci_logread_filter filter;
+	uint64_t cursor, last;
+	int limit;
+};
+
+static void _push_line(const struct juci_log_line *line, void *arg){
+	struct _log_result *res = (struct _log_result*)arg;
+	lua_State *L = res->L;
+	lua_newtable(L);
+	lua_pushstring(L, line->date); lua_setfield(L, -2, "date");
+	lua_pushstring(L, line->type); lua_setfield(L, -2, "type");
+	lua_pushstring(L, line->source); lua_setfield(L, -2, "source");
+	lua_pushstring(L, line->message); lua_setfield(L, -2, "message");
+	lua_rawseti(L, -2, ++res->index);
+}
+
+// pushes the table of lines, called protected so that the filter is freed when pushing fails
+static int _read_lines(lua_State *L){
+	struct _log_result *res = lua_touserdata(L, 1);
+	res->L = L;
+	lua_newtable(L);
+	juci_logread_query(&res->filter, res->cursor, res->limit, _push_line, res, &res->last);
+	return 1;
+}
+
+static const char *_opt_string(lua_State *L, const char *name){
+	lua_getfield(L, 1, name);
+	const char *str = lua_tostring(L, -1);
+	lua_pop(L, 1);
+	// the string stays referenced by the options table
+	return str;
+}
+
+/*
+ * log.read({type = re, source = re, limit = n, cursor = c}) returns
+ * {lines = {{date, type, source, message}, ...}, cursor = c} or nil and an
+ * error. Passing the returned cursor back only returns lines that were
+ * logged after the previous read.
+ */
+static int l_log_read(lua_State *L){
+	uint64_t cursor = 0;
+	int limit = JUCI_LUA_LOG_LIMIT;
+	const char *type = NULL, *source = NULL;
+
+	if(lua_istable(L, 1)){
+		type = _opt_string(L, "type");
+		source = _opt_string(L, "source");
+		lua_getfield(L, 1, "limit");
+		if(lua_isnumber(L, -1)) limit = lua_tointeger(L, -1);
+		lua_getfield(L, 1, "cursor");
+		if(lua_isnumber(L, -1) && lua_tonumber(L, -1) > 0) cursor = (uint64_t)lua_tonumber(L, -1);
+		lua_pop(L, 2);
+	}
+	if(limit < 1) limit = 1;
+	if(limit > JUCI_LUA_LOG_MAX_LIMIT) limit = JUCI_LUA_LOG_MAX_LIMIT;
+
+	struct _log_result res = { .cursor = cursor, .limit = limit };
+	// pushed before the filter is compiled since pushing can fail
+	lua_pushcfunction(L, _read_lines);
+	lua_pushlightuserdata(L, &res);
+	int ret = juci_logread_filter_init(&res.filter, type, source);
+	if(ret < 0){
+		lua_pushnil(L);
+		lua_pushstring(L, (ret == -EINVAL)?"invalid filter":strerror(-ret));
+		return 2;
+	}
+	ret = lua_pcall(L, 1, 1, 0);
+	juci_logread_filter_free(&res.filter);
+	if(ret != 0) return lua_error(L);
+
+	lua_newtable(L);
+	lua_insert(L, -2);
+	lua_setfield(L, -2, "lines");
+	lua_pushnumber(L, (lua_Number)res.last);
+	lua_setfield(L, -2, "cursor");
+	return 1;
+}
+
+int juci_lua_open_log(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "read", l_log_read },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
@@ -0,0 +1,86 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_macdb.h"
+
+// shared by all lua states so that the index is only mapped once
+static struct juci_macdb _db;
+static bool _db_ready = false;
+
+static int _macdb_open(lua_State *L){
+	if(!_db_ready){
+		juci_macdb_init(&_db, JUCI_MACDB_PATH, JUCI_MACDB_INDEX_PATH);
+		_db_ready = true;
+	}
+	int ret = juci_macdb_open(&_db);
+	if(ret < 0){
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(-ret));
+		return 2;
+	}
+	return 0;
+}
+
+/*
+ * macdb.lookup(mac) returns the vendor of a mac address or nil.
+ * macdb.lookup({mac, ...}) returns a table of vendors keyed by the given
+ * addresses that holds only the ones that are known.
+ */
+static int l_macdb_lookup(lua_State *L){
+	if(!lua_istable(L, 1)) luaL_checkstring(L, 1);
+	if(_macdb_open(L)) return 2;
+
+	if(!lua_istable(L, 1)){
+		const char *vendor = juci_macdb_lookup(&_db, lua_tostring(L, 1));
+		if(vendor) lua_pushstring(L, vendor);
+		else lua_pushnil(L);
+		return 1;
+	}
+
+	lua_newtable(L);
+	for(int c = 1; ; c++){
+		lua_rawgeti(L, 1, c);
+		if(lua_isnil(L, -1)){
+			lua_pop(L, 1);
+			break;
+		}
+		const char *vendor = (lua_type(L, -1) == LUA_TSTRING)?juci_macdb_lookup(&_db, lua_tostring(L, -1)):NULL;
+		if(vendor){
+			lua_pushstring(L, vendor);
+			lua_settable(L, -3);
+		} else {
+			lua_pop(L, 1);
+		}
+	}
+	return 1;
+}
+
+int juci_lua_open_macdb(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "lookup", l_macdb_lookup },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
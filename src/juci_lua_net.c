@@ -0,0 +1,711 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/neighbour.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_netlink.h"
+
+#ifndef IFF_LOWER_UP
+#define IFF_LOWER_UP 0x10000
+#endif
+#ifndef IFF_DORMANT
+#define IFF_DORMANT 0x20000
+#endif
+
+#define JUCI_LUA_NET_MAX_IFACES 128
+#define JUCI_LUA_NET_LINE_SIZE 512
+
+struct _ifname {
+	int index;
+	char name[IF_NAMESIZE];
+};
+
+// interface names by index, read with one link dump when a call needs them
+struct _ifnames {
+	struct _ifname entries[JUCI_LUA_NET_MAX_IFACES];
+	int count;
+	bool loaded;
+};
+
+struct _socket {
+	unsigned long inode;
+	pid_t pid;
+	char name[32];
+};
+
+struct _sockets {
+	struct _socket *entries;
+	int count;
+	int size;
+};
+
+/*
+ * State of a call that builds rows. Everything that has to be released is
+ * kept here and not on the C stack because building rows can raise a lua
+ * error at any point (see _run_protected).
+ */
+struct _dump {
+	lua_State *L;
+	int count;
+	int family;
+	struct _ifnames *names;
+	struct juci_netlink_dump nl;
+	FILE *file;
+	struct _sockets socks;
+	// for _dump_rows
+	int type;
+	juci_netlink_cb cb;
+	void (*fallback4)(struct _dump *);
+	void (*fallback6)(struct _dump *);
+};
+
+static const char *_link_flag_names[] = {
+	"LOOPBACK", "BROADCAST", "POINTOPOINT", "MULTICAST", "NOARP", "ALLMULTI",
+	"PROMISC", "NOTRAILERS", "DEBUG", "DYNAMIC", "AUTOMEDIA", "PORTSEL",
+	"MASTER", "SLAVE", "UP", "LOWER_UP", "DORMANT"
+};
+static const unsigned int _link_flag_values[] = {
+	IFF_LOOPBACK, IFF_BROADCAST, IFF_POINTOPOINT, IFF_MULTICAST, IFF_NOARP, IFF_ALLMULTI,
+	IFF_PROMISC, IFF_NOTRAILERS, IFF_DEBUG, IFF_DYNAMIC, IFF_AUTOMEDIA, IFF_PORTSEL,
+	IFF_MASTER, IFF_SLAVE, IFF_UP, IFF_LOWER_UP, IFF_DORMANT
+};
+
+static const char *_operstates[] = {
+	"UNKNOWN", "NOTPRESENT", "DOWN", "LOWERLAYERDOWN", "TESTING", "DORMANT", "UP"
+};
+
+static const char *_route_types[] = {
+	"unspec", "unicast", "local", "broadcast", "anycast", "multicast",
+	"blackhole", "unreachable", "prohibit", "throw", "nat", "xresolve"
+};
+
+static const char *_route_protocols[] = {
+	"unspec", "redirect", "kernel", "boot", "static"
+};
+
+static void _set_string(lua_State *L, const char *key, const char *val){
+	if(!val) return;
+	lua_pushstring(L, val);
+	lua_setfield(L, -2, key);
+}
+
+static void _set_int(lua_State *L, const char *key, lua_Integer val){
+	lua_pushinteger(L, val);
+	lua_setfield(L, -2, key);
+}
+
+static void _set_number(lua_State *L, const char *key, lua_Number val){
+	lua_pushnumber(L, val);
+	lua_setfield(L, -2, key);
+}
+
+static void _set_bool(lua_State *L, const char *key, bool val){
+	lua_pushboolean(L, val);
+	lua_setfield(L, -2, key);
+}
+
+static FILE *_open_file(struct _dump *dump, const char *path){
+	dump->file = fopen(path, "r");
+	return dump->file;
+}
+
+static void _close_file(struct _dump *dump){
+	fclose(dump->file);
+	dump->file = NULL;
+}
+
+// adds the table on top of the stack to the array below it
+static void _append(struct _dump *dump){
+	lua_rawseti(dump->L, -2, ++dump->count);
+}
+
+static const char *_family_name(int family){
+	return (family == AF_INET6)?"inet6":"inet";
+}
+
+static int _parse_family(lua_State *L, int idx){
+	const char *name = luaL_optstring(L, idx, NULL);
+	if(!name) return AF_UNSPEC;
+	if(strcmp(name, "inet") == 0 || strcmp(name, "ipv4") == 0) return AF_INET;
+	if(strcmp(name, "inet6") == 0 || strcmp(name, "ipv6") == 0) return AF_INET6;
+	return AF_UNSPEC;
+}
+
+static void _set_addr(lua_State *L, const char *key, int family, const void *data){
+	char buf[INET6_ADDRSTRLEN];
+	if(inet_ntop(family, data, buf, sizeof(buf))) _set_string(L, key, buf);
+}
+
+// ipv4 prefixes are also given as a netmask
+static void _set_mask(lua_State *L, int family, int prefixlen){
+	if(family != AF_INET) return;
+	uint32_t mask = htonl((prefixlen > 0)?(0xffffffffU << (32 - prefixlen)):0);
+	_set_addr(L, "mask", AF_INET, &mask);
+}
+
+static void _set_mac(lua_State *L, const char *key, const unsigned char *data, int len){
+	char buf[64];
+	if(len <= 0 || len * 3 > sizeof(buf)) return;
+	for(int c = 0; c < len; c++)
+		snprintf(buf + c * 3, 4, (c + 1 < len)?"%02x:":"%02x", data[c]);
+	_set_string(L, key, buf);
+}
+
+static void _set_name(lua_State *L, const char *key, const char **names, int count, int value){
+	if(value >= 0 && value < count) _set_string(L, key, names[value]);
+	else _set_int(L, key, value);
+}
+
+static int _ifnames_add(struct nlmsghdr *nh, void *arg){
+	struct _ifnames *names = arg;
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr *tb[IFLA_MAX + 1];
+	if(nh->nlmsg_type != RTM_NEWLINK || names->count >= JUCI_LUA_NET_MAX_IFACES) return 0;
+	juci_netlink_parse_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nh));
+	if(!tb[IFLA_IFNAME]) return 0;
+	struct _ifname *entry = &names->entries[names->count++];
+	entry->index = ifi->ifi_index;
+	snprintf(entry->name, sizeof(entry->name), "%s", (char*)RTA_DATA(tb[IFLA_IFNAME]));
+	return 0;
+}
+
+static const char *_ifname(struct _ifnames *names, int index){
+	if(!names->loaded){
+		names->loaded = true;
+		juci_netlink_dump(RTM_GETLINK, AF_UNSPEC, _ifnames_add, names);
+	}
+	for(int c = 0; c < names->count; c++)
+		if(names->entries[c].index == index) return names->entries[c].name;
+	// interfaces that came up after the dump
+	if(names->count < JUCI_LUA_NET_MAX_IFACES){
+		struct _ifname *entry = &names->entries[names->count];
+		if(!if_indextoname(index, entry->name)) return NULL;
+		entry->index = index;
+		names->count++;
+		return entry->name;
+	}
+	return NULL;
+}
+
+static void _set_device(struct _dump *dump, const char *key, int index){
+	_set_string(dump->L, key, _ifname(dump->names, index));
+}
+
+static int _push_link(struct nlmsghdr *nh, void *arg){
+	struct _dump *dump = arg;
+	lua_State *L = dump->L;
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr *tb[IFLA_MAX + 1];
+	char flags[256] = "";
+
+	if(nh->nlmsg_type != RTM_NEWLINK) return 0;
+	juci_netlink_parse_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nh));
+	if(!tb[IFLA_IFNAME]) return 0;
+
+	lua_newtable(L);
+	_set_int(L, "index", ifi->ifi_index);
+	_set_string(L, "name", RTA_DATA(tb[IFLA_IFNAME]));
+
+	// same flag list that ip link prints
+	if((ifi->ifi_flags & IFF_UP) && !(ifi->ifi_flags & IFF_RUNNING)) strcat(flags, "NO-CARRIER,");
+	for(int c = 0; c < sizeof(_link_flag_values) / sizeof(_link_flag_values[0]); c++){
+		if(!(ifi->ifi_flags & _link_flag_values[c])) continue;
+		strcat(flags, _link_flag_names[c]);
+		strcat(flags, ",");
+	}
+	if(*flags) flags[strlen(flags) - 1] = 0;
+	_set_string(L, "flags", flags);
+	_set_bool(L, "up", ifi->ifi_flags & IFF_UP);
+	_set_bool(L, "running", ifi->ifi_flags & IFF_RUNNING);
+
+	switch(ifi->ifi_type){
+		case ARPHRD_ETHER: _set_string(L, "link_type", "ether"); break;
+		case ARPHRD_LOOPBACK: _set_string(L, "link_type", "loopback"); break;
+		case ARPHRD_PPP: _set_string(L, "link_type", "ppp"); break;
+		case ARPHRD_NONE: _set_string(L, "link_type", "none"); break;
+		default: _set_int(L, "link_type", ifi->ifi_type); break;
+	}
+	if(tb[IFLA_ADDRESS]) _set_mac(L, "macaddr", RTA_DATA(tb[IFLA_ADDRESS]), RTA_PAYLOAD(tb[IFLA_ADDRESS]));
+	if(tb[IFLA_BROADCAST]) _set_mac(L, "brd", RTA_DATA(tb[IFLA_BROADCAST]), RTA_PAYLOAD(tb[IFLA_BROADCAST]));
+	if(tb[IFLA_MTU]) _set_int(L, "mtu", *(uint32_t*)RTA_DATA(tb[IFLA_MTU]));
+	if(tb[IFLA_TXQLEN]) _set_int(L, "qlen", *(uint32_t*)RTA_DATA(tb[IFLA_TXQLEN]));
+	if(tb[IFLA_QDISC]) _set_string(L, "qdisc", RTA_DATA(tb[IFLA_QDISC]));
+	if(tb[IFLA_OPERSTATE]) _set_name(L, "state", _operstates, sizeof(_operstates) / sizeof(_operstates[0]), *(uint8_t*)RTA_DATA(tb[IFLA_OPERSTATE]));
+	if(tb[IFLA_MASTER]) _set_device(dump, "master", *(uint32_t*)RTA_DATA(tb[IFLA_MASTER]));
+	if(tb[IFLA_LINK] && *(uint32_t*)RTA_DATA(tb[IFLA_LINK]) != ifi->ifi_index) _set_device(dump, "parent", *(uint32_t*)RTA_DATA(tb[IFLA_LINK]));
+
+	if(tb[IFLA_STATS64] && RTA_PAYLOAD(tb[IFLA_STATS64]) >= sizeof(struct rtnl_link_stats64)){
+		struct rtnl_link_stats64 stats;
+		// the attribute is only 4 byte aligned
+		memcpy(&stats, RTA_DATA(tb[IFLA_STATS64]), sizeof(stats));
+		lua_newtable(L);
+		_set_number(L, "rx_bytes", stats.rx_bytes);
+		_set_number(L, "tx_bytes", stats.tx_bytes);
+		_set_number(L, "rx_packets", stats.rx_packets);
+		_set_number(L, "tx_packets", stats.tx_packets);
+		_set_number(L, "rx_errors", stats.rx_errors);
+		_set_number(L, "tx_errors", stats.tx_errors);
+		_set_number(L, "rx_dropped", stats.rx_dropped);
+		_set_number(L, "tx_dropped", stats.tx_dropped);
+		lua_setfield(L, -2, "stats");
+	}
+	_append(dump);
+	return 0;
+}
+
+static int _push_addr(struct nlmsghdr *nh, void *arg){
+	struct _dump *dump = arg;
+	lua_State *L = dump->L;
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	struct rtattr *tb[IFA_MAX + 1];
+
+	if(nh->nlmsg_type != RTM_NEWADDR) return 0;
+	if(ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6) return 0;
+	juci_netlink_parse_attrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nh));
+	// on point to point links IFA_ADDRESS is the peer and IFA_LOCAL our own address
+	struct rtattr *local = (tb[IFA_LOCAL])?tb[IFA_LOCAL]:tb[IFA_ADDRESS];
+	if(!local) return 0;
+
+	lua_newtable(L);
+	_set_string(L, "family", _family_name(ifa->ifa_family));
+	_set_addr(L, "addr", ifa->ifa_family, RTA_DATA(local));
+	_set_int(L, "prefixlen", ifa->ifa_prefixlen);
+	_set_mask(L, ifa->ifa_family, ifa->ifa_prefixlen);
+	if(tb[IFA_ADDRESS] && tb[IFA_LOCAL] && memcmp(RTA_DATA(tb[IFA_ADDRESS]), RTA_DATA(tb[IFA_LOCAL]), RTA_PAYLOAD(tb[IFA_LOCAL])) != 0)
+		_set_addr(L, "peer", ifa->ifa_family, RTA_DATA(tb[IFA_ADDRESS]));
+	if(tb[IFA_BROADCAST]) _set_addr(L, "brd", ifa->ifa_family, RTA_DATA(tb[IFA_BROADCAST]));
+	if(tb[IFA_LABEL]) _set_string(L, "label", RTA_DATA(tb[IFA_LABEL]));
+	switch(ifa->ifa_scope){
+		case RT_SCOPE_UNIVERSE: _set_string(L, "scope", "global"); break;
+		case RT_SCOPE_SITE: _set_string(L, "scope", "site"); break;
+		case RT_SCOPE_LINK: _set_string(L, "scope", "link"); break;
+		case RT_SCOPE_HOST: _set_string(L, "scope", "host"); break;
+		default: _set_int(L, "scope", ifa->ifa_scope); break;
+	}
+	_set_int(L, "index", ifa->ifa_index);
+	_set_device(dump, "device", ifa->ifa_index);
+	_append(dump);
+	return 0;
+}
+
+static int _push_route(struct nlmsghdr *nh, void *arg){
+	struct _dump *dump = arg;
+	lua_State *L = dump->L;
+	struct rtmsg *rtm = NLMSG_DATA(nh);
+	struct rtattr *tb[RTA_MAX + 1];
+	unsigned char any[16] = {0};
+
+	if(nh->nlmsg_type != RTM_NEWROUTE) return 0;
+	if(rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) return 0;
+	// cached routes are not part of the routing table
+	if(rtm->rtm_flags & RTM_F_CLONED) return 0;
+	juci_netlink_parse_attrs(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(nh));
+
+	uint32_t table = (tb[RTA_TABLE])?*(uint32_t*)RTA_DATA(tb[RTA_TABLE]):rtm->rtm_table;
+
+	lua_newtable(L);
+	_set_string(L, "family", _family_name(rtm->rtm_family));
+	_set_addr(L, "destination", rtm->rtm_family, (tb[RTA_DST])?RTA_DATA(tb[RTA_DST]):any);
+	_set_int(L, "prefixlen", rtm->rtm_dst_len);
+	_set_mask(L, rtm->rtm_family, rtm->rtm_dst_len);
+	if(tb[RTA_GATEWAY]) _set_addr(L, "gateway", rtm->rtm_family, RTA_DATA(tb[RTA_GATEWAY]));
+	if(tb[RTA_PREFSRC]) _set_addr(L, "source", rtm->rtm_family, RTA_DATA(tb[RTA_PREFSRC]));
+	if(tb[RTA_OIF]) _set_device(dump, "device", *(uint32_t*)RTA_DATA(tb[RTA_OIF]));
+	_set_int(L, "metric", (tb[RTA_PRIORITY])?*(uint32_t*)RTA_DATA(tb[RTA_PRIORITY]):0);
+	switch(table){
+		case RT_TABLE_MAIN: _set_string(L, "table", "main"); break;
+		case RT_TABLE_LOCAL: _set_string(L, "table", "local"); break;
+		case RT_TABLE_DEFAULT: _set_string(L, "table", "default"); break;
+		default: _set_int(L, "table", table); break;
+	}
+	_set_name(L, "type", _route_types, sizeof(_route_types) / sizeof(_route_types[0]), rtm->rtm_type);
+	_set_name(L, "protocol", _route_protocols, sizeof(_route_protocols) / sizeof(_route_protocols[0]), rtm->rtm_protocol);
+	_append(dump);
+	return 0;
+}
+
+static const char *_neigh_state(int state){
+	switch(state){
+		case NUD_INCOMPLETE: return "INCOMPLETE";
+		case NUD_REACHABLE: return "REACHABLE";
+		case NUD_STALE: return "STALE";
+		case NUD_DELAY: return "DELAY";
+		case NUD_PROBE: return "PROBE";
+		case NUD_FAILED: return "FAILED";
+		case NUD_NOARP: return "NOARP";
+		case NUD_PERMANENT: return "PERMANENT";
+		default: return "NONE";
+	}
+}
+
+static int _push_neigh(struct nlmsghdr *nh, void *arg){
+	struct _dump *dump = arg;
+	lua_State *L = dump->L;
+	struct ndmsg *ndm = NLMSG_DATA(nh);
+	struct rtattr *tb[NDA_MAX + 1];
+
+	if(nh->nlmsg_type != RTM_NEWNEIGH) return 0;
+	if(ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6) return 0;
+	// like ip neigh, leave out entries of interfaces that do not use arp
+	if(ndm->ndm_state & NUD_NOARP) return 0;
+	juci_netlink_parse_attrs(tb, NDA_MAX, (struct rtattr*)((char*)ndm + NLMSG_ALIGN(sizeof(struct ndmsg))), nh->nlmsg_len - NLMSG_LENGTH(sizeof(struct ndmsg)));
+	if(!tb[NDA_DST]) return 0;
+
+	lua_newtable(L);
+	_set_string(L, "family", _family_name(ndm->ndm_family));
+	_set_addr(L, "addr", ndm->ndm_family, RTA_DATA(tb[NDA_DST]));
+	if(tb[NDA_LLADDR]) _set_mac(L, "macaddr", RTA_DATA(tb[NDA_LLADDR]), RTA_PAYLOAD(tb[NDA_LLADDR]));
+	_set_device(dump, "device", ndm->ndm_ifindex);
+	_set_string(L, "state", _neigh_state(ndm->ndm_state));
+	_set_bool(L, "router", ndm->ndm_flags & NTF_ROUTER);
+	_append(dump);
+	return 0;
+}
+
+/*
+ * Fallbacks for when netlink can not be used. These read the older text
+ * interfaces in /proc/net and fill in what they provide.
+ */
+
+static int _prefix_len(uint32_t mask){
+	int len = 0;
+	for(mask = ntohl(mask); mask & 0x80000000; mask <<= 1) len++;
+	return len;
+}
+
+// parses 32 hex digits of an ipv6 address as printed in /proc/net
+static bool _parse_ip6(const char *hex, struct in6_addr *addr){
+	for(int c = 0; c < 16; c++){
+		unsigned int byte;
+		if(sscanf(hex + c * 2, "%2x", &byte) != 1) return false;
+		addr->s6_addr[c] = byte;
+	}
+	return true;
+}
+
+static void _proc_routes4(struct _dump *dump){
+	lua_State *L = dump->L;
+	char line[JUCI_LUA_NET_LINE_SIZE], dev[IF_NAMESIZE + 1];
+	unsigned int dst, gw, flags, metric, mask;
+	FILE *f = _open_file(dump, "/proc/net/route");
+	if(!f) return;
+	while(fgets(line, sizeof(line), f)){
+		if(sscanf(line, "%16s %x %x %x %*d %*d %u %x", dev, &dst, &gw, &flags, &metric, &mask) != 6) continue;
+		lua_newtable(L);
+		_set_string(L, "family", "inet");
+		_set_addr(L, "destination", AF_INET, &dst);
+		_set_int(L, "prefixlen", _prefix_len(mask));
+		_set_addr(L, "mask", AF_INET, &mask);
+		if(gw) _set_addr(L, "gateway", AF_INET, &gw);
+		_set_string(L, "device", dev);
+		_set_int(L, "metric", metric);
+		_set_string(L, "table", "main");
+		_set_string(L, "type", "unicast");
+		_append(dump);
+	}
+	_close_file(dump);
+}
+
+static void _proc_routes6(struct _dump *dump){
+	lua_State *L = dump->L;
+	char line[JUCI_LUA_NET_LINE_SIZE], dst[33], gw[33], dev[IF_NAMESIZE + 1];
+	unsigned int dst_len, metric, flags;
+	struct in6_addr addr;
+	FILE *f = _open_file(dump, "/proc/net/ipv6_route");
+	if(!f) return;
+	while(fgets(line, sizeof(line), f)){
+		if(sscanf(line, "%32s %x %*s %*x %32s %x %*x %*x %x %16s", dst, &dst_len, gw, &metric, &flags, dev) != 6) continue;
+		if(!_parse_ip6(dst, &addr)) continue;
+		lua_newtable(L);
+		_set_string(L, "family", "inet6");
+		_set_addr(L, "destination", AF_INET6, &addr);
+		_set_int(L, "prefixlen", dst_len);
+		if(_parse_ip6(gw, &addr) && !IN6_IS_ADDR_UNSPECIFIED(&addr)) _set_addr(L, "gateway", AF_INET6, &addr);
+		_set_string(L, "device", dev);
+		_set_int(L, "metric", metric);
+		_append(dump);
+	}
+	_close_file(dump);
+}
+
+static void _proc_arp(struct _dump *dump){
+	lua_State *L = dump->L;
+	char line[JUCI_LUA_NET_LINE_SIZE], ip[INET_ADDRSTRLEN], mac[32], dev[IF_NAMESIZE + 1];
+	unsigned int flags;
+	FILE *f = _open_file(dump, "/proc/net/arp");
+	if(!f) return;
+	while(fgets(line, sizeof(line), f)){
+		if(sscanf(line, "%15s %*x %x %31s %*s %16s", ip, &flags, mac, dev) != 4) continue;
+		lua_newtable(L);
+		_set_string(L, "family", "inet");
+		_set_string(L, "addr", ip);
+		if(flags & ATF_COM) _set_string(L, "macaddr", mac);
+		_set_string(L, "device", dev);
+		_set_string(L, "state", (flags & ATF_PERM)?"PERMANENT":(flags & ATF_COM)?"REACHABLE":"INCOMPLETE");
+		_set_bool(L, "router", false);
+		_append(dump);
+	}
+	_close_file(dump);
+}
+
+static void _proc_addrs6(struct _dump *dump){
+	lua_State *L = dump->L;
+	char line[JUCI_LUA_NET_LINE_SIZE], hex[33], dev[IF_NAMESIZE + 1];
+	unsigned int index, prefix, scope, flags;
+	struct in6_addr addr;
+	FILE *f = _open_file(dump, "/proc/net/if_inet6");
+	if(!f) return;
+	while(fgets(line, sizeof(line), f)){
+		if(sscanf(line, "%32s %x %x %x %x %16s", hex, &index, &prefix, &scope, &flags, dev) != 6) continue;
+		if(!_parse_ip6(hex, &addr)) continue;
+		lua_newtable(L);
+		_set_string(L, "family", "inet6");
+		_set_addr(L, "addr", AF_INET6, &addr);
+		_set_int(L, "prefixlen", prefix);
+		_set_string(L, "scope", (scope == 0x20)?"link":(scope == 0x10)?"host":"global");
+		_set_int(L, "index", index);
+		_set_string(L, "device", dev);
+		_append(dump);
+	}
+	_close_file(dump);
+}
+
+static void _proc_links(struct _dump *dump){
+	lua_State *L = dump->L;
+	char line[JUCI_LUA_NET_LINE_SIZE];
+	FILE *f = _open_file(dump, "/proc/net/dev");
+	if(!f) return;
+	while(fgets(line, sizeof(line), f)){
+		char *colon = strchr(line, ':');
+		if(!colon) continue;
+		*colon = 0;
+		char *name = line;
+		while(isspace(*name)) name++;
+		unsigned long long rx_bytes, rx_packets, rx_errors, rx_dropped, tx_bytes, tx_packets, tx_errors, tx_dropped;
+		if(sscanf(colon + 1, "%llu %llu %llu %llu %*u %*u %*u %*u %llu %llu %llu %llu",
+			&rx_bytes, &rx_packets, &rx_errors, &rx_dropped, &tx_bytes, &tx_packets, &tx_errors, &tx_dropped) != 8) continue;
+		lua_newtable(L);
+		_set_int(L, "index", if_nametoindex(name));
+		_set_string(L, "name", name);
+		lua_newtable(L);
+		_set_number(L, "rx_bytes", rx_bytes);
+		_set_number(L, "tx_bytes", tx_bytes);
+		_set_number(L, "rx_packets", rx_packets);
+		_set_number(L, "tx_packets", tx_packets);
+		_set_number(L, "rx_errors", rx_errors);
+		_set_number(L, "tx_errors", tx_errors);
+		_set_number(L, "rx_dropped", rx_dropped);
+		_set_number(L, "tx_dropped", tx_dropped);
+		lua_setfield(L, -2, "stats");
+		_append(dump);
+	}
+	_close_file(dump);
+}
+
+/*
+ * Calls func with the dump as its only argument in a protected call and
+ * releases what the dump holds afterwards, whether func returned or raised
+ * an error (usually out of memory). An error is raised again once the dump
+ * is cleaned up. 
+ */
+static int _run_protected(lua_State *L, lua_CFunction func, struct _dump *dump){
+	lua_pushcfunction(L, func);
+	lua_pushlightuserdata(L, dump);
+	int ret = lua_pcall(L, 1, 1, 0);
+	juci_netlink_dump_end(&dump->nl);
+	if(dump->file) _close_file(dump);
+	free(dump->socks.entries);
+	if(ret != 0) return lua_error(L);
+	return 1;
+}
+
+// runs the dump of _dump_families into a new table on the stack
+static int _dump_rows(lua_State *L){
+	struct _dump *dump = lua_touserdata(L, 1);
+	dump->L = L;
+
+	lua_newtable(L);
+	if(juci_netlink_dump_start(&dump->nl, dump->type, dump->family) == 0 &&
+		juci_netlink_dump_run(&dump->nl, dump->cb, dump) == 0) return 1;
+
+	// start over from the text files. Rows of a dump that failed halfway are dropped.
+	lua_pop(L, 1);
+	lua_newtable(L);
+	dump->count = 0;
+	if(dump->fallback4 && dump->family != AF_INET6) dump->fallback4(dump);
+	if(dump->fallback6 && dump->family != AF_INET) dump->fallback6(dump);
+	return 1;
+}
+
+// runs a dump for each requested family into a new table on the stack
+static int _dump_families(lua_State *L, int type, int family, juci_netlink_cb cb, void (*fallback4)(struct _dump *), void (*fallback6)(struct _dump *)){
+	struct _ifnames names = { .count = 0 };
+	struct _dump dump = { .L = L, .names = &names, .nl = JUCI_NETLINK_DUMP_INIT, .type = type, .family = family, .cb = cb, .fallback4 = fallback4, .fallback6 = fallback6 };
+	return _run_protected(L, _dump_rows, &dump);
+}
+
+// net.links() returns the network interfaces
+static int l_net_links(lua_State *L){
+	return _dump_families(L, RTM_GETLINK, AF_UNSPEC, _push_link, _proc_links, NULL);
+}
+
+// net.addresses([family]) returns the addresses of all interfaces
+static int l_net_addresses(lua_State *L){
+	return _dump_families(L, RTM_GETADDR, _parse_family(L, 1), _push_addr, NULL, _proc_addrs6);
+}
+
+// net.routes([family]) returns the routes of all tables
+static int l_net_routes(lua_State *L){
+	return _dump_families(L, RTM_GETROUTE, _parse_family(L, 1), _push_route, _proc_routes4, _proc_routes6);
+}
+
+// net.neighbors([family]) returns the arp and ipv6 neighbor tables
+static int l_net_neighbors(lua_State *L){
+	return _dump_families(L, RTM_GETNEIGH, _parse_family(L, 1), _push_neigh, _proc_arp, NULL);
+}
+
+static void _read_sockets(struct _sockets *socks, lua_State *L, struct _dump *dump, const char *path, const char *proto, int family, bool tcp){
+	char line[JUCI_LUA_NET_LINE_SIZE], local[64];
+	unsigned int port, state;
+	unsigned long inode;
+	FILE *f = _open_file(dump, path);
+	if(!f) return;
+	while(fgets(line, sizeof(line), f)){
+		if(sscanf(line, " %*d: %63[0-9A-Fa-f]:%x %*x:%*x %x %*x:%*x %*x:%*x %*x %*u %*u %lu", local, &port, &state, &inode) != 4) continue;
+		// listening tcp sockets and unconnected udp sockets, like netstat -l
+		if(state != ((tcp)?0x0a:0x07)) continue;
+
+		union { struct in_addr v4; struct in6_addr v6; uint32_t words[4]; } addr;
+		int words = (family == AF_INET6)?4:1;
+		for(int c = 0; c < words; c++){
+			if(sscanf(local + c * 8, "%8x", &addr.words[c]) != 1) words = -1;
+		}
+		if(words < 0) continue;
+
+		if(socks->count == socks->size){
+			int size = (socks->size)?(socks->size << 1):32;
+			struct _socket *entries = realloc(socks->entries, size * sizeof(struct _socket));
+			if(!entries) break;
+			socks->entries = entries;
+			socks->size = size;
+		}
+		socks->entries[socks->count++] = (struct _socket){ .inode = inode, .pid = 0 };
+
+		lua_newtable(L);
+		_set_string(L, "proto", proto);
+		_set_string(L, "family", _family_name(family));
+		_set_addr(L, "local_address", family, &addr);
+		_set_int(L, "local_port", port);
+		if(tcp) _set_string(L, "state", "LISTEN");
+		_set_number(L, "inode", inode);
+		_append(dump);
+	}
+	_close_file(dump);
+}
+
+// finds the processes that own the sockets by looking at their open files like netstat -p
+static void _find_socket_owners(struct _sockets *socks){
+	char path[64], link[64];
+	DIR *proc = opendir("/proc");
+	if(!proc) return;
+	struct dirent *pent;
+	while((pent = readdir(proc))){
+		if(!isdigit(pent->d_name[0])) continue;
+		int pid = atoi(pent->d_name);
+		snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+		DIR *fds = opendir(path);
+		if(!fds) continue;
+		struct dirent *fent;
+		while((fent = readdir(fds))){
+			if(!isdigit(fent->d_name[0])) continue;
+			snprintf(path, sizeof(path), "/proc/%d/fd/%.16s", pid, fent->d_name);
+			ssize_t len = readlink(path, link, sizeof(link) - 1);
+			if(len < 9 || strncmp(link, "socket:[", 8) != 0) continue;
+			link[len] = 0;
+			unsigned long inode = strtoul(link + 8, NULL, 10);
+			for(int c = 0; c < socks->count; c++){
+				if(socks->entries[c].inode != inode || socks->entries[c].pid) continue;
+				socks->entries[c].pid = pid;
+				snprintf(path, sizeof(path), "/proc/%d/comm", pid);
+				FILE *f = fopen(path, "r");
+				if(f){
+					if(fgets(socks->entries[c].name, sizeof(socks->entries[c].name), f))
+						socks->entries[c].name[strcspn(socks->entries[c].name, "\n")] = 0;
+					fclose(f);
+				}
+			}
+		}
+		closedir(fds);
+	}
+	closedir(proc);
+}
+
+static int _listening_rows(lua_State *L){
+	struct _dump *dump = lua_touserdata(L, 1);
+	struct _sockets *socks = &dump->socks;
+	dump->L = L;
+
+	lua_newtable(L);
+	_read_sockets(socks, L, dump, "/proc/net/tcp", "tcp", AF_INET, true);
+	_read_sockets(socks, L, dump, "/proc/net/tcp6", "tcp6", AF_INET6, true);
+	_read_sockets(socks, L, dump, "/proc/net/udp", "udp", AF_INET, false);
+	_read_sockets(socks, L, dump, "/proc/net/udp6", "udp6", AF_INET6, false);
+	if(socks->count) _find_socket_owners(socks);
+
+	// the rows are in the same order as the sockets
+	for(int c = 0; c < socks->count && c < dump->count; c++){
+		if(!socks->entries[c].pid) continue;
+		lua_rawgeti(L, -1, c + 1);
+		_set_int(L, "pid", socks->entries[c].pid);
+		_set_string(L, "name", socks->entries[c].name);
+		lua_pop(L, 1);
+	}
+	return 1;
+}
+
+// net.listening() returns the sockets that accept connections and the processes that own them
+static int l_net_listening(lua_State *L){
+	struct _dump dump = { .L = L, .nl = JUCI_NETLINK_DUMP_INIT };
+	return _run_protected(L, _listening_rows, &dump);
+}
+
+int juci_lua_open_net(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "links", l_net_links },
+		{ "addresses", l_net_addresses },
+		{ "routes", l_net_routes },
+		{ "neighbors", l_net_neighbors },
+		{ "listening", l_net_listening },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
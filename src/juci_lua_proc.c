@@ -0,0 +1,105 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pwd.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_proc.h"
+
+#define JUCI_LUA_PROC_USER_CACHE 16
+
+// shared by all lua states so that cpu usage is measured between any two calls
+static struct juci_proc_table _table;
+static bool _table_ready = false;
+
+struct _user_name {
+	uid_t uid;
+	char name[32];
+};
+
+static void _push_user(lua_State *L, struct _user_name *cache, int *cached, uid_t uid){
+	for(int c = 0; c < *cached; c++){
+		if(cache[c].uid == uid){
+			lua_pushstring(L, cache[c].name);
+			return;
+		}
+	}
+	struct passwd *pw = getpwuid(uid);
+	if(!pw){
+		lua_pushinteger(L, uid);
+		return;
+	}
+	lua_pushstring(L, pw->pw_name);
+	if(*cached < JUCI_LUA_PROC_USER_CACHE){
+		cache[*cached].uid = uid;
+		snprintf(cache[*cached].name, sizeof(cache[*cached].name), "%s", pw->pw_name);
+		(*cached)++;
+	}
+}
+
+// proc.list() returns a table with a row for each process
+static int l_proc_list(lua_State *L){
+	struct _user_name users[JUCI_LUA_PROC_USER_CACHE];
+	int cached = 0;
+
+	if(!_table_ready){
+		juci_proc_table_init(&_table);
+		_table_ready = true;
+	}
+	if(juci_proc_table_scan(&_table) < 0){
+		lua_pushnil(L);
+		lua_pushstring(L, "could not read process list");
+		return 2;
+	}
+
+	lua_newtable(L);
+	for(int c = 0; c < _table.count; c++){
+		struct juci_proc_entry *entry = &_table.entries[c];
+		char state[2] = { entry->state, 0 };
+		lua_pushinteger(L, c + 1);
+		lua_newtable(L);
+		lua_pushinteger(L, entry->pid); lua_setfield(L, -2, "pid");
+		lua_pushinteger(L, entry->ppid); lua_setfield(L, -2, "ppid");
+		lua_pushinteger(L, entry->uid); lua_setfield(L, -2, "uid");
+		_push_user(L, users, &cached, entry->uid);
+		lua_setfield(L, -2, "user");
+		lua_pushstring(L, state); lua_setfield(L, -2, "state");
+		lua_pushinteger(L, entry->threads); lua_setfield(L, -2, "threads");
+		lua_pushinteger(L, entry->vsz); lua_setfield(L, -2, "vsz");
+		lua_pushinteger(L, entry->rss); lua_setfield(L, -2, "rss");
+		lua_pushnumber(L, (_table.mem_total)?(entry->vsz * 100.0 / _table.mem_total):0); lua_setfield(L, -2, "vsz_percent");
+		lua_pushnumber(L, entry->cpu); lua_setfield(L, -2, "cpu");
+		lua_pushstring(L, entry->name); lua_setfield(L, -2, "name");
+		lua_pushstring(L, entry->command); lua_setfield(L, -2, "command");
+		lua_settable(L, -3);
+	}
+	return 1;
+}
+
+int juci_lua_open_proc(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "list", l_proc_list },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	return 1;
+}
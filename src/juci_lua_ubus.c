@@ -0,0 +1,328 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+// configure fails without libubus so there is no build without it
+#include <libubus.h>
+#include <libubox/avl-cmp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+ * This file only uses the libubox blob api. It must not include blobpack
+ * which defines its own blob types.
+ */
+#include "internal.h"
+#include "juci_lua.h"
+
+#ifndef JUCI_UBUS_TIMEOUT
+#define JUCI_UBUS_TIMEOUT 30000
+#endif
+
+// socket of the ubus daemon to use instead of the default one
+#define JUCI_UBUS_SOCKET_ENV "JUCI_UBUS_SOCKET"
+
+struct juci_ubus_object {
+	struct avl_node avl;
+	uint32_t id;
+	char path[];
+};
+
+/*
+ * All lua states run on the main thread so they share one connection which
+ * is made on the first call and kept for the lifetime of the server. Object
+ * ids are looked up once and kept until the object goes away.
+ */
+static struct {
+	struct ubus_context *ctx;
+	struct avl_tree objects;
+	struct blob_buf buf;
+	bool initialized;
+} _ubus;
+
+static void _ubus_drop_objects(void){
+	struct juci_ubus_object *obj, *tmp;
+	avl_remove_all_elements(&_ubus.objects, obj, avl, tmp)
+		free(obj);
+}
+
+static void _ubus_disconnect(void){
+	if(!_ubus.ctx) return;
+	ubus_free(_ubus.ctx);
+	_ubus.ctx = NULL;
+	// ids are only valid for as long as the daemon that handed them out is running
+	_ubus_drop_objects();
+}
+
+static struct ubus_context *_ubus_connect(void){
+	if(!_ubus.initialized){
+		avl_init(&_ubus.objects, avl_strcmp, false, NULL);
+		_ubus.initialized = true;
+	}
+	if(_ubus.ctx && _ubus.ctx->sock.eof) _ubus_disconnect();
+	if(_ubus.ctx) return _ubus.ctx;
+
+	_ubus.ctx = ubus_connect(getenv(JUCI_UBUS_SOCKET_ENV));
+	if(!_ubus.ctx){
+		ERROR("ubus: could not connect to ubus daemon\n");
+		return NULL;
+	}
+	return _ubus.ctx;
+}
+
+static int _ubus_lookup(struct ubus_context *ctx, const char *path, uint32_t *id){
+	struct juci_ubus_object *obj = avl_find_element(&_ubus.objects, path, obj, avl);
+	if(obj){
+		*id = obj->id;
+		return UBUS_STATUS_OK;
+	}
+	int ret = ubus_lookup_id(ctx, path, id);
+	if(ret != UBUS_STATUS_OK) return ret;
+
+	obj = calloc(1, sizeof(struct juci_ubus_object) + strlen(path) + 1);
+	if(!obj) return UBUS_STATUS_OK;
+	strcpy(obj->path, path);
+	obj->id = *id;
+	obj->avl.key = obj->path;
+	avl_insert(&_ubus.objects, &obj->avl);
+	return UBUS_STATUS_OK;
+}
+
+static void _ubus_forget(const char *path){
+	struct juci_ubus_object *obj = avl_find_element(&_ubus.objects, path, obj, avl);
+	if(!obj) return;
+	avl_delete(&_ubus.objects, &obj->avl);
+	free(obj);
+}
+
+static void _push_attrs(lua_State *L, struct blob_attr *head, int len, bool table);
+
+static void _push_attr(lua_State *L, struct blob_attr *attr){
+	switch(blobmsg_type(attr)){
+		case BLOBMSG_TYPE_BOOL:
+			lua_pushboolean(L, blobmsg_get_bool(attr));
+			break;
+		case BLOBMSG_TYPE_INT16:
+			lua_pushinteger(L, (int16_t)blobmsg_get_u16(attr));
+			break;
+		case BLOBMSG_TYPE_INT32:
+			lua_pushinteger(L, (int32_t)blobmsg_get_u32(attr));
+			break;
+		case BLOBMSG_TYPE_INT64:
+			lua_pushnumber(L, (lua_Number)(int64_t)blobmsg_get_u64(attr));
+			break;
+		case BLOBMSG_TYPE_DOUBLE:
+			lua_pushnumber(L, blobmsg_get_double(attr));
+			break;
+		case BLOBMSG_TYPE_STRING:
+			lua_pushstring(L, blobmsg_get_string(attr));
+			break;
+		case BLOBMSG_TYPE_ARRAY:
+			_push_attrs(L, blobmsg_data(attr), blobmsg_data_len(attr), false);
+			break;
+		case BLOBMSG_TYPE_TABLE:
+			_push_attrs(L, blobmsg_data(attr), blobmsg_data_len(attr), true);
+			break;
+		default:
+			lua_pushnil(L);
+			break;
+	}
+}
+
+static void _push_attrs(lua_State *L, struct blob_attr *head, int len, bool table){
+	struct blob_attr *attr;
+	int rem = len, index = 1;
+	lua_newtable(L);
+	__blob_for_each_attr(attr, head, rem){
+		if(table && !blobmsg_name(attr)[0]) continue;
+		_push_attr(L, attr);
+		if(table) lua_setfield(L, -2, blobmsg_name(attr));
+		else lua_rawseti(L, -2, index++);
+	}
+}
+
+// a table is sent as an array when its keys are exactly 1..n
+static bool _table_is_array(lua_State *L, int idx, int *len){
+	lua_Number max = 0;
+	int count = 0;
+	lua_pushnil(L);
+	while(lua_next(L, idx)){
+		lua_pop(L, 1);
+		if(lua_type(L, -1) != LUA_TNUMBER){
+			lua_pop(L, 1);
+			return false;
+		}
+		lua_Number key = lua_tonumber(L, -1);
+		if(key < 1 || key != (lua_Number)(int)key){
+			lua_pop(L, 1);
+			return false;
+		}
+		if(key > max) max = key;
+		count++;
+	}
+	*len = count;
+	return max == count;
+}
+
+static void _add_table(lua_State *L, int idx, struct blob_buf *buf, int len);
+
+static void _add_value(lua_State *L, struct blob_buf *buf, const char *name){
+	switch(lua_type(L, -1)){
+		case LUA_TBOOLEAN:
+			blobmsg_add_u8(buf, name, lua_toboolean(L, -1));
+			break;
+		case LUA_TNUMBER: {
+			lua_Number num = lua_tonumber(L, -1);
+			if(num != (lua_Number)(int64_t)num)
+				blobmsg_add_double(buf, name, num);
+			else if(num >= INT32_MIN && num <= INT32_MAX)
+				blobmsg_add_u32(buf, name, (uint32_t)(int32_t)num);
+			else
+				blobmsg_add_u64(buf, name, (uint64_t)(int64_t)num);
+			break;
+		}
+		case LUA_TSTRING:
+			blobmsg_add_string(buf, name, lua_tostring(L, -1));
+			break;
+		case LUA_TTABLE: {
+			int len = 0;
+			bool array = _table_is_array(L, lua_gettop(L), &len);
+			void *c = (array)?blobmsg_open_array(buf, name):blobmsg_open_table(buf, name);
+			_add_table(L, lua_gettop(L), buf, (array)?len:-1);
+			if(array) blobmsg_close_array(buf, c);
+			else blobmsg_close_table(buf, c);
+			break;
+		}
+		default:
+			// functions and userdata can not be sent
+			break;
+	}
+}
+
+// adds the items of an array of len items or the fields of a table (len < 0)
+static void _add_table(lua_State *L, int idx, struct blob_buf *buf, int len){
+	if(len >= 0){
+		for(int c = 1; c <= len; c++){
+			lua_rawgeti(L, idx, c);
+			_add_value(L, buf, NULL);
+			lua_pop(L, 1);
+		}
+		return;
+	}
+	lua_pushnil(L);
+	while(lua_next(L, idx)){
+		// copy the key so that lua_tostring does not change the one used by lua_next
+		lua_pushvalue(L, -2);
+		const char *name = lua_tostring(L, -1);
+		lua_pushvalue(L, -2);
+		if(name) _add_value(L, buf, name);
+		lua_pop(L, 3);
+	}
+}
+
+/*
+ * The reply is only copied while ubus_invoke runs. A lua error raised from
+ * inside the callback would jump out of libubus and leave its request,
+ * which lives on the stack of ubus_invoke, linked into the context.
+ */
+struct juci_ubus_reply {
+	struct blob_attr *data;
+	bool have_data;
+};
+
+static void _ubus_data_cb(struct ubus_request *req, int type, struct blob_attr *msg){
+	struct juci_ubus_reply *reply = (struct juci_ubus_reply*)req->priv;
+	if(!msg) return;
+	// only the last reply is returned when a method sends several
+	free(reply->data);
+	reply->data = blob_memdup(msg);
+	reply->have_data = true;
+}
+
+// converts the copied reply into a table, called protected so that the copy is always freed
+static int _reply_table(lua_State *L){
+	struct juci_ubus_reply *reply = lua_touserdata(L, 1);
+	if(reply->data) _push_attrs(L, blob_data(reply->data), blob_len(reply->data), true);
+	else lua_newtable(L);
+	return 1;
+}
+
+static int _ubus_invoke(struct ubus_context *ctx, const char *object, const char *method, struct juci_ubus_reply *reply){
+	uint32_t id;
+	int ret = _ubus_lookup(ctx, object, &id);
+	if(ret != UBUS_STATUS_OK) return ret;
+	ret = ubus_invoke(ctx, id, method, _ubus.buf.head, _ubus_data_cb, reply, JUCI_UBUS_TIMEOUT);
+	if(ret == UBUS_STATUS_NOT_FOUND && !reply->have_data){
+		// the object may have been registered again under a new id
+		_ubus_forget(object);
+		if(_ubus_lookup(ctx, object, &id) != UBUS_STATUS_OK) return ret;
+		ret = ubus_invoke(ctx, id, method, _ubus.buf.head, _ubus_data_cb, reply, JUCI_UBUS_TIMEOUT);
+	}
+	return ret;
+}
+
+// UBUS.call(object, method[, args]): returns the reply table or nil and an error
+static int l_ubus_call(lua_State *L){
+	const char *object = luaL_checkstring(L, 1);
+	const char *method = luaL_checkstring(L, 2);
+	struct juci_ubus_reply reply = { .data = NULL };
+
+	blob_buf_init(&_ubus.buf, 0);
+	if(lua_type(L, 3) == LUA_TTABLE) _add_table(L, 3, &_ubus.buf, -1);
+	else if(!lua_isnoneornil(L, 3)) return luaL_argerror(L, 3, "table expected");
+	lua_settop(L, 2);
+	// pushed before the call since pushing can fail once the reply has been copied
+	lua_pushcfunction(L, _reply_table);
+	lua_pushlightuserdata(L, &reply);
+
+	struct ubus_context *ctx = _ubus_connect();
+	if(!ctx){
+		lua_pushnil(L);
+		lua_pushstring(L, ubus_strerror(UBUS_STATUS_CONNECTION_FAILED));
+		return 2;
+	}
+
+	int ret = _ubus_invoke(ctx, object, method, &reply);
+	if(ret == UBUS_STATUS_CONNECTION_FAILED) _ubus_disconnect();
+	if(ret != UBUS_STATUS_OK){
+		free(reply.data);
+		DEBUG("ubus: call %s %s failed: %s\n", object, method, ubus_strerror(ret));
+		lua_pushnil(L);
+		lua_pushstring(L, ubus_strerror(ret));
+		return 2;
+	}
+	if(reply.have_data && !reply.data){
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(ENOMEM));
+		return 2;
+	}
+	ret = lua_pcall(L, 1, 1, 0);
+	free(reply.data);
+	if(ret != 0) return lua_error(L);
+	return 1;
+}
+
+void juci_lua_publish_ubus_api(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "call", l_ubus_call },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	lua_setfield(L, -2, "UBUS");
+}
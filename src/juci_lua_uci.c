@@ -0,0 +1,180 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <blobpack/blobpack.h>
+
+#include "internal.h"
+#include "juci_lua.h"
+#include "juci_uci.h"
+
+static struct blob_field *_find_key(struct blob_field *table, const char *name){
+	struct blob_field *key, *value;
+	blob_field_for_each_kv(table, key, value){
+		if(strcmp(blob_field_get_string(key), name) == 0) return value;
+	}
+	return NULL;
+}
+
+static const char *_section_type(struct blob_field *section){
+	struct blob_field *type = _find_key(section, ".type");
+	return (type)?blob_field_get_string(type):"";
+}
+
+// finds a section by name or by position among the sections of a type (@type[index])
+static struct blob_field *_find_section(struct blob_field *config, const char *name){
+	struct blob_field *key, *value;
+	char type[64];
+	int index = 0, count = 0;
+
+	if(name[0] != '@') return _find_key(config, name);
+	if(sscanf(name, "@%63[^[][%d]", type, &index) != 2) return NULL;
+	if(index < 0){
+		blob_field_for_each_kv(config, key, value){
+			if(strcmp(_section_type(value), type) == 0) count++;
+		}
+		index += count;
+	}
+	blob_field_for_each_kv(config, key, value){
+		if(strcmp(_section_type(value), type) != 0) continue;
+		if(index-- == 0) return value;
+	}
+	return NULL;
+}
+
+static void _push_value(lua_State *L, struct blob_field *value){
+	struct blob_field *item;
+	int index = 1;
+	if(blob_field_type(value) != BLOB_FIELD_ARRAY){
+		lua_pushstring(L, blob_field_get_string(value));
+		return;
+	}
+	lua_newtable(L);
+	blob_field_for_each_child(value, item){
+		lua_pushstring(L, blob_field_get_string(item));
+		lua_rawseti(L, -2, index++);
+	}
+}
+
+// sections are built by hand so that .anonymous is a boolean and .index a number
+static void _push_section(lua_State *L, struct blob_field *section){
+	struct blob_field *key, *value;
+	lua_newtable(L);
+	blob_field_for_each_kv(section, key, value){
+		const char *name = blob_field_get_string(key);
+		if(strcmp(name, ".anonymous") == 0) lua_pushboolean(L, blob_field_get_bool(value));
+		else if(strcmp(name, ".index") == 0) lua_pushinteger(L, blob_field_get_int(value));
+		else _push_value(L, value);
+		lua_setfield(L, -2, name);
+	}
+}
+
+static void _push_config(lua_State *L, struct blob_field *config){
+	struct blob_field *key, *value;
+	lua_newtable(L);
+	blob_field_for_each_kv(config, key, value){
+		_push_section(L, value);
+		lua_setfield(L, -2, blob_field_get_string(key));
+	}
+}
+
+// UCI.get(config[, section[, option]]) returns a config, a section or an option value
+static int l_uci_get(lua_State *L){
+	const char *name = luaL_checkstring(L, 1);
+	const char *section = luaL_optstring(L, 2, NULL);
+	const char *option = luaL_optstring(L, 3, NULL);
+
+	struct blob_field *config = juci_uci_get_config(name);
+	if(!config){
+		lua_pushnil(L);
+		return 1;
+	}
+	if(!section){
+		_push_config(L, config);
+		return 1;
+	}
+	struct blob_field *s = _find_section(config, section);
+	if(!s){
+		lua_pushnil(L);
+		return 1;
+	}
+	if(!option){
+		_push_section(L, s);
+		return 1;
+	}
+	struct blob_field *value = _find_key(s, option);
+	if(value) _push_value(L, value);
+	else lua_pushnil(L);
+	return 1;
+}
+
+// UCI.section(config, section)
+static int l_uci_section(lua_State *L){
+	luaL_checkstring(L, 2);
+	lua_settop(L, 2);
+	return l_uci_get(L);
+}
+
+/*
+ * UCI.foreach(config, type, fn) calls fn for every section of a type (or of
+ * any type when type is nil) in file order until fn returns false. Returns
+ * false when the config does not exist.
+ */
+static int l_uci_foreach(lua_State *L){
+	struct blob_field *key, *value;
+	const char *name = luaL_checkstring(L, 1);
+	const char *type = luaL_optstring(L, 2, NULL);
+	int count = 0;
+	luaL_checktype(L, 3, LUA_TFUNCTION);
+
+	struct blob_field *config = juci_uci_get_config(name);
+	if(!config){
+		lua_pushboolean(L, false);
+		return 1;
+	}
+	// the callback may read configs itself which can drop this one from the cache
+	lua_newtable(L);
+	blob_field_for_each_kv(config, key, value){
+		if(type && strcmp(_section_type(value), type) != 0) continue;
+		_push_section(L, value);
+		lua_rawseti(L, -2, ++count);
+	}
+	for(int c = 1; c <= count; c++){
+		lua_pushvalue(L, 3);
+		lua_rawgeti(L, -2, c);
+		lua_call(L, 1, 1);
+		bool stop = lua_isboolean(L, -1) && !lua_toboolean(L, -1);
+		lua_pop(L, 1);
+		if(stop) break;
+	}
+	lua_pushboolean(L, true);
+	return 1;
+}
+
+void juci_lua_publish_uci_api(lua_State *L){
+	static const luaL_Reg funcs[] = {
+		{ "get", l_uci_get },
+		{ "section", l_uci_section },
+		{ "foreach", l_uci_foreach },
+		{ NULL, NULL }
+	};
+	juci_lua_new_module(L, funcs);
+	lua_setfield(L, -2, "UCI");
+}
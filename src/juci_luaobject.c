@@ -16,6 +16,7 @@
 */
 
 #include <dirent.h>
+#include <time.h>
 
 #include "internal.h"
 #include "juci_luaobject.h"
@@ -23,15 +24,51 @@
 
 #define JUCI_LUA_LIB_PATH "/usr/lib/juci/lib/"
 
-struct juci_luaobject* juci_luaobject_new(const char *name){
-	struct juci_luaobject *self = calloc(1, sizeof(struct juci_luaobject)); 
-	assert(self); 
-	self->lua = luaL_newstate(); 
-	self->name = malloc(strlen(name) + 1); 
-	strcpy(self->name, name); 
-	self->avl.key = self->name; 
+// let the heap grow to 3x the live data before lua starts a cycle on its own.
+// This leaves the idle scheduler time to finish cycles outside of calls. 
+#define JUCI_GC_PAUSE 300
+#define JUCI_GC_STEPMUL 200
+// size of one idle collection step (in KiB of allocation debt)
+#define JUCI_GC_STEP_SIZE 16
+// growth since the last completed cycle before an idle cycle is started
+#define JUCI_GC_IDLE_THRESHOLD (32 * 1024)
+
+static uint64_t _monotonic_us(void){
+	struct timespec ts; 
+	clock_gettime(CLOCK_MONOTONIC, &ts); 
+	return (uint64_t)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000; 
+}
+
+static int _lua_panic(lua_State *L){
+	ERROR("lua panic: %s\n", lua_tostring(L, -1)); 
+	return 0; 
+}
+
+/*
+ * Lua has no hook for the end of a collection cycle. Instead we keep an
+ * unreferenced userdata around whose finalizer counts the cycle and plants a
+ * new sentinel for the next one.
+ */
+static void _gc_sentinel_new(lua_State *L, struct juci_luaobject *self); 
+static int _gc_sentinel_collect(lua_State *L){
+	struct juci_luaobject *self = (struct juci_luaobject*)lua_touserdata(L, lua_upvalueindex(1)); 
+	self->gc_cycles++; 
+	_gc_sentinel_new(L, self); 
+	return 0; 
+}
+
+static void _gc_sentinel_new(lua_State *L, struct juci_luaobject *self){
+	lua_newuserdata(L, 1); 
+	lua_newtable(L); 
+	lua_pushlightuserdata(L, self); 
+	lua_pushcclosure(L, _gc_sentinel_collect, 1); 
+	lua_setfield(L, -2, "__gc"); 
+	lua_setmetatable(L, -2); 
+	lua_pop(L, 1); 
+}
+
+static void _lua_state_init(struct juci_luaobject *self){
 	luaL_openlibs(self->lua); 
-	blob_init(&self->signature, 0, 0); 
 
 	// add proper lua paths
 	lua_getglobal(self->lua, "package"); 
@@ -57,11 +94,310 @@ struct juci_luaobject* juci_luaobject_new(const char *name){
 	lua_setfield(self->lua, -2, "path"); 
 	lua_pop(self->lua, 1); 
 
+	juci_lua_preload_modules(self->lua); 
+
+	_gc_sentinel_new(self->lua, self); 
+
+#ifdef LUA_GCGEN
+	lua_gc(self->lua, LUA_GCGEN, 0); 
+#else
+	lua_gc(self->lua, LUA_GCSETPAUSE, JUCI_GC_PAUSE); 
+	lua_gc(self->lua, LUA_GCSETSTEPMUL, JUCI_GC_STEPMUL); 
+#endif
+}
+
+// pushes the table that holds the globals of the object
+static void _push_env(struct juci_luaobject *self){
+	if(self->env_ref != LUA_NOREF) lua_rawgeti(self->lua, LUA_REGISTRYINDEX, self->env_ref); 
+	else juci_lua_push_globals(self->lua); 
+}
+
+// the object that owns the lua state (and its allocator) of an object
+static inline struct juci_luaobject *_owner(struct juci_luaobject *self){
+	return (self->host)?self->host:self; 
+}
+
+/*
+ * Hosted objects see the shared globals (_G and the standard libraries) and
+ * the modules they require through read-only proxies so that one plugin can
+ * not change them under the others. A proxy is an empty table that reads
+ * through to the original, handing out proxies for the tables it contains,
+ * and raises an error on assignment. pairs, ipairs and next of the
+ * environment see through proxies; functions that read tables directly
+ * (table.concat, #t in lua 5.1, JSON.stringify) do not. Every environment
+ * has its own view of proxies so rawset on one only affects that plugin.
+ * This keeps plugins from stepping on each other by accident. One that
+ * means to can still reach the originals through debug or getfenv(0).
+ */
+enum {
+	_VIEW_PROXIES = 1,	// original -> proxy, weak
+	_VIEW_ORIGINALS,	// proxy -> original, weak
+	_VIEW_META,		// metatable of the proxies
+	_VIEW_NEXT,		// next that sees through proxies
+	_VIEW_IPAIRS_ITER
+}; 
+
+// replaces the value on top of the stack with its proxy when it is a table
+static void _readonly_wrap(lua_State *L, int view){
+	if(lua_type(L, -1) != LUA_TTABLE) return; 
+	lua_rawgeti(L, view, _VIEW_ORIGINALS); 
+	lua_pushvalue(L, -2); 
+	lua_rawget(L, -2); 
+	bool is_proxy = !lua_isnil(L, -1); 
+	lua_pop(L, 2); 
+	if(is_proxy) return; 
+
+	lua_rawgeti(L, view, _VIEW_PROXIES); 
+	lua_pushvalue(L, -2); 
+	lua_rawget(L, -2); 
+	if(lua_isnil(L, -1)){
+		lua_pop(L, 1); 
+		lua_newtable(L); 
+		lua_rawgeti(L, view, _VIEW_META); 
+		lua_setmetatable(L, -2); 
+		// proxies[original] = proxy
+		lua_pushvalue(L, -3); 
+		lua_pushvalue(L, -2); 
+		lua_rawset(L, -4); 
+		// originals[proxy] = original
+		lua_rawgeti(L, view, _VIEW_ORIGINALS); 
+		lua_pushvalue(L, -2); 
+		lua_pushvalue(L, -5); 
+		lua_rawset(L, -3); 
+		lua_pop(L, 1); 
+	}
+	// original proxies proxy -> proxy
+	lua_replace(L, -3); 
+	lua_pop(L, 1); 
+}
+
+// pushes the original behind the proxy at idx, or nil when it is not a proxy
+static void _readonly_original(lua_State *L, int idx){
+	lua_rawgeti(L, lua_upvalueindex(1), _VIEW_ORIGINALS); 
+	lua_pushvalue(L, idx); 
+	lua_rawget(L, -2); 
+	lua_remove(L, -2); 
+}
+
+static int _proxy_index(lua_State *L){
+	_readonly_original(L, 1); 
+	lua_pushvalue(L, 2); 
+	lua_gettable(L, -2); 
+	_readonly_wrap(L, lua_upvalueindex(1)); 
+	return 1; 
+}
+
+static int _proxy_newindex(lua_State *L){
+	return luaL_error(L, "shared tables are read-only, copy them to make changes"); 
+}
+
+#if LUA_VERSION_NUM >= 502
+static int _proxy_len(lua_State *L){
+	_readonly_original(L, 1); 
+	lua_pushinteger(L, lua_rawlen(L, -1)); 
+	return 1; 
+}
+#endif
+
+static int _readonly_next(lua_State *L){
+	lua_settop(L, 2); 
+	_readonly_original(L, 1); 
+	if(lua_isnil(L, -1)){
+		lua_pop(L, 1); 
+		luaL_checktype(L, 1, LUA_TTABLE); 
+		if(lua_next(L, 1)) return 2; 
+		lua_pushnil(L); 
+		return 1; 
+	}
+	lua_pushvalue(L, 2); 
+	if(!lua_next(L, -2)){
+		lua_pushnil(L); 
+		return 1; 
+	}
+	_readonly_wrap(L, lua_upvalueindex(1)); 
+	return 2; 
+}
+
+// upvalues: the view and the real pairs
+static int _readonly_pairs(lua_State *L){
+	luaL_checkany(L, 1); 
+	_readonly_original(L, 1); 
+	if(lua_isnil(L, -1)){
+		lua_pushvalue(L, lua_upvalueindex(2)); 
+		lua_pushvalue(L, 1); 
+		lua_call(L, 1, 3); 
+		return 3; 
+	}
+	lua_rawgeti(L, lua_upvalueindex(1), _VIEW_NEXT); 
+	lua_pushvalue(L, 1); 
+	lua_pushnil(L); 
+	return 3; 
+}
+
+static int _readonly_ipairs_iter(lua_State *L){
+	int index = luaL_checkinteger(L, 2) + 1; 
+	_readonly_original(L, 1); 
+	lua_rawgeti(L, -1, index); 
+	if(lua_isnil(L, -1)) return 0; 
+	_readonly_wrap(L, lua_upvalueindex(1)); 
+	lua_pushinteger(L, index); 
+	lua_insert(L, -2); 
+	return 2; 
+}
+
+// upvalues: the view and the real ipairs
+static int _readonly_ipairs(lua_State *L){
+	luaL_checkany(L, 1); 
+	_readonly_original(L, 1); 
+	if(lua_isnil(L, -1)){
+		lua_pushvalue(L, lua_upvalueindex(2)); 
+		lua_pushvalue(L, 1); 
+		lua_call(L, 1, 3); 
+		return 3; 
+	}
+	lua_rawgeti(L, lua_upvalueindex(1), _VIEW_IPAIRS_ITER); 
+	lua_pushvalue(L, 1); 
+	lua_pushinteger(L, 0); 
+	return 3; 
+}
+
+// upvalues: the view and the real require
+static int _readonly_require(lua_State *L){
+	lua_pushvalue(L, lua_upvalueindex(2)); 
+	lua_insert(L, 1); 
+	lua_call(L, lua_gettop(L) - 1, 1); 
+	_readonly_wrap(L, lua_upvalueindex(1)); 
+	return 1; 
+}
+
+// __index of an environment: globals that it does not set itself
+static int _env_index(lua_State *L){
+	juci_lua_push_globals(L); 
+	lua_pushvalue(L, 2); 
+	lua_gettable(L, -2); 
+	_readonly_wrap(L, lua_upvalueindex(1)); 
+	return 1; 
+}
+
+static void _weak_table(lua_State *L, const char *mode){
+	lua_newtable(L); 
+	lua_newtable(L); 
+	lua_pushstring(L, mode); 
+	lua_setfield(L, -2, "__mode"); 
+	lua_setmetatable(L, -2); 
+}
+
+// pushes the view of an environment (see _readonly_wrap)
+static void _readonly_view_new(lua_State *L){
+	lua_newtable(L); 
+	int view = lua_gettop(L); 
+	_weak_table(L, "v"); 
+	lua_rawseti(L, view, _VIEW_PROXIES); 
+	_weak_table(L, "k"); 
+	lua_rawseti(L, view, _VIEW_ORIGINALS); 
+
+	lua_newtable(L); 
+	lua_pushvalue(L, view); 
+	lua_pushcclosure(L, _proxy_index, 1); 
+	lua_setfield(L, -2, "__index"); 
+	lua_pushcfunction(L, _proxy_newindex); 
+	lua_setfield(L, -2, "__newindex"); 
+#if LUA_VERSION_NUM >= 502
+	lua_pushvalue(L, view); 
+	lua_pushcclosure(L, _proxy_len, 1); 
+	lua_setfield(L, -2, "__len"); 
+#endif
+	// setmetatable on a proxy fails and getmetatable returns false
+	lua_pushboolean(L, 0); 
+	lua_setfield(L, -2, "__metatable"); 
+	lua_rawseti(L, view, _VIEW_META); 
+
+	lua_pushvalue(L, view); 
+	lua_pushcclosure(L, _readonly_next, 1); 
+	lua_rawseti(L, view, _VIEW_NEXT); 
+	lua_pushvalue(L, view); 
+	lua_pushcclosure(L, _readonly_ipairs_iter, 1); 
+	lua_rawseti(L, view, _VIEW_IPAIRS_ITER); 
+}
+
+// sets a function of the environment at -2 that gets the view at -1 and the real global of the same name
+static void _env_set_function(lua_State *L, const char *name, lua_CFunction func){
+	lua_pushvalue(L, -1); 
+	lua_getglobal(L, name); 
+	lua_pushcclosure(L, func, 2); 
+	lua_setfield(L, -3, name); 
+}
+
+// pushes a new environment for a hosted object
+static void _env_new(lua_State *L){
+	lua_newtable(L); 
+	_readonly_view_new(L); 
+
+	lua_newtable(L); 
+	lua_pushvalue(L, -2); 
+	lua_pushcclosure(L, _env_index, 1); 
+	lua_setfield(L, -2, "__index"); 
+	lua_setmetatable(L, -3); 
+
+	_env_set_function(L, "require", _readonly_require); 
+	_env_set_function(L, "pairs", _readonly_pairs); 
+	_env_set_function(L, "ipairs", _readonly_ipairs); 
+	lua_rawgeti(L, -1, _VIEW_NEXT); 
+	lua_setfield(L, -3, "next"); 
+	lua_pop(L, 1); 
+}
+
+struct juci_luaobject* juci_luaobject_new(const char *name, struct juci_luaobject *host){
+	struct juci_luaobject *self = calloc(1, sizeof(struct juci_luaobject)); 
+	assert(self); 
+	self->name = malloc(strlen(name) + 1); 
+	strcpy(self->name, name); 
+	self->avl.key = self->name; 
+	blob_init(&self->signature, 0, 0); 
+	self->env_ref = self->session_ref = LUA_NOREF; 
+
+	if(host){
+		// hosted objects share the state of the host but get their own
+		// environment that reads the shared globals through read-only proxies
+		self->host = host; 
+		self->lua = host->lua; 
+		_env_new(self->lua); 
+		self->env_ref = luaL_ref(self->lua, LUA_REGISTRYINDEX); 
+	} else {
+		self->alloc = juci_alloc_new(); 
+		self->lua = lua_newstate(juci_alloc_lua, self->alloc); 
+		assert(self->lua); 
+		lua_atpanic(self->lua, _lua_panic); 
+		_lua_state_init(self); 
+	}
+
+	_push_env(self); 
+	juci_lua_publish_json_api(self->lua); 
+	juci_lua_publish_file_api(self->lua); 
+	juci_lua_publish_uci_api(self->lua); 
+	juci_lua_publish_ubus_api(self->lua); 
+	juci_lua_publish_session_api(self->lua); 
+	lua_getfield(self->lua, -1, "SESSION"); 
+	self->session_ref = luaL_ref(self->lua, LUA_REGISTRYINDEX); 
+	lua_pop(self->lua, 1); 
+
 	return self; 
 }
 
 void juci_luaobject_delete(struct juci_luaobject **self){
-	lua_close((*self)->lua); 
+	if((*self)->host){
+		for(int c = 0; c < (*self)->num_methods; c++)
+			luaL_unref((*self)->lua, LUA_REGISTRYINDEX, (*self)->methods[c].ref); 
+		luaL_unref((*self)->lua, LUA_REGISTRYINDEX, (*self)->session_ref); 
+		luaL_unref((*self)->lua, LUA_REGISTRYINDEX, (*self)->env_ref); 
+	} else {
+		lua_close((*self)->lua); 
+		// all slabs of the state go back to the system here
+		juci_alloc_delete(&(*self)->alloc); 
+	}
+	for(int c = 0; c < (*self)->num_methods; c++)
+		free((*self)->methods[c].name); 
+	free((*self)->methods); 
 	blob_free(&(*self)->signature); 
 	free((*self)->name); 
 	free(*self); 
@@ -71,64 +407,214 @@ void juci_luaobject_delete(struct juci_luaobject **self){
 int juci_luaobject_load(struct juci_luaobject *self, const char *file){
 	if(luaL_loadfile(self->lua, file) != 0){
 		ERROR("could not load plugin: %s\n", lua_tostring(self->lua, -1)); 
+		lua_pop(self->lua, 1); 
 		return -1; 
 	}
+	if(self->env_ref != LUA_NOREF){
+		_push_env(self); 
+#if LUA_VERSION_NUM >= 502
+		if(!lua_setupvalue(self->lua, -2, 1)) lua_pop(self->lua, 1); 
+#else
+		lua_setfenv(self->lua, -2); 
+#endif
+	}
 	if(lua_pcall(self->lua, 0, 1, 0) != 0){
 		ERROR("could not run plugin: %s\n", lua_tostring(self->lua, -1)); 
+		lua_pop(self->lua, 1); 
 		return -1; 
 	}
-	// this just dumps the returned object
+	if(lua_type(self->lua, -1) != LUA_TTABLE){
+		ERROR("plugin %s did not return a table!\n", file); 
+		lua_pop(self->lua, 1); 
+		return -1; 
+	}
+	// build the signature and keep a reference to every function of the returned object
 	lua_pushnil(self->lua); 
-	const char *k; 
 	blob_offset_t root = blob_open_table(&self->signature); 
 	while(lua_next(self->lua, -2)){
-		lua_pop(self->lua, 1); 
-		k = lua_tostring(self->lua, -1); 
+		if(lua_type(self->lua, -2) != LUA_TSTRING || !lua_isfunction(self->lua, -1)){
+			lua_pop(self->lua, 1); 
+			continue; 
+		}
+		const char *k = lua_tostring(self->lua, -2); 
 		blob_put_string(&self->signature, k); 
 		blob_offset_t m = blob_open_array(&self->signature); 
 		blob_close_array(&self->signature, m); 
+
+		self->methods = realloc(self->methods, sizeof(struct juci_luaobject_method) * (self->num_methods + 1)); 
+		assert(self->methods); 
+		struct juci_luaobject_method *method = &self->methods[self->num_methods++]; 
+		method->name = strdup(k); 
+		// pops the function
+		method->ref = luaL_ref(self->lua, LUA_REGISTRYINDEX); 
 	}
 	blob_close_table(&self->signature, root); 
+	lua_pop(self->lua, 1); 
 	return 0; 
 }
 
-int juci_luaobject_call(struct juci_luaobject *self, struct juci_session *session, const char *method, struct blob_field *in, struct blob *out){
-	if(!self) return -1; 
+void juci_luaobject_set_memory_limits(struct juci_luaobject *self, size_t soft, size_t hard){
+	// limits of a shared state are set on its host
+	if(self->host) return; 
+	juci_alloc_set_limits(self->alloc, soft, hard); 
+}
 
-	// set self pointer of the global session object to point to current session
-	juci_lua_set_session(self->lua, session); 
+static void _record_gc_pause(struct juci_luaobject *self, uint64_t start){
+	uint64_t t = _monotonic_us() - start; 
+	self->gc_time_us += t; 
+	if(t > self->gc_max_pause_us) self->gc_max_pause_us = t; 
+}
 
-	if(lua_type(self->lua, -1) != LUA_TTABLE) {
-		ERROR("lua state is broken. No table on stack!\n"); 
-		return -1; 
+static void _emergency_gc(struct juci_luaobject *self){
+	uint64_t start = _monotonic_us(); 
+	lua_gc(self->lua, LUA_GCCOLLECT, 0); 
+	_record_gc_pause(self, start); 
+	self->gc_in_cycle = false; 
+	self->gc_baseline = self->alloc->used; 
+	self->emergency_gcs++; 
+	DEBUG("%s: emergency gc, %lu bytes in use\n", self->name, (unsigned long)self->alloc->used); 
+}
+
+struct juci_luaobject_method *juci_luaobject_find_method(struct juci_luaobject *self, const char *method){
+	for(int c = 0; c < self->num_methods; c++){
+		if(!strcmp(self->methods[c].name, method)) return &self->methods[c]; 
 	}
+	return NULL; 
+}
 
-	lua_getfield(self->lua, -1, method); 
-	if(!lua_isfunction(self->lua, -1)){
+int juci_luaobject_call(struct juci_luaobject *self, struct juci_session *session, const char *method, struct blob_field *in, struct blob *out){
+	if(!self) return -1; 
+	struct juci_luaobject_method *m = juci_luaobject_find_method(self, method); 
+	if(!m){
 		ERROR("can not call %s on %s: field is not a function!\n", method, self->name); 
 		// add an empty object
 		blob_offset_t t = blob_open_table(out); 
 		blob_close_table(out, t); 
 		return -1; 
 	}
+	return juci_luaobject_invoke(self, session, m, in, out); 
+}
+
+struct juci_luaobject_invocation {
+	struct juci_luaobject *self; 
+	struct juci_session *session; 
+	struct juci_luaobject_method *method; 
+	struct blob_field *in; 
+	struct blob result; 
+}; 
+
+/*
+ * Converting the arguments and the result allocates in the lua state just
+ * like the method itself does. Everything is done in a protected call so that
+ * hitting the hard memory limit on a big request fails the call instead of
+ * raising an error that ends up in the panic handler. The result is built
+ * in a separate buffer so that a failed call leaves nothing half written. 
+ */
+static int _invoke_protected(lua_State *L){
+	struct juci_luaobject_invocation *inv = lua_touserdata(L, 1); 
+
+	// set self pointer of the session object of the plugin to point to current session
+	lua_rawgeti(L, LUA_REGISTRYINDEX, inv->self->session_ref); 
+	juci_lua_set_session(L, inv->session); 
+	lua_pop(L, 1); 
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, inv->method->ref); 
+	if(inv->in) juci_lua_blob_to_table(L, inv->in, true); 
+	else lua_newtable(L); 
+	lua_call(L, 1, 1); 
+
+	blob_offset_t t = blob_open_table(&inv->result); 
+	if(lua_type(L, -1) == LUA_TTABLE) {
+		juci_lua_table_to_blob(L, &inv->result, true); 
+	}
+	blob_close_table(&inv->result, t); 
+	return 0; 
+}
 
-	if(in) juci_lua_blob_to_table(self->lua, in, true); 
-	else lua_newtable(self->lua); 
+int juci_luaobject_invoke(struct juci_luaobject *self, struct juci_session *session, struct juci_luaobject_method *method, struct blob_field *in, struct blob *out){
+	struct juci_luaobject *owner = _owner(self); 
+
+	// do not even enter the state if a collection can not bring it below its hard limit
+	if(juci_alloc_over_hard_limit(owner->alloc)){
+		_emergency_gc(owner); 
+		if(juci_alloc_over_hard_limit(owner->alloc)){
+			ERROR("%s: refusing call to %s, memory limit of %lu bytes reached\n", self->name, method->name, (unsigned long)owner->alloc->hard_limit); 
+			return -ENOMEM; 
+		}
+	}
 
-	if(lua_pcall(self->lua, 1, 1, 0) != 0){
-		ERROR("error calling %s: %s\n", method, lua_tostring(self->lua, -1)); 
+	struct juci_luaobject_invocation inv = { .self = self, .session = session, .method = method, .in = in };
+	blob_init(&inv.result, 0, 0); 
+
+	int ret = juci_lua_cpcall(self->lua, _invoke_protected, &inv); 
+	if(ret == LUA_ERRMEM){
+		ERROR("%s: out of memory calling %s (limit %lu bytes)\n", self->name, method->name, (unsigned long)owner->alloc->hard_limit); 
+		lua_pop(self->lua, 1); 
+		blob_free(&inv.result); 
+		_emergency_gc(owner); 
+		return -ENOMEM; 
+	} else if(ret != 0){
+		ERROR("error calling %s: %s\n", method->name, lua_tostring(self->lua, -1)); 
+		lua_pop(self->lua, 1); 
+		blob_free(&inv.result); 
 		return -1; 
 	}
 
 	blob_put_string(out, "result"); 
+	blob_put_attr(out, blob_field_first_child(blob_head(&inv.result))); 
+	blob_free(&inv.result); 
+
+	// collect the garbage of the call right away if it pushed us over the soft limit
+	if(juci_alloc_over_soft_limit(owner->alloc)){
+		_emergency_gc(owner); 
+		if(juci_alloc_over_soft_limit(owner->alloc)){
+			ERROR("%s: still using %lu bytes after gc (soft limit %lu)\n", self->name, (unsigned long)owner->alloc->used, (unsigned long)owner->alloc->soft_limit); 
+		}
+	}
+	return 0; 
+}
+
+bool juci_luaobject_gc_pending(struct juci_luaobject *self){
+	// shared states are collected through their host
+	if(self->host) return false; 
+	return self->gc_in_cycle || self->alloc->used > self->gc_baseline + JUCI_GC_IDLE_THRESHOLD; 
+}
+
+// runs one bounded collection step and returns the time it took in microseconds
+uint32_t juci_luaobject_gc_step(struct juci_luaobject *self){
+	uint64_t start = _monotonic_us(); 
+	self->gc_in_cycle = true; 
+	if(lua_gc(self->lua, LUA_GCSTEP, JUCI_GC_STEP_SIZE)){
+		self->gc_in_cycle = false; 
+		self->gc_baseline = self->alloc->used; 
+	}
+	self->gc_steps++; 
+	_record_gc_pause(self, start); 
+	return _monotonic_us() - start; 
+}
+
+void juci_luaobject_stats_to_blob(struct juci_luaobject *self, struct blob *out){
 	blob_offset_t t = blob_open_table(out); 
-	if(lua_type(self->lua, -1) == LUA_TTABLE) {
-		juci_lua_table_to_blob(self->lua, out, true); 
+	if(self->host){
+		// memory of hosted objects is accounted to the shared state
+		blob_put_string(out, "shared"); 
+		blob_put_bool(out, true); 
+		blob_close_table(out, t); 
+		return; 
 	}
+	blob_put_string(out, "gc_cycles"); 
+	blob_put_int(out, self->gc_cycles); 
+	blob_put_string(out, "emergency_gcs"); 
+	blob_put_int(out, self->emergency_gcs); 
+	blob_put_string(out, "gc_steps"); 
+	blob_put_int(out, self->gc_steps); 
+	blob_put_string(out, "gc_time_us"); 
+	blob_put_int(out, self->gc_time_us); 
+	blob_put_string(out, "gc_max_pause_us"); 
+	blob_put_int(out, self->gc_max_pause_us); 
+	blob_put_string(out, "alloc"); 
+	juci_alloc_to_blob(self->alloc, out); 
 	blob_close_table(out, t); 
-	
-	lua_pop(self->lua, 1); 	
-	return 0; 
 }
 
 
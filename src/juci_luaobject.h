@@ -22,16 +22,52 @@
 #include <blobpack/blobpack.h>
 #include <libutype/avl.h>
 
+#include "juci_alloc.h"
+
 struct juci_session; 
 
+struct juci_luaobject_method {
+	char *name; 
+	int ref; // registry reference of the lua function
+}; 
+
 struct juci_luaobject {
 	struct avl_node avl; 
 	char *name; 
 	struct blob signature; 
 	lua_State *lua; 
+	struct juci_alloc *alloc; 
+
+	// set when the object lives in the lua state of another object
+	struct juci_luaobject *host; 
+	// registry references of the environment and SESSION
+	int env_ref; 
+	int session_ref; 
+
+	// functions of the object table resolved at load time
+	struct juci_luaobject_method *methods; 
+	int num_methods; 
+
+	// number of completed garbage collection cycles of the lua state
+	uint32_t gc_cycles; 
+	// full collections forced because the state went over its memory limit
+	uint32_t emergency_gcs; 
+
+	// idle time collection bookkeeping
+	size_t gc_baseline; // bytes in use when the last idle cycle completed
+	bool gc_in_cycle; 
+	uint32_t gc_steps; 
+	uint64_t gc_time_us; // total time spent collecting outside of calls
+	uint32_t gc_max_pause_us; 
 }; 
 
-struct juci_luaobject* juci_luaobject_new(const char *name); 
+struct juci_luaobject* juci_luaobject_new(const char *name, struct juci_luaobject *host); 
 void juci_luaobject_delete(struct juci_luaobject **self); 
 int juci_luaobject_load(struct juci_luaobject *self, const char *file); 
+void juci_luaobject_set_memory_limits(struct juci_luaobject *self, size_t soft, size_t hard); 
+struct juci_luaobject_method *juci_luaobject_find_method(struct juci_luaobject *self, const char *method); 
 int juci_luaobject_call(struct juci_luaobject *self, struct juci_session *ses, const char *method, struct blob_field *in, struct blob *out); 
+int juci_luaobject_invoke(struct juci_luaobject *self, struct juci_session *ses, struct juci_luaobject_method *method, struct blob_field *in, struct blob *out); 
+bool juci_luaobject_gc_pending(struct juci_luaobject *self); 
+uint32_t juci_luaobject_gc_step(struct juci_luaobject *self); 
+void juci_luaobject_stats_to_blob(struct juci_luaobject *self, struct blob *out); 
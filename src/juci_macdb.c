@@ -0,0 +1,284 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "juci_macdb.h"
+#include "juci_private_file.h"
+
+#define JUCI_MACDB_MAGIC "JMDB"
+#define JUCI_MACDB_VERSION 1
+
+struct juci_macdb_header {
+	char magic[4];
+	uint32_t version;
+	// the text database the index was built from
+	uint64_t db_size;
+	int64_t db_mtime;
+	uint32_t count;
+	uint32_t names_size;
+};
+
+void juci_macdb_init(struct juci_macdb *self, const char *db_path, const char *index_path){
+	memset(self, 0, sizeof(*self));
+	snprintf(self->db_path, sizeof(self->db_path), "%s", db_path);
+	snprintf(self->index_path, sizeof(self->index_path), "%s", index_path);
+}
+
+static void _macdb_unload(struct juci_macdb *self){
+	if(self->mapped) munmap(self->data, self->size);
+	else free(self->data);
+	self->data = NULL;
+	self->size = 0;
+	self->mapped = false;
+	self->entries = NULL;
+	self->count = 0;
+	self->names = NULL;
+	self->names_size = 0;
+}
+
+void juci_macdb_free(struct juci_macdb *self){
+	_macdb_unload(self);
+}
+
+static inline int _hex_value(char ch){
+	if(ch >= '0' && ch <= '9') return ch - '0';
+	if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+	if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+	return -1;
+}
+
+int juci_macdb_parse_oui(const char *mac, uint32_t *oui){
+	uint32_t value = 0;
+	int digits = 0;
+	if(!mac) return -EINVAL;
+	for(const char *ch = mac; *ch && digits < 6; ch++){
+		if(*ch == ':' || *ch == '-' || *ch == '.') continue;
+		int v = _hex_value(*ch);
+		if(v < 0) return -EINVAL;
+		value = (value << 4) | v;
+		digits++;
+	}
+	if(digits < 6) return -EINVAL;
+	*oui = value;
+	return 0;
+}
+
+// checks that an index file is complete and was made from the current database
+static bool _macdb_valid(struct juci_macdb *self, const void *data, size_t size){
+	const struct juci_macdb_header *hdr = data;
+	if(size < sizeof(*hdr)) return false;
+	if(memcmp(hdr->magic, JUCI_MACDB_MAGIC, 4) != 0 || hdr->version != JUCI_MACDB_VERSION) return false;
+	if(hdr->db_size != (uint64_t)self->db_size || hdr->db_mtime != (int64_t)self->db_mtime) return false;
+	if(size != sizeof(*hdr) + (size_t)hdr->count * sizeof(struct juci_macdb_entry) + hdr->names_size) return false;
+	const char *names = (const char*)data + size - hdr->names_size;
+	return hdr->names_size > 0 && names[hdr->names_size - 1] == 0;
+}
+
+static void _macdb_set(struct juci_macdb *self, void *data, size_t size, bool mapped){
+	const struct juci_macdb_header *hdr = data;
+	self->data = data;
+	self->size = size;
+	self->mapped = mapped;
+	self->entries = (const struct juci_macdb_entry*)(hdr + 1);
+	self->count = hdr->count;
+	self->names = (const char*)data + size - hdr->names_size;
+	self->names_size = hdr->names_size;
+}
+
+static int _macdb_map(struct juci_macdb *self){
+	struct stat st;
+	int fd = juci_private_file_open(self->index_path);
+	if(fd < 0) return fd;
+	if(fstat(fd, &st) < 0 || st.st_size == 0){
+		close(fd);
+		return -EINVAL;
+	}
+	// the index is only ever replaced by a rename and never written in place
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) return -errno;
+	if(!_macdb_valid(self, data, st.st_size)){
+		munmap(data, st.st_size);
+		return -ESTALE;
+	}
+	_macdb_set(self, data, st.st_size, true);
+	return 0;
+}
+
+static int _entry_cmp(const void *a, const void *b){
+	const struct juci_macdb_entry *x = a, *y = b;
+	if(x->oui != y->oui) return (x->oui < y->oui)?-1:1;
+	// names are stored in file order so this keeps the first line for an oui
+	return (x->name < y->name)?-1:(x->name > y->name);
+}
+
+// parses the text database ("001122 Vendor name" per line) into an index image
+static int _macdb_build(struct juci_macdb *self, void **out, size_t *out_size){
+	struct juci_macdb_entry *entries = NULL;
+	char *names = NULL, *line = NULL;
+	size_t line_size = 0, count = 0, entries_size = 0, names_len = 0, names_cap = 0;
+	ssize_t len;
+	int ret = 0;
+
+	FILE *file = fopen(self->db_path, "re");
+	if(!file) return -errno;
+
+	while((len = getline(&line, &line_size, file)) > 0){
+		uint32_t oui;
+		while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = 0;
+		if(len < 8 || juci_macdb_parse_oui(line, &oui) < 0 || !isspace((unsigned char)line[6])) continue;
+		const char *name = line + 7;
+		while(isspace((unsigned char)*name)) name++;
+		size_t name_len = strlen(name) + 1;
+		if(name_len == 1) continue;
+
+		if(count == entries_size){
+			entries_size = (entries_size)?(entries_size * 2):4096;
+			void *ptr = realloc(entries, entries_size * sizeof(*entries));
+			if(!ptr){ ret = -ENOMEM; goto out; }
+			entries = ptr;
+		}
+		if(names_len + name_len > names_cap){
+			names_cap = (names_cap)?(names_cap * 2):65536;
+			if(names_cap < names_len + name_len) names_cap = names_len + name_len;
+			void *ptr = realloc(names, names_cap);
+			if(!ptr){ ret = -ENOMEM; goto out; }
+			names = ptr;
+		}
+		entries[count].oui = oui;
+		entries[count].name = names_len;
+		memcpy(names + names_len, name, name_len);
+		names_len += name_len;
+		count++;
+	}
+	if(!names){
+		// keep a valid image for an empty database so that it is not parsed again
+		names = calloc(1, 1);
+		if(!names){ ret = -ENOMEM; goto out; }
+		names_len = 1;
+	}
+
+	qsort(entries, count, sizeof(*entries), _entry_cmp);
+	size_t unique = 0;
+	for(size_t c = 0; c < count; c++){
+		if(unique && entries[unique - 1].oui == entries[c].oui) continue;
+		entries[unique++] = entries[c];
+	}
+
+	size_t size = sizeof(struct juci_macdb_header) + unique * sizeof(*entries) + names_len;
+	struct juci_macdb_header *hdr = calloc(1, size);
+	if(!hdr){ ret = -ENOMEM; goto out; }
+	memcpy(hdr->magic, JUCI_MACDB_MAGIC, 4);
+	hdr->version = JUCI_MACDB_VERSION;
+	hdr->db_size = self->db_size;
+	hdr->db_mtime = self->db_mtime;
+	hdr->count = unique;
+	hdr->names_size = names_len;
+	if(unique) memcpy(hdr + 1, entries, unique * sizeof(*entries));
+	memcpy((char*)hdr + size - names_len, names, names_len);
+	*out = hdr;
+	*out_size = size;
+out:
+	fclose(file);
+	free(line);
+	free(entries);
+	free(names);
+	return ret;
+}
+
+// writes the index next to its final path and renames it so readers never see a partial file
+static int _macdb_write(struct juci_macdb *self, const void *data, size_t size){
+	char tmp[sizeof(self->index_path) + 16];
+	int fd = juci_private_file_create(self->index_path, tmp, sizeof(tmp));
+	if(fd < 0) return fd;
+	const char *ptr = data;
+	size_t left = size;
+	while(left){
+		ssize_t ret = write(fd, ptr, left);
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret <= 0){
+			int err = (ret < 0)?-errno:-EIO;
+			close(fd);
+			unlink(tmp);
+			return err;
+		}
+		ptr += ret;
+		left -= ret;
+	}
+	close(fd);
+	if(rename(tmp, self->index_path) < 0){
+		int err = -errno;
+		unlink(tmp);
+		return err;
+	}
+	return 0;
+}
+
+int juci_macdb_open(struct juci_macdb *self){
+	struct stat st;
+	if(stat(self->db_path, &st) < 0){
+		_macdb_unload(self);
+		return -errno;
+	}
+	if(self->data && st.st_size == self->db_size && st.st_mtime == self->db_mtime) return 0;
+
+	_macdb_unload(self);
+	self->db_size = st.st_size;
+	self->db_mtime = st.st_mtime;
+
+	// another instance may already have built it
+	if(_macdb_map(self) == 0) return 0;
+
+	void *data = NULL;
+	size_t size = 0;
+	int ret = _macdb_build(self, &data, &size);
+	if(ret < 0){
+		ERROR("macdb: could not read %s: %s\n", self->db_path, strerror(-ret));
+		return ret;
+	}
+	DEBUG("macdb: built index of %s with %u entries\n", self->db_path, ((struct juci_macdb_header*)data)->count);
+	if(_macdb_write(self, data, size) == 0 && _macdb_map(self) == 0){
+		free(data);
+		return 0;
+	}
+	_macdb_set(self, data, size, false);
+	return 0;
+}
+
+const char *juci_macdb_lookup(struct juci_macdb *self, const char *mac){
+	uint32_t oui;
+	if(!self->entries || juci_macdb_parse_oui(mac, &oui) < 0) return NULL;
+	uint32_t lo = 0, hi = self->count;
+	while(lo < hi){
+		uint32_t mid = lo + ((hi - lo) >> 1);
+		if(self->entries[mid].oui < oui) lo = mid + 1;
+		else hi = mid;
+	}
+	if(lo == self->count || self->entries[lo].oui != oui) return NULL;
+	if(self->entries[lo].name >= self->names_size) return NULL;
+	return self->names + self->entries[lo].name;
+}
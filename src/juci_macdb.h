@@ -0,0 +1,67 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifndef JUCI_MACDB_PATH
+#define JUCI_MACDB_PATH "/usr/share/macdb/db.txt"
+#endif
+#ifndef JUCI_MACDB_INDEX_PATH
+// the directory must be private to us, see juci_private_file.h
+#define JUCI_MACDB_INDEX_PATH "/var/run/revorpcd/macdb.idx"
+#endif
+
+struct juci_macdb_entry {
+	uint32_t oui;
+	// offset of the vendor name in the string area
+	uint32_t name;
+};
+
+/*
+ * Vendor lookup by the first three bytes of a mac address. The text database
+ * is converted once into an index file that holds the entries sorted by oui
+ * followed by the vendor names. The index is mapped into memory so a lookup
+ * is a binary search. It is rebuilt when the size or modification time of
+ * the text database no longer match the ones it was built from. When the
+ * index can not be written it is kept in memory instead.
+ */
+struct juci_macdb {
+	char db_path[128];
+	char index_path[128];
+	void *data;
+	size_t size;
+	bool mapped;
+	const struct juci_macdb_entry *entries;
+	uint32_t count;
+	const char *names;
+	uint32_t names_size;
+	off_t db_size;
+	time_t db_mtime;
+};
+
+void juci_macdb_init(struct juci_macdb *self, const char *db_path, const char *index_path);
+void juci_macdb_free(struct juci_macdb *self);
+// loads the index, building it first if it is missing or out of date
+int juci_macdb_open(struct juci_macdb *self);
+// parses the oui of a mac address ("00:11:22:33:44:55", "00-11-22..." or "001122...")
+int juci_macdb_parse_oui(const char *mac, uint32_t *oui);
+// returns the vendor of a mac address or NULL when it is not known
+const char *juci_macdb_lookup(struct juci_macdb *self, const char *mac);
@@ -41,10 +41,15 @@ enum ubus_msg_type {
 	__UBUS_MSG_LAST
 }; 
 
+// random bytes of a connection that its login challenge is made from
+#define JUCI_PEER_NONCE_SIZE 16
+
 struct ubus_message {
 	struct list_head list; 
 	struct blob buf; 
-	int32_t peer; 
+	uint64_t peer; 
+	// nonce of the connection a received message came in on
+	uint8_t nonce[JUCI_PEER_NONCE_SIZE]; 
 }; 
 
 struct ubus_message *ubus_message_new(); 
@@ -0,0 +1,172 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/neighbour.h>
+
+#include "juci_netlink.h"
+
+#define JUCI_NETLINK_BUFFER_SIZE 32768
+// bursts of notifications (a link going down) must fit while the loop is busy
+#define JUCI_NETLINK_RCVBUF_SIZE (256 * 1024)
+
+// size of the family specific header that a dump request of a type carries
+static size_t _request_size(int type){
+	switch(type){
+		case RTM_GETLINK: return sizeof(struct ifinfomsg);
+		case RTM_GETADDR: return sizeof(struct ifaddrmsg);
+		case RTM_GETROUTE: return sizeof(struct rtmsg);
+		case RTM_GETNEIGH: return sizeof(struct ndmsg);
+		default: return 0;
+	}
+}
+
+void juci_netlink_parse_attrs(struct rtattr **tb, int max, struct rtattr *rta, int len){
+	memset(tb, 0, sizeof(struct rtattr*) * (max + 1));
+	for(; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)){
+		if(rta->rta_type <= max && !tb[rta->rta_type]) tb[rta->rta_type] = rta;
+	}
+}
+
+int juci_netlink_dump_start(struct juci_netlink_dump *self, int type, int family){
+	struct {
+		struct nlmsghdr nh;
+		// all of the request headers start with the family
+		union {
+			unsigned char family;
+			struct ifinfomsg link;
+			struct ifaddrmsg addr;
+			struct rtmsg route;
+			struct ndmsg neigh;
+		} body;
+	} req;
+	size_t size = _request_size(type);
+	if(!size) return -EINVAL;
+
+	self->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if(self->fd < 0) return -errno;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(size);
+	req.nh.nlmsg_type = type;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_seq = self->seq = (uint32_t)time(NULL);
+	req.body.family = family;
+
+	struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+	if(sendto(self->fd, &req, req.nh.nlmsg_len, 0, (struct sockaddr*)&kernel, sizeof(kernel)) < 0) return -errno;
+
+	self->buf = malloc(JUCI_NETLINK_BUFFER_SIZE);
+	if(!self->buf) return -ENOMEM;
+	return 0;
+}
+
+int juci_netlink_dump_run(struct juci_netlink_dump *self, juci_netlink_cb cb, void *arg){
+	int ret = 0;
+	bool done = false;
+	while(!done && ret == 0){
+		ssize_t len = recv(self->fd, self->buf, JUCI_NETLINK_BUFFER_SIZE, 0);
+		if(len < 0){
+			if(errno == EINTR) continue;
+			ret = -errno;
+			break;
+		}
+		if(len == 0){
+			ret = -EIO;
+			break;
+		}
+		struct nlmsghdr *nh = (struct nlmsghdr*)self->buf;
+		for(; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)){
+			if(nh->nlmsg_seq != self->seq) continue;
+			if(nh->nlmsg_type == NLMSG_DONE){
+				done = true;
+				break;
+			}
+			if(nh->nlmsg_type == NLMSG_ERROR){
+				struct nlmsgerr *err = NLMSG_DATA(nh);
+				ret = (err->error)?err->error:-EIO;
+				break;
+			}
+			ret = cb(nh, arg);
+			if(ret < 0) break;
+		}
+	}
+	return ret;
+}
+
+void juci_netlink_dump_end(struct juci_netlink_dump *self){
+	free(self->buf);
+	if(self->fd >= 0) close(self->fd);
+	self->buf = NULL;
+	self->fd = -1;
+}
+
+int juci_netlink_dump(int type, int family, juci_netlink_cb cb, void *arg){
+	struct juci_netlink_dump dump = JUCI_NETLINK_DUMP_INIT;
+	int ret = juci_netlink_dump_start(&dump, type, family);
+	if(ret == 0) ret = juci_netlink_dump_run(&dump, cb, arg);
+	juci_netlink_dump_end(&dump);
+	return ret;
+}
+
+int juci_netlink_open(unsigned int groups){
+	int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+	if(fd < 0) return -errno;
+
+	int size = JUCI_NETLINK_RCVBUF_SIZE;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	struct sockaddr_nl local = { .nl_family = AF_NETLINK, .nl_groups = groups };
+	if(bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0){
+		int err = -errno;
+		close(fd);
+		return err;
+	}
+	return fd;
+}
+
+int juci_netlink_read(int fd, juci_netlink_cb cb, void *arg){
+	char *buf = malloc(JUCI_NETLINK_BUFFER_SIZE);
+	if(!buf) return -ENOMEM;
+
+	int count = 0;
+	while(1){
+		ssize_t len = recv(fd, buf, JUCI_NETLINK_BUFFER_SIZE, 0);
+		if(len < 0){
+			if(errno == EINTR) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) count = -errno;
+			break;
+		}
+		if(len == 0) break;
+		struct nlmsghdr *nh = (struct nlmsghdr*)buf;
+		for(; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)){
+			if(nh->nlmsg_type == NLMSG_DONE || nh->nlmsg_type == NLMSG_ERROR) continue;
+			cb(nh, arg);
+			count++;
+		}
+	}
+
+	free(buf);
+	return count;
+}
@@ -0,0 +1,66 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+// called for every message of a dump. A negative return stops the dump.
+typedef int (*juci_netlink_cb)(struct nlmsghdr *msg, void *arg);
+
+/*
+ * Runs an rtnetlink dump request (RTM_GETLINK, RTM_GETADDR, RTM_GETROUTE or
+ * RTM_GETNEIGH) for the given address family and hands every reply message
+ * to cb. Returns 0 when the dump completed or a negative errno.
+ */
+int juci_netlink_dump(int type, int family, juci_netlink_cb cb, void *arg);
+
+/*
+ * The steps of juci_netlink_dump for callers whose callback may not return,
+ * such as one that raises lua errors. The caller owns the socket and buffer
+ * of the dump and releases them with juci_netlink_dump_end, which may be
+ * called whether or not start succeeded.
+ */
+struct juci_netlink_dump {
+	int fd;
+	uint32_t seq;
+	char *buf;
+};
+#define JUCI_NETLINK_DUMP_INIT { .fd = -1 }
+
+int juci_netlink_dump_start(struct juci_netlink_dump *self, int type, int family);
+int juci_netlink_dump_run(struct juci_netlink_dump *self, juci_netlink_cb cb, void *arg);
+void juci_netlink_dump_end(struct juci_netlink_dump *self);
+
+/*
+ * Opens a non blocking rtnetlink socket that receives the notifications of
+ * the given multicast groups (RTMGRP_*). Returns the fd or a negative errno.
+ */
+int juci_netlink_open(unsigned int groups);
+
+/*
+ * Hands every notification that is waiting on a socket from
+ * juci_netlink_open to cb. Returns the number of messages read or a negative
+ * errno. -ENOBUFS means that notifications were lost and the caller has to
+ * dump the state again.
+ */
+int juci_netlink_read(int fd, juci_netlink_cb cb, void *arg);
+
+// fills tb (of max + 1 entries) with the attributes of a message by type
+void juci_netlink_parse_attrs(struct rtattr **tb, int max, struct rtattr *rta, int len);
@@ -0,0 +1,400 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/neighbour.h>
+#include <libutype/avl-cmp.h>
+
+#include "internal.h"
+#include "juci_netlink.h"
+#include "juci_netwatch.h"
+
+#define JUCI_NETWATCH_KEY_SIZE 128
+
+#define JUCI_NETWATCH_GROUPS (RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR | \
+	RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE | RTMGRP_NEIGH)
+
+struct juci_netwatch_entry {
+	struct avl_node avl;
+	enum juci_netwatch_type type;
+	unsigned int generation;
+	// name of a link, used for the device field of the other entries
+	char ifname[IF_NAMESIZE];
+	struct blob data;
+	char key[];
+};
+
+// what a message says about the entry it describes
+struct _update {
+	enum juci_netwatch_type type;
+	bool remove;
+	// link is administratively up
+	bool up;
+	char key[JUCI_NETWATCH_KEY_SIZE];
+	char ifname[IF_NAMESIZE];
+};
+
+static const char *_topics[] = {
+	[JUCI_NETWATCH_LINK] = "network.link",
+	[JUCI_NETWATCH_ADDRESS] = "network.address",
+	[JUCI_NETWATCH_ROUTE] = "network.route",
+	[JUCI_NETWATCH_NEIGHBOR] = "network.neighbor"
+};
+
+static const char *_operstates[] = {
+	"UNKNOWN", "NOTPRESENT", "DOWN", "LOWERLAYERDOWN", "TESTING", "DORMANT", "UP"
+};
+
+const char *juci_netwatch_topic(enum juci_netwatch_type type){
+	return (type < JUCI_NETWATCH_TYPES)?_topics[type]:NULL;
+}
+
+static const char *_family_name(int family){
+	return (family == AF_INET6)?"inet6":"inet";
+}
+
+static void _put_string(struct blob *out, const char *key, const char *val){
+	if(!val) return;
+	blob_put_string(out, key);
+	blob_put_string(out, val);
+}
+
+static void _put_int(struct blob *out, const char *key, long long val){
+	blob_put_string(out, key);
+	blob_put_int(out, val);
+}
+
+static void _put_bool(struct blob *out, const char *key, bool val){
+	blob_put_string(out, key);
+	blob_put_bool(out, val);
+}
+
+static const char *_ntop(int family, const void *data, char *buf, size_t size){
+	return inet_ntop(family, data, buf, size);
+}
+
+static void _put_mac(struct blob *out, const char *key, struct rtattr *rta){
+	char buf[64];
+	int len = RTA_PAYLOAD(rta);
+	const unsigned char *data = RTA_DATA(rta);
+	if(len <= 0 || len * 3 > sizeof(buf)) return;
+	for(int c = 0; c < len; c++)
+		snprintf(buf + c * 3, 4, (c + 1 < len)?"%02x:":"%02x", data[c]);
+	_put_string(out, key, buf);
+}
+
+static struct juci_netwatch_entry *_find(struct juci_netwatch *self, const char *key){
+	struct juci_netwatch_entry *entry = NULL;
+	return avl_find_element(&self->entries, key, entry, avl);
+}
+
+static void _put_device(struct juci_netwatch *self, struct blob *out, const char *key, int index){
+	char link_key[32], name[IF_NAMESIZE];
+	snprintf(link_key, sizeof(link_key), "link/%d", index);
+	struct juci_netwatch_entry *link = _find(self, link_key);
+	if(link) _put_string(out, key, link->ifname);
+	else if(if_indextoname(index, name)) _put_string(out, key, name);
+}
+
+static int _parse_link(struct juci_netwatch *self, struct nlmsghdr *nh, struct _update *up, struct blob *out){
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr *tb[IFLA_MAX + 1];
+
+	// bridge port notifications describe the port and not the link itself
+	if(ifi->ifi_family != AF_UNSPEC) return -1;
+	juci_netlink_parse_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nh));
+	up->type = JUCI_NETWATCH_LINK;
+	up->remove = nh->nlmsg_type == RTM_DELLINK;
+	snprintf(up->key, sizeof(up->key), "link/%d", ifi->ifi_index);
+	if(up->remove) return 0;
+	if(!tb[IFLA_IFNAME]) return -1;
+	snprintf(up->ifname, sizeof(up->ifname), "%s", (char*)RTA_DATA(tb[IFLA_IFNAME]));
+
+	// counters are left out since they change with every packet
+	_put_int(out, "index", ifi->ifi_index);
+	_put_string(out, "name", up->ifname);
+	up->up = ifi->ifi_flags & IFF_UP;
+	_put_bool(out, "up", up->up);
+	_put_bool(out, "running", ifi->ifi_flags & IFF_RUNNING);
+	if(tb[IFLA_ADDRESS]) _put_mac(out, "macaddr", tb[IFLA_ADDRESS]);
+	if(tb[IFLA_MTU]) _put_int(out, "mtu", *(uint32_t*)RTA_DATA(tb[IFLA_MTU]));
+	if(tb[IFLA_OPERSTATE]){
+		uint8_t state = *(uint8_t*)RTA_DATA(tb[IFLA_OPERSTATE]);
+		if(state < sizeof(_operstates) / sizeof(_operstates[0])) _put_string(out, "state", _operstates[state]);
+	}
+	if(tb[IFLA_MASTER]) _put_device(self, out, "master", *(uint32_t*)RTA_DATA(tb[IFLA_MASTER]));
+	return 0;
+}
+
+static int _parse_addr(struct juci_netwatch *self, struct nlmsghdr *nh, struct _update *up, struct blob *out){
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	struct rtattr *tb[IFA_MAX + 1];
+	char addr[INET6_ADDRSTRLEN];
+
+	if(ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6) return -1;
+	juci_netlink_parse_attrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nh));
+	// on point to point links IFA_ADDRESS is the peer and IFA_LOCAL our own address
+	struct rtattr *local = (tb[IFA_LOCAL])?tb[IFA_LOCAL]:tb[IFA_ADDRESS];
+	if(!local || !_ntop(ifa->ifa_family, RTA_DATA(local), addr, sizeof(addr))) return -1;
+
+	up->type = JUCI_NETWATCH_ADDRESS;
+	up->remove = nh->nlmsg_type == RTM_DELADDR;
+	snprintf(up->key, sizeof(up->key), "address/%d/%s/%d", ifa->ifa_index, addr, ifa->ifa_prefixlen);
+
+	_put_string(out, "family", _family_name(ifa->ifa_family));
+	_put_string(out, "addr", addr);
+	_put_int(out, "prefixlen", ifa->ifa_prefixlen);
+	_put_int(out, "index", ifa->ifa_index);
+	_put_device(self, out, "device", ifa->ifa_index);
+	if(ifa->ifa_flags & IFA_F_TENTATIVE) _put_bool(out, "tentative", true);
+	return 0;
+}
+
+static int _parse_route(struct juci_netwatch *self, struct nlmsghdr *nh, struct _update *up, struct blob *out){
+	struct rtmsg *rtm = NLMSG_DATA(nh);
+	struct rtattr *tb[RTA_MAX + 1];
+	unsigned char any[16] = {0};
+	char dst[INET6_ADDRSTRLEN], buf[INET6_ADDRSTRLEN];
+
+	if(rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) return -1;
+	// cached routes are not part of the routing table
+	if(rtm->rtm_flags & RTM_F_CLONED) return -1;
+	juci_netlink_parse_attrs(tb, RTA_MAX, RTM_RTA(rtm), RTM_PAYLOAD(nh));
+	uint32_t table = (tb[RTA_TABLE])?*(uint32_t*)RTA_DATA(tb[RTA_TABLE]):rtm->rtm_table;
+	// the local table only holds the addresses of the system again
+	if(table == RT_TABLE_LOCAL) return -1;
+	uint32_t metric = (tb[RTA_PRIORITY])?*(uint32_t*)RTA_DATA(tb[RTA_PRIORITY]):0;
+	if(!_ntop(rtm->rtm_family, (tb[RTA_DST])?RTA_DATA(tb[RTA_DST]):any, dst, sizeof(dst))) return -1;
+
+	up->type = JUCI_NETWATCH_ROUTE;
+	up->remove = nh->nlmsg_type == RTM_DELROUTE;
+	uint32_t oif = (tb[RTA_OIF])?*(uint32_t*)RTA_DATA(tb[RTA_OIF]):0;
+	// ipv6 has the same link local route on every link
+	snprintf(up->key, sizeof(up->key), "route/%u/%s/%d/%u/%d/%u", table, dst, rtm->rtm_dst_len, metric, rtm->rtm_tos, oif);
+
+	_put_string(out, "family", _family_name(rtm->rtm_family));
+	_put_string(out, "destination", dst);
+	_put_int(out, "prefixlen", rtm->rtm_dst_len);
+	if(tb[RTA_GATEWAY]) _put_string(out, "gateway", _ntop(rtm->rtm_family, RTA_DATA(tb[RTA_GATEWAY]), buf, sizeof(buf)));
+	if(tb[RTA_PREFSRC]) _put_string(out, "source", _ntop(rtm->rtm_family, RTA_DATA(tb[RTA_PREFSRC]), buf, sizeof(buf)));
+	if(oif) _put_device(self, out, "device", oif);
+	_put_int(out, "metric", metric);
+	if(table == RT_TABLE_MAIN) _put_string(out, "table", "main");
+	else _put_int(out, "table", table);
+	return 0;
+}
+
+static const char *_neigh_state(int state){
+	switch(state){
+		case NUD_REACHABLE: return "REACHABLE";
+		case NUD_STALE: return "STALE";
+		case NUD_DELAY: return "DELAY";
+		case NUD_PROBE: return "PROBE";
+		case NUD_PERMANENT: return "PERMANENT";
+		default: return NULL;
+	}
+}
+
+static int _parse_neigh(struct juci_netwatch *self, struct nlmsghdr *nh, struct _update *up, struct blob *out){
+	struct ndmsg *ndm = NLMSG_DATA(nh);
+	struct rtattr *tb[NDA_MAX + 1];
+	char addr[INET6_ADDRSTRLEN];
+
+	// bridge fdb entries are reported with the bridge family
+	if(ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6) return -1;
+	juci_netlink_parse_attrs(tb, NDA_MAX, (struct rtattr*)((char*)ndm + NLMSG_ALIGN(sizeof(struct ndmsg))), nh->nlmsg_len - NLMSG_LENGTH(sizeof(struct ndmsg)));
+	if(!tb[NDA_DST] || !_ntop(ndm->ndm_family, RTA_DATA(tb[NDA_DST]), addr, sizeof(addr))) return -1;
+
+	up->type = JUCI_NETWATCH_NEIGHBOR;
+	snprintf(up->key, sizeof(up->key), "neighbor/%d/%s", ndm->ndm_ifindex, addr);
+	// neighbours that are being resolved or failed to resolve are not shown
+	const char *state = _neigh_state(ndm->ndm_state);
+	up->remove = nh->nlmsg_type == RTM_DELNEIGH || !state || !tb[NDA_LLADDR];
+	if(up->remove) return 0;
+
+	_put_string(out, "family", _family_name(ndm->ndm_family));
+	_put_string(out, "addr", addr);
+	_put_mac(out, "macaddr", tb[NDA_LLADDR]);
+	_put_device(self, out, "device", ndm->ndm_ifindex);
+	_put_string(out, "state", state);
+	if(ndm->ndm_flags & NTF_ROUTER) _put_bool(out, "router", true);
+	return 0;
+}
+
+static void _report(struct juci_netwatch *self, const char *action, struct juci_netwatch_entry *entry){
+	self->changes++;
+	if(self->cb) self->cb(_topics[entry->type], action, blob_field_first_child(blob_head(&entry->data)), self->arg);
+}
+
+static void _remove(struct juci_netwatch *self, struct juci_netwatch_entry *entry){
+	_report(self, "remove", entry);
+	avl_delete(&self->entries, &entry->avl);
+	self->count[entry->type]--;
+	blob_free(&entry->data);
+	free(entry);
+}
+
+static bool _blob_equal(struct blob *a, struct blob *b){
+	return blob_size(a) == blob_size(b) && memcmp(blob_head(a), blob_head(b), blob_size(a)) == 0;
+}
+
+static int _apply(struct nlmsghdr *nh, void *arg){
+	struct juci_netwatch *self = arg;
+	struct _update up;
+	int ret = -1;
+
+	memset(&up, 0, sizeof(up));
+	blob_reset(&self->tmp);
+	blob_offset_t t = blob_open_table(&self->tmp);
+	switch(nh->nlmsg_type){
+		case RTM_NEWLINK: case RTM_DELLINK: ret = _parse_link(self, nh, &up, &self->tmp); break;
+		case RTM_NEWADDR: case RTM_DELADDR: ret = _parse_addr(self, nh, &up, &self->tmp); break;
+		case RTM_NEWROUTE: case RTM_DELROUTE: ret = _parse_route(self, nh, &up, &self->tmp); break;
+		case RTM_NEWNEIGH: case RTM_DELNEIGH: ret = _parse_neigh(self, nh, &up, &self->tmp); break;
+	}
+	blob_close_table(&self->tmp, t);
+	if(ret < 0) return 0;
+
+	// the kernel drops ipv4 routes of a link that goes down or loses an address without telling
+	if((up.type == JUCI_NETWATCH_LINK && (up.remove || !up.up)) || (up.type == JUCI_NETWATCH_ADDRESS && up.remove))
+		self->routes_stale = true;
+
+	struct juci_netwatch_entry *entry = _find(self, up.key);
+	if(up.remove){
+		if(entry) _remove(self, entry);
+		return 0;
+	}
+	if(entry){
+		entry->generation = self->generation;
+		if(_blob_equal(&entry->data, &self->tmp)) return 0;
+		// the scratch buffer takes over the old state and is reused
+		struct blob old = entry->data;
+		entry->data = self->tmp;
+		self->tmp = old;
+		strcpy(entry->ifname, up.ifname);
+		_report(self, "change", entry);
+		return 0;
+	}
+
+	entry = calloc(1, sizeof(struct juci_netwatch_entry) + strlen(up.key) + 1);
+	if(!entry) return -ENOMEM;
+	strcpy(entry->key, up.key);
+	strcpy(entry->ifname, up.ifname);
+	entry->type = up.type;
+	entry->generation = self->generation;
+	entry->data = self->tmp;
+	blob_init(&self->tmp, 0, 0);
+	entry->avl.key = entry->key;
+	avl_insert(&self->entries, &entry->avl);
+	self->count[entry->type]++;
+	_report(self, "add", entry);
+	return 0;
+}
+
+static const int _dump_requests[JUCI_NETWATCH_TYPES] = {
+	[JUCI_NETWATCH_LINK] = RTM_GETLINK,
+	[JUCI_NETWATCH_ADDRESS] = RTM_GETADDR,
+	[JUCI_NETWATCH_ROUTE] = RTM_GETROUTE,
+	[JUCI_NETWATCH_NEIGHBOR] = RTM_GETNEIGH
+};
+
+// dumps one type and drops the entries of it that the dump did not return
+static int _resync_type(struct juci_netwatch *self, enum juci_netwatch_type type){
+	struct juci_netwatch_entry *entry, *nentry;
+
+	self->generation++;
+	int ret = juci_netlink_dump(_dump_requests[type], AF_UNSPEC, _apply, self);
+	if(ret < 0){
+		ERROR("netwatch: could not dump %s: %s\n", _topics[type], strerror(-ret));
+		return ret;
+	}
+	avl_for_each_element_safe(&self->entries, entry, avl, nentry){
+		if(entry->type == type && entry->generation != self->generation) _remove(self, entry);
+	}
+	return 0;
+}
+
+/*
+ * Reloads all state. Done at startup and when notifications were lost
+ * because the socket buffer ran full.
+ */
+static int _resync(struct juci_netwatch *self){
+	int ret = 0;
+	// links first so that the other entries can name their device
+	for(int type = 0; type < JUCI_NETWATCH_TYPES; type++){
+		int r = _resync_type(self, type);
+		if(r < 0) ret = r;
+	}
+	self->routes_stale = false;
+	return ret;
+}
+
+int juci_netwatch_init(struct juci_netwatch *self){
+	memset(self, 0, sizeof(*self));
+	avl_init(&self->entries, avl_strcmp, false, NULL);
+	blob_init(&self->tmp, 0, 0);
+	// subscribe before dumping so that no change can fall between the two
+	self->fd = juci_netlink_open(JUCI_NETWATCH_GROUPS);
+	if(self->fd < 0) return self->fd;
+	// a dump that failed only leaves that part of the model empty
+	_resync(self);
+	return 0;
+}
+
+void juci_netwatch_free(struct juci_netwatch *self){
+	struct juci_netwatch_entry *entry, *nentry;
+	avl_remove_all_elements(&self->entries, entry, avl, nentry){
+		blob_free(&entry->data);
+		free(entry);
+	}
+	if(self->fd >= 0) close(self->fd);
+	self->fd = -1;
+	blob_free(&self->tmp);
+}
+
+int juci_netwatch_poll(struct juci_netwatch *self, juci_netwatch_cb cb, void *arg){
+	if(self->fd < 0) return -EBADF;
+	self->cb = cb;
+	self->arg = arg;
+	int ret = juci_netlink_read(self->fd, _apply, self);
+	if(ret == -ENOBUFS){
+		DEBUG("netwatch: notifications lost, reloading state\n");
+		self->resyncs++;
+		ret = _resync(self);
+	} else if(self->routes_stale){
+		self->routes_stale = false;
+		_resync_type(self, JUCI_NETWATCH_ROUTE);
+	}
+	self->cb = NULL;
+	self->arg = NULL;
+	return ret;
+}
+
+void juci_netwatch_to_blob(struct juci_netwatch *self, enum juci_netwatch_type type, struct blob *out){
+	struct juci_netwatch_entry *entry;
+	blob_offset_t a = blob_open_array(out);
+	avl_for_each_element(&self->entries, entry, avl){
+		if(entry->type == type) blob_put_attr(out, blob_field_first_child(blob_head(&entry->data)));
+	}
+	blob_close_array(out, a);
+}
@@ -0,0 +1,68 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <libutype/avl.h>
+#include <blobpack/blobpack.h>
+
+enum juci_netwatch_type {
+	JUCI_NETWATCH_LINK,
+	JUCI_NETWATCH_ADDRESS,
+	JUCI_NETWATCH_ROUTE,
+	JUCI_NETWATCH_NEIGHBOR,
+	JUCI_NETWATCH_TYPES
+};
+
+// action is "add", "change" or "remove" and entry the new (or removed) state
+typedef void (*juci_netwatch_cb)(const char *topic, const char *action, struct blob_field *entry, void *arg);
+
+/*
+ * In memory copy of the links, addresses, routes and neighbours of the
+ * system that is kept up to date from rtnetlink notifications. Every change
+ * that a notification makes to an entry is reported once to the callback
+ * of juci_netwatch_poll. Notifications that do not change anything that is
+ * kept in the model (such as a neighbour being confirmed) are not reported.
+ */
+struct juci_netwatch {
+	int fd;
+	// entries by "type/identity"
+	struct avl_tree entries;
+	unsigned int count[JUCI_NETWATCH_TYPES];
+	// dumps mark the entries they see so that the ones that are gone can be removed
+	unsigned int generation;
+	// routes have to be dumped again after the next batch of notifications
+	bool routes_stale;
+	juci_netwatch_cb cb;
+	void *arg;
+	// scratch buffer an entry is built in before it is compared to the model
+	struct blob tmp;
+	unsigned long changes;
+	unsigned long resyncs;
+};
+
+// topic under which changes of a type are published ("network.link", ...)
+const char *juci_netwatch_topic(enum juci_netwatch_type type);
+
+// subscribes to the notifications and loads the current state
+int juci_netwatch_init(struct juci_netwatch *self);
+void juci_netwatch_free(struct juci_netwatch *self);
+// applies pending notifications and reports the changes they make to cb
+int juci_netwatch_poll(struct juci_netwatch *self, juci_netwatch_cb cb, void *arg);
+// writes an array of all entries of a type
+void juci_netwatch_to_blob(struct juci_netwatch *self, enum juci_netwatch_type type, struct blob *out);
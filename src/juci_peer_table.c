@@ -0,0 +1,100 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "juci_peer_table.h"
+
+#define JUCI_PEER_TABLE_INITIAL_SIZE 16
+#define JUCI_PEER_SLOT_NONE 0xffffffffU
+
+void juci_peer_table_init(struct juci_peer_table *self){
+	memset(self, 0, sizeof(*self));
+	self->free_head = self->free_tail = JUCI_PEER_SLOT_NONE;
+}
+
+void juci_peer_table_free(struct juci_peer_table *self){
+	free(self->slots);
+	juci_peer_table_init(self);
+}
+
+static int _grow(struct juci_peer_table *self){
+	uint32_t size = (self->size)?(self->size << 1):JUCI_PEER_TABLE_INITIAL_SIZE;
+	if(size > JUCI_PEER_MAX_SLOTS) size = JUCI_PEER_MAX_SLOTS;
+	if(size == self->size) return -ENOSPC;
+	struct juci_peer_slot *slots = realloc(self->slots, size * sizeof(struct juci_peer_slot));
+	if(!slots) return -ENOMEM;
+	// only called when the free list is empty so the new slots become all of it
+	for(uint32_t c = self->size; c < size; c++){
+		slots[c].ptr = NULL;
+		slots[c].gen = 1;
+		slots[c].next_free = (c + 1 < size)?(c + 1):JUCI_PEER_SLOT_NONE;
+	}
+	self->free_head = self->size;
+	self->free_tail = size - 1;
+	self->slots = slots;
+	self->size = size;
+	return 0;
+}
+
+int juci_peer_table_alloc(struct juci_peer_table *self, void *ptr, uint64_t *id){
+	if(!ptr) return -EINVAL;
+	if(self->free_head == JUCI_PEER_SLOT_NONE){
+		int ret = _grow(self);
+		if(ret < 0) return ret;
+	}
+	uint32_t idx = self->free_head;
+	struct juci_peer_slot *slot = &self->slots[idx];
+	self->free_head = slot->next_free;
+	if(self->free_head == JUCI_PEER_SLOT_NONE) self->free_tail = JUCI_PEER_SLOT_NONE;
+	slot->ptr = ptr;
+	slot->next_free = JUCI_PEER_SLOT_NONE;
+	self->count++;
+	*id = (slot->gen << JUCI_PEER_SLOT_BITS) | idx;
+	return 0;
+}
+
+static struct juci_peer_slot *_slot(struct juci_peer_table *self, uint64_t id){
+	uint32_t idx = id & JUCI_PEER_SLOT_MASK;
+	if(idx >= self->size) return NULL;
+	struct juci_peer_slot *slot = &self->slots[idx];
+	if(!slot->ptr || slot->gen != (id >> JUCI_PEER_SLOT_BITS)) return NULL;
+	return slot;
+}
+
+int juci_peer_table_release(struct juci_peer_table *self, uint64_t id){
+	struct juci_peer_slot *slot = _slot(self, id);
+	if(!slot) return -ENOENT;
+	uint32_t idx = id & JUCI_PEER_SLOT_MASK;
+	slot->ptr = NULL;
+	// generations start at 1 so that no id is ever 0
+	slot->gen++;
+	// the slot goes to the back of the free list
+	slot->next_free = JUCI_PEER_SLOT_NONE;
+	if(self->free_tail == JUCI_PEER_SLOT_NONE) self->free_head = idx;
+	else self->slots[self->free_tail].next_free = idx;
+	self->free_tail = idx;
+	self->count--;
+	return 0;
+}
+
+void *juci_peer_table_find(struct juci_peer_table *self, uint64_t id){
+	struct juci_peer_slot *slot = _slot(self, id);
+	return (slot)?slot->ptr:NULL;
+}
@@ -0,0 +1,63 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define JUCI_PEER_SLOT_BITS 16
+#define JUCI_PEER_SLOT_MASK ((1U << JUCI_PEER_SLOT_BITS) - 1)
+#define JUCI_PEER_MAX_SLOTS (1U << JUCI_PEER_SLOT_BITS)
+
+struct juci_peer_slot {
+	void *ptr;
+	uint64_t gen;
+	uint32_t next_free;
+};
+
+/*
+ * Table of connected peers. A peer id carries the index of its slot in the
+ * low bits and the generation of the slot in the high bits. Looking up a peer
+ * is a single array access and an id of a peer that has gone away does not
+ * match even when its slot has been reused, because freeing a slot bumps its
+ * generation. Generations have 48 bits so they do not wrap even at a million
+ * reconnects a second for years, and freed slots are reused in the order they
+ * were freed so that an id that just went away is not the next one handed out.
+ */
+struct juci_peer_table {
+	struct juci_peer_slot *slots;
+	uint32_t size;
+	uint32_t free_head;
+	uint32_t free_tail;
+	uint32_t count;
+};
+
+void juci_peer_table_init(struct juci_peer_table *self);
+void juci_peer_table_free(struct juci_peer_table *self);
+// stores ptr in a free slot and returns its id in *id
+int juci_peer_table_alloc(struct juci_peer_table *self, void *ptr, uint64_t *id);
+int juci_peer_table_release(struct juci_peer_table *self, uint64_t id);
+void *juci_peer_table_find(struct juci_peer_table *self, uint64_t id);
+
+static inline uint32_t juci_peer_table_count(struct juci_peer_table *self){
+	return self->count;
+}
+
+#define juci_peer_table_for_each(table, i, var) \
+	for((i) = 0; (i) < (table)->size; (i)++) \
+		if(((var) = (table)->slots[(i)].ptr) != NULL)
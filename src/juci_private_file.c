@@ -0,0 +1,80 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "juci_private_file.h"
+
+static int _check_dir(const char *path, bool create){
+	size_t len = strlen(path) + 1;
+	char *dir = alloca(len);
+	memcpy(dir, path, len);
+	char *slash = strrchr(dir, '/');
+	if(!slash) strcpy(dir, ".");
+	else if(slash == dir) slash[1] = 0;
+	else *slash = 0;
+
+	if(create && mkdir(dir, 0700) != 0 && errno != EEXIST) return -errno;
+
+	struct stat st;
+	if(lstat(dir, &st) != 0) return -errno;
+	if(!S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))){
+		ERROR("%s is not a private directory, not using %s\n", dir, path);
+		return -EPERM;
+	}
+	return 0;
+}
+
+int juci_private_file_dir(const char *path){
+	return _check_dir(path, true);
+}
+
+int juci_private_file_create(const char *path, char *tmp, size_t tmp_size){
+	int ret = _check_dir(path, true);
+	if(ret < 0) return ret;
+	// two instances can write the same file during a hot restart
+	if(snprintf(tmp, tmp_size, "%s.%d", path, (int)getpid()) >= tmp_size) return -ENAMETOOLONG;
+
+	// the directory is ours so a file left here by a crash can only be our own
+	unlink(tmp);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if(fd < 0) return -errno;
+	return fd;
+}
+
+int juci_private_file_open(const char *path){
+	int ret = _check_dir(path, false);
+	if(ret < 0) return ret;
+
+	int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd < 0) return -errno;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO))){
+		ERROR("refusing to read %s: not a private file\n", path);
+		close(fd);
+		return -EPERM;
+	}
+	return fd;
+}
@@ -0,0 +1,35 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Files that the server writes for itself (saved sessions, indexes) live in
+ * a directory that is owned by us and that nobody else can write to, so no
+ * other user can plant a file or a link where we expect ours. Files are only
+ * read back if they are regular files owned by us that nobody else can
+ * access.
+ */
+
+// creates the directory that contains path if it does not exist and checks that it is private
+int juci_private_file_dir(const char *path);
+// creates a new file next to path that only we can access and stores its name in tmp (strlen(path) + 16 bytes)
+int juci_private_file_create(const char *path, char *tmp, size_t tmp_size);
+// opens path for reading if it and the directory it is in are private
+int juci_private_file_open(const char *path);
@@ -0,0 +1,210 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ctype.h>
+
+#include "juci_proc.h"
+
+#define JUCI_PROC_READ_SIZE 1024
+
+static long _page_kb = 0;
+static long _clock_ticks = 0;
+
+// reads a small proc file into buf and terminates it. Returns its length.
+static int _read_file(const char *path, char *buf, size_t size){
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return -errno;
+	ssize_t len = read(fd, buf, size - 1);
+	close(fd);
+	if(len < 0) return -EIO;
+	buf[len] = 0;
+	return len;
+}
+
+static unsigned long long _read_total_ticks(void){
+	char buf[JUCI_PROC_READ_SIZE];
+	unsigned long long total = 0;
+	if(_read_file("/proc/stat", buf, sizeof(buf)) < 0 || strncmp(buf, "cpu ", 4) != 0) return 0;
+	// user nice system idle iowait irq softirq steal (guest time is already in user)
+	char *ptr = buf + 4;
+	for(int c = 0; c < 8; c++){
+		char *end;
+		unsigned long long val = strtoull(ptr, &end, 10);
+		if(end == ptr) break;
+		total += val;
+		ptr = end;
+	}
+	return total;
+}
+
+static unsigned long _read_mem_total(void){
+	char buf[JUCI_PROC_READ_SIZE];
+	if(_read_file("/proc/meminfo", buf, sizeof(buf)) < 0) return 0;
+	char *ptr = strstr(buf, "MemTotal:");
+	if(!ptr) return 0;
+	return strtoul(ptr + 9, NULL, 10);
+}
+
+static double _read_uptime_ticks(void){
+	char buf[64];
+	if(_read_file("/proc/uptime", buf, sizeof(buf)) < 0) return 0;
+	return strtod(buf, NULL) * _clock_ticks;
+}
+
+static int _read_stat(struct juci_proc_entry *entry, const char *dir){
+	char path[64], buf[JUCI_PROC_READ_SIZE];
+	snprintf(path, sizeof(path), "%s/stat", dir);
+	if(_read_file(path, buf, sizeof(buf)) < 0) return -ENOENT;
+
+	// the name is in parentheses and may itself contain spaces and parentheses
+	char *open = strchr(buf, '(');
+	char *close = strrchr(buf, ')');
+	if(!open || !close || close < open || close[1] != ' ') return -EINVAL;
+	size_t len = close - open - 1;
+	if(len >= sizeof(entry->name)) len = sizeof(entry->name) - 1;
+	memcpy(entry->name, open + 1, len);
+	entry->name[len] = 0;
+
+	unsigned long long utime, stime, starttime;
+	unsigned long vsize;
+	long rss;
+	int ppid, threads;
+	char state;
+	if(sscanf(close + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %d %*d %llu %lu %ld",
+		&state, &ppid, &utime, &stime, &threads, &starttime, &vsize, &rss) != 8) return -EINVAL;
+
+	entry->state = state;
+	entry->ppid = ppid;
+	entry->ticks = utime + stime;
+	entry->threads = threads;
+	entry->starttime = starttime;
+	entry->vsz = vsize / 1024;
+	entry->rss = rss * _page_kb;
+	return 0;
+}
+
+static void _read_status(struct juci_proc_entry *entry, const char *dir){
+	char path[64], buf[JUCI_PROC_READ_SIZE * 2];
+	snprintf(path, sizeof(path), "%s/status", dir);
+	if(_read_file(path, buf, sizeof(buf)) < 0) return;
+	char *ptr = strstr(buf, "\nUid:");
+	if(ptr) entry->uid = strtoul(ptr + 5, NULL, 10);
+}
+
+static void _read_cmdline(struct juci_proc_entry *entry, const char *dir){
+	char path[64];
+	snprintf(path, sizeof(path), "%s/cmdline", dir);
+	int len = _read_file(path, entry->command, sizeof(entry->command));
+	// kernel threads have no command line and are shown by name like top does
+	if(len <= 0){
+		snprintf(entry->command, sizeof(entry->command), "[%s]", entry->name);
+		return;
+	}
+	while(len > 0 && entry->command[len - 1] == 0) len--;
+	for(int c = 0; c < len; c++)
+		if(entry->command[c] == 0) entry->command[c] = ' ';
+	entry->command[len] = 0;
+}
+
+static int _cmp_pid(const void *a, const void *b){
+	const struct juci_proc_entry *pa = a, *pb = b;
+	return (pa->pid > pb->pid) - (pa->pid < pb->pid);
+}
+
+static struct juci_proc_entry *_find(struct juci_proc_entry *entries, int count, pid_t pid){
+	struct juci_proc_entry key = { .pid = pid };
+	return bsearch(&key, entries, count, sizeof(struct juci_proc_entry), _cmp_pid);
+}
+
+void juci_proc_table_init(struct juci_proc_table *self){
+	memset(self, 0, sizeof(*self));
+	if(!_page_kb) _page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	if(!_clock_ticks) _clock_ticks = sysconf(_SC_CLK_TCK);
+}
+
+void juci_proc_table_free(struct juci_proc_table *self){
+	free(self->entries);
+	self->entries = NULL;
+	self->count = self->size = 0;
+}
+
+int juci_proc_table_scan(struct juci_proc_table *self){
+	DIR *dir = opendir("/proc");
+	if(!dir) return -errno;
+
+	int size = (self->count > 16)?(self->count + (self->count >> 2)):64;
+	struct juci_proc_entry *entries = malloc(size * sizeof(struct juci_proc_entry));
+	if(!entries){
+		closedir(dir);
+		return -ENOMEM;
+	}
+	int count = 0;
+	unsigned long long total = _read_total_ticks();
+	double uptime = _read_uptime_ticks();
+
+	struct dirent *ent;
+	while((ent = readdir(dir))){
+		if(!isdigit(ent->d_name[0])) continue;
+		if(count == size){
+			struct juci_proc_entry *grown = realloc(entries, (size << 1) * sizeof(struct juci_proc_entry));
+			if(!grown) break;
+			entries = grown;
+			size <<= 1;
+		}
+		struct juci_proc_entry *entry = &entries[count];
+		char path[32];
+		memset(entry, 0, sizeof(*entry));
+		entry->pid = strtol(ent->d_name, NULL, 10);
+		snprintf(path, sizeof(path), "/proc/%d", (int)entry->pid);
+		// processes may exit while we look at them
+		if(_read_stat(entry, path) < 0) continue;
+		_read_status(entry, path);
+		_read_cmdline(entry, path);
+		count++;
+	}
+	closedir(dir);
+
+	qsort(entries, count, sizeof(struct juci_proc_entry), _cmp_pid);
+
+	unsigned long long elapsed = (total > self->total_ticks)?(total - self->total_ticks):0;
+	for(int c = 0; c < count; c++){
+		struct juci_proc_entry *entry = &entries[c];
+		struct juci_proc_entry *prev = (self->total_ticks)?_find(self->entries, self->count, entry->pid):NULL;
+		// a pid that has been reused belongs to a new process
+		if(prev && prev->starttime == entry->starttime && prev->ticks <= entry->ticks && elapsed){
+			entry->cpu = (entry->ticks - prev->ticks) * 100.0 / elapsed;
+		} else if(uptime > entry->starttime){
+			// total ticks count all cpus while the process ticks run on one
+			entry->cpu = entry->ticks * 100.0 / ((uptime - entry->starttime) * sysconf(_SC_NPROCESSORS_ONLN));
+		}
+	}
+
+	free(self->entries);
+	self->entries = entries;
+	self->count = count;
+	self->size = size;
+	self->total_ticks = total;
+	self->mem_total = _read_mem_total();
+	return count;
+}
@@ -0,0 +1,65 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define JUCI_PROC_NAME_SIZE 32
+#define JUCI_PROC_COMMAND_SIZE 256
+
+struct juci_proc_entry {
+	pid_t pid;
+	pid_t ppid;
+	uid_t uid;
+	char state;
+	int threads;
+	// kB
+	unsigned long vsz;
+	unsigned long rss;
+	// clock ticks since boot at which the process was started
+	unsigned long long starttime;
+	// user and system time in clock ticks
+	unsigned long long ticks;
+	// share of the total cpu time since the previous scan in percent
+	double cpu;
+	char name[JUCI_PROC_NAME_SIZE];
+	char command[JUCI_PROC_COMMAND_SIZE];
+};
+
+/*
+ * Process table read straight from /proc. The previous scan is kept so that
+ * the cpu usage of a process is the part of all cpu time that it used since
+ * then instead of a one shot sample. On the first scan, and for processes
+ * that were not there on the previous one, it is the average since the
+ * process was started.
+ */
+struct juci_proc_table {
+	struct juci_proc_entry *entries;
+	int count;
+	int size;
+	// jiffies of all cpus together at the time of the scan
+	unsigned long long total_ticks;
+	// kB
+	unsigned long mem_total;
+};
+
+void juci_proc_table_init(struct juci_proc_table *self);
+void juci_proc_table_free(struct juci_proc_table *self);
+// replaces the table with a new scan, using the old contents for the cpu deltas
+int juci_proc_table_scan(struct juci_proc_table *self);
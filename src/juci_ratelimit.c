@@ -0,0 +1,242 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <libutype/avl-cmp.h>
+
+#include "juci_ratelimit.h"
+
+#define JUCI_RATELIMIT_KEY_MAX 256
+
+struct juci_ratelimit_bucket {
+	struct avl_node avl;
+	struct juci_ratelimit_rule *rule;
+	// thousandths of a token
+	uint64_t tokens;
+	uint64_t stamp;
+	char key[];
+};
+
+static const char *_scope_names[] = {
+	[JUCI_RATELIMIT_SESSION] = "session",
+	[JUCI_RATELIMIT_USER] = "user",
+	[JUCI_RATELIMIT_GLOBAL] = "global"
+};
+
+void juci_ratelimit_init(struct juci_ratelimit *self){
+	memset(self, 0, sizeof(*self));
+	INIT_LIST_HEAD(&self->rules);
+	avl_init(&self->buckets, avl_strcmp, false, NULL);
+}
+
+void juci_ratelimit_free(struct juci_ratelimit *self){
+	struct juci_ratelimit_bucket *bucket, *nbucket;
+	struct juci_ratelimit_rule *rule, *nrule;
+
+	avl_remove_all_elements(&self->buckets, bucket, avl, nbucket)
+		free(bucket);
+	list_for_each_entry_safe(rule, nrule, &self->rules, list){
+		list_del(&rule->list);
+		free(rule->object);
+		free(rule->method);
+		free(rule);
+	}
+	self->num_rules = 0;
+}
+
+int juci_ratelimit_parse_scope(const char *name, enum juci_ratelimit_scope *scope){
+	for(int c = 0; c < sizeof(_scope_names) / sizeof(_scope_names[0]); c++){
+		if(strcmp(name, _scope_names[c]) == 0){
+			*scope = c;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+int juci_ratelimit_add_rule(struct juci_ratelimit *self, const char *object, const char *method, enum juci_ratelimit_scope scope, double rate, uint32_t burst){
+	if(rate <= 0 || rate > 1000000) return -EINVAL;
+	struct juci_ratelimit_rule *rule = calloc(1, sizeof(struct juci_ratelimit_rule));
+	if(!rule) return -ENOMEM;
+	rule->object = strdup((object)?object:"*");
+	rule->method = strdup((method)?method:"*");
+	rule->scope = scope;
+	rule->rate = (uint32_t)(rate * 1000);
+	if(!rule->rate) rule->rate = 1;
+	// without a burst a rule allows one second worth of calls at once
+	rule->burst = (burst)?burst:(uint32_t)(rate + 0.999);
+	list_add_tail(&rule->list, &self->rules);
+	self->num_rules++;
+	return 0;
+}
+
+/*
+ * The stamp only moves forward by the time that was turned into tokens so
+ * the fraction of a token that accumulated since is not lost. Otherwise a
+ * bucket that is checked more often than once per thousandth of a token
+ * would never refill at all. 
+ */
+static void _refill(struct juci_ratelimit_bucket *bucket, uint64_t now_ms){
+	struct juci_ratelimit_rule *rule = bucket->rule;
+	uint64_t capacity = (uint64_t)rule->burst * 1000;
+	if(now_ms <= bucket->stamp) return;
+	uint64_t tokens = (now_ms - bucket->stamp) * rule->rate / 1000;
+	if(bucket->tokens + tokens >= capacity){
+		bucket->tokens = capacity;
+		bucket->stamp = now_ms;
+		return;
+	}
+	bucket->tokens += tokens;
+	bucket->stamp += (tokens * 1000 + rule->rate - 1) / rule->rate;
+}
+
+static struct juci_ratelimit_bucket *_get_bucket(struct juci_ratelimit *self, struct juci_ratelimit_rule *rule, int idx, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms){
+	char key[JUCI_RATELIMIT_KEY_MAX];
+	const char *who = "";
+	if(rule->scope == JUCI_RATELIMIT_SESSION) who = sid;
+	else if(rule->scope == JUCI_RATELIMIT_USER) who = user;
+	int len = snprintf(key, sizeof(key), "%d %s %s %s", idx, who, object, method);
+	if(len < 0 || len >= sizeof(key)) return NULL;
+
+	struct juci_ratelimit_bucket *bucket = avl_find_element(&self->buckets, key, bucket, avl);
+	if(bucket) return bucket;
+
+	bucket = calloc(1, sizeof(struct juci_ratelimit_bucket) + len + 1);
+	if(!bucket) return NULL;
+	memcpy(bucket->key, key, len + 1);
+	bucket->avl.key = bucket->key;
+	bucket->rule = rule;
+	bucket->tokens = (uint64_t)rule->burst * 1000;
+	bucket->stamp = now_ms;
+	avl_insert(&self->buckets, &bucket->avl);
+	return bucket;
+}
+
+// finds the buckets of all rules that match the call and returns the time in ms until each of them has a token
+static uint64_t _match(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms, struct juci_ratelimit_bucket **matched, int *count){
+	struct juci_ratelimit_rule *rule;
+	int idx = 0;
+	uint64_t wait = 0;
+
+	if(!sid) sid = "";
+	if(!user) user = "";
+
+	*count = 0;
+	list_for_each_entry(rule, &self->rules, list){
+		idx++;
+		if(fnmatch(rule->object, object, FNM_NOESCAPE) != 0 || fnmatch(rule->method, method, FNM_NOESCAPE) != 0) continue;
+		struct juci_ratelimit_bucket *bucket = _get_bucket(self, rule, idx, sid, user, object, method, now_ms);
+		if(!bucket){
+			// a call that can not be counted is throttled instead of let through
+			uint64_t ms = (1000000 + rule->rate - 1) / rule->rate;
+			if(ms > wait) wait = ms;
+			rule->throttled++;
+			continue;
+		}
+		_refill(bucket, now_ms);
+		if(bucket->tokens < 1000){
+			// time until the bucket has a whole token again
+			uint64_t ms = ((1000 - bucket->tokens) * 1000 + rule->rate - 1) / rule->rate;
+			if(ms > wait) wait = ms;
+			rule->throttled++;
+		}
+		matched[(*count)++] = bucket;
+	}
+	return wait;
+}
+
+static int _throttle(struct juci_ratelimit *self, uint64_t wait, uint32_t *retry_ms){
+	self->throttled++;
+	if(retry_ms) *retry_ms = (wait > UINT32_MAX)?UINT32_MAX:(uint32_t)wait;
+	return -EAGAIN;
+}
+
+int juci_ratelimit_check(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms, uint32_t *retry_ms){
+	struct juci_ratelimit_bucket *matched[self->num_rules];
+	int count;
+	uint64_t wait = _match(self, sid, user, object, method, now_ms, matched, &count);
+
+	// tokens are only taken when every bucket has one so a throttled call costs nothing
+	if(wait) return _throttle(self, wait, retry_ms);
+	for(int c = 0; c < count; c++) matched[c]->tokens -= 1000;
+	self->allowed++;
+	return 0;
+}
+
+int juci_ratelimit_peek(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms, uint32_t *retry_ms){
+	struct juci_ratelimit_bucket *matched[self->num_rules];
+	int count;
+	uint64_t wait = _match(self, sid, user, object, method, now_ms, matched, &count);
+
+	if(wait) return _throttle(self, wait, retry_ms);
+	self->allowed++;
+	return 0;
+}
+
+void juci_ratelimit_charge(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms){
+	struct juci_ratelimit_bucket *matched[self->num_rules];
+	int count;
+	_match(self, sid, user, object, method, now_ms, matched, &count);
+
+	for(int c = 0; c < count; c++)
+		matched[c]->tokens = (matched[c]->tokens > 1000)?matched[c]->tokens - 1000:0;
+}
+
+void juci_ratelimit_sweep(struct juci_ratelimit *self, uint64_t now_ms){
+	struct juci_ratelimit_bucket *bucket, *nbucket;
+	avl_for_each_element_safe(&self->buckets, bucket, avl, nbucket){
+		_refill(bucket, now_ms);
+		if(bucket->tokens < (uint64_t)bucket->rule->burst * 1000) continue;
+		avl_delete(&self->buckets, &bucket->avl);
+		free(bucket);
+	}
+}
+
+void juci_ratelimit_to_blob(struct juci_ratelimit *self, struct blob *out){
+	struct juci_ratelimit_rule *rule;
+	blob_offset_t t = blob_open_table(out);
+	blob_put_string(out, "allowed");
+	blob_put_int(out, self->allowed);
+	blob_put_string(out, "throttled");
+	blob_put_int(out, self->throttled);
+	blob_put_string(out, "buckets");
+	blob_put_int(out, self->buckets.count);
+	blob_put_string(out, "rules");
+	blob_offset_t a = blob_open_array(out);
+	list_for_each_entry(rule, &self->rules, list){
+		blob_offset_t r = blob_open_table(out);
+		blob_put_string(out, "object");
+		blob_put_string(out, rule->object);
+		blob_put_string(out, "method");
+		blob_put_string(out, rule->method);
+		blob_put_string(out, "scope");
+		blob_put_string(out, _scope_names[rule->scope]);
+		blob_put_string(out, "rate");
+		blob_put_real(out, rule->rate / 1000.0);
+		blob_put_string(out, "burst");
+		blob_put_int(out, rule->burst);
+		blob_put_string(out, "throttled");
+		blob_put_int(out, rule->throttled);
+		blob_close_table(out, r);
+	}
+	blob_close_array(out, a);
+	blob_close_table(out, t);
+}
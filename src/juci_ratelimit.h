@@ -0,0 +1,76 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <libutype/avl.h>
+#include <libutype/list.h>
+#include <blobpack/blobpack.h>
+
+// what a bucket of a rule is shared by
+enum juci_ratelimit_scope {
+	JUCI_RATELIMIT_SESSION,
+	JUCI_RATELIMIT_USER,
+	JUCI_RATELIMIT_GLOBAL
+};
+
+struct juci_ratelimit_rule {
+	struct list_head list;
+	char *object;
+	char *method;
+	enum juci_ratelimit_scope scope;
+	// thousandths of a call per second and calls
+	uint32_t rate;
+	uint32_t burst;
+	unsigned long throttled;
+};
+
+/*
+ * Token buckets for rpc calls. Each rule applies to the calls whose object
+ * and method match its patterns and gives every session, user or the whole
+ * server (depending on its scope) a separate bucket per object and method.
+ * A call is only let through when all buckets it falls into have a token
+ * left. Tokens are counted in thousandths so that rates below one call per
+ * second work.
+ */
+struct juci_ratelimit {
+	struct list_head rules;
+	int num_rules;
+	struct avl_tree buckets;
+	unsigned long allowed;
+	unsigned long throttled;
+};
+
+void juci_ratelimit_init(struct juci_ratelimit *self);
+void juci_ratelimit_free(struct juci_ratelimit *self);
+int juci_ratelimit_add_rule(struct juci_ratelimit *self, const char *object, const char *method, enum juci_ratelimit_scope scope, double rate, uint32_t burst);
+int juci_ratelimit_parse_scope(const char *name, enum juci_ratelimit_scope *scope);
+// takes a token for the call or returns -EAGAIN and the time in ms until it can be retried
+int juci_ratelimit_check(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms, uint32_t *retry_ms);
+// like check but does not take a token, for limits that are only charged for failures
+int juci_ratelimit_peek(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms, uint32_t *retry_ms);
+// takes a token from every bucket the call falls into, even when that empties it
+void juci_ratelimit_charge(struct juci_ratelimit *self, const char *sid, const char *user, const char *object, const char *method, uint64_t now_ms);
+// drops buckets that have filled up again since they behave the same as new ones
+void juci_ratelimit_sweep(struct juci_ratelimit *self, uint64_t now_ms);
+void juci_ratelimit_to_blob(struct juci_ratelimit *self, struct blob *out);
+
+static inline bool juci_ratelimit_enabled(struct juci_ratelimit *self){
+	return self->num_rules > 0;
+}
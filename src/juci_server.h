@@ -32,6 +32,12 @@ struct ubus_server_api {
 	int 	(*send)(juci_server_t ptr, struct ubus_message **msg); 
 	int 	(*recv)(juci_server_t ptr, struct ubus_message **msg, unsigned long long timeout_us); 
 	void*	(*userdata)(juci_server_t ptr, void *data); 
+	// hot restart support: serve on an inherited listening socket, hand
+	// the listening socket over and count connections that still need to drain
+	int 	(*adopt_listener)(juci_server_t ptr, int fd, const char *path); 
+	int 	(*listener_fd)(juci_server_t ptr); 
+	void 	(*close_listener)(juci_server_t ptr); 
+	int 	(*num_clients)(juci_server_t ptr); 
 }; 
 
 #define UBUS_TARGET_PEER (0)
@@ -44,3 +50,7 @@ struct ubus_server_api {
 #define ubus_server_recv(sock, msg, timeout) (*sock)->recv(sock, msg, timeout)
 #define ubus_server_get_userdata(sock) (*sock)->userdata(sock, NULL)
 #define ubus_server_set_userdata(sock, ptr) (*sock)->userdata(sock, ptr)
+#define ubus_server_adopt_listener(sock, fd, path) (*sock)->adopt_listener(sock, fd, path)
+#define ubus_server_listener_fd(sock) (*sock)->listener_fd(sock)
+#define ubus_server_close_listener(sock) (*sock)->close_listener(sock)
+#define ubus_server_num_clients(sock) (*sock)->num_clients(sock)
@@ -36,6 +36,11 @@
 #include <limits.h>
 #include <ctype.h>
 #include <crypt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 
 #ifdef HAVE_SHADOW
 #include <shadow.h>
@@ -53,71 +58,117 @@ struct juci_session_data {
 	struct blob_field *attr;
 };
 
-struct juci_session_acl_scope {
-	struct avl_node avl;
-	struct avl_tree acls;
-};
-
-struct juci_session_acl {
-	struct avl_node avl;
-	const char *object;
-	const char *function;
-	const char *perms; 
-	int sort_len;
-};
+#define JUCI_RANDOM_POOL_SIZE 256
 
-static int _generate_sid(juci_sid_t dest){
-	unsigned char buf[16] = { 0 };
-	FILE *f;
-	int i;
-	int ret;
-
-	f = fopen("/dev/urandom", "r");
-	if (!f)
-		return -1;
+/*
+ * Random bytes for session ids are read from the kernel in blocks so that a
+ * login does not cost a file open and a syscall each time.
+ */
+static struct {
+	pthread_mutex_t lock; 
+	uint8_t buf[JUCI_RANDOM_POOL_SIZE]; 
+	size_t avail; 
+} _random_pool = { .lock = PTHREAD_MUTEX_INITIALIZER }; 
+
+static int _random_fill(uint8_t *buf, size_t size){
+	size_t got = 0; 
+#ifdef SYS_getrandom
+	while(got < size){
+		long ret = syscall(SYS_getrandom, buf + got, size - got, 0); 
+		if(ret < 0 && errno == EINTR) continue; 
+		if(ret <= 0) break; 
+		got += ret; 
+	}
+	if(got == size) return 0; 
+#endif
+	// older kernels: fall back to the device
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC); 
+	if(fd < 0) return -errno; 
+	while(got < size){
+		ssize_t ret = read(fd, buf + got, size - got); 
+		if(ret < 0 && errno == EINTR) continue; 
+		if(ret <= 0) break; 
+		got += ret; 
+	}
+	close(fd); 
+	return (got == size)?0:-EIO; 
+}
 
-	ret = fread(buf, 1, sizeof(buf), f);
-	fclose(f);
+static int _random_bytes(uint8_t *dest, size_t size){
+	int ret = 0; 
+	pthread_mutex_lock(&_random_pool.lock); 
+	if(_random_pool.avail < size){
+		ret = _random_fill(_random_pool.buf, sizeof(_random_pool.buf)); 
+		if(ret == 0) _random_pool.avail = sizeof(_random_pool.buf); 
+	}
+	if(ret == 0){
+		// take bytes from the end and wipe them so they can never be handed out twice
+		_random_pool.avail -= size; 
+		memcpy(dest, _random_pool.buf + _random_pool.avail, size); 
+		memset(_random_pool.buf + _random_pool.avail, 0, size); 
+	}
+	pthread_mutex_unlock(&_random_pool.lock); 
+	return ret; 
+}
 
-	if (ret < 0)
-		return ret;
+static void _set_sid(struct juci_session *self){
+	static const char hex[] = "0123456789abcdef"; 
+	for(int i = 0; i < sizeof(self->id); i++){
+		self->sid[i << 1] = hex[self->id[i] >> 4]; 
+		self->sid[(i << 1) + 1] = hex[self->id[i] & 0xf]; 
+	}
+	self->sid[sizeof(self->id) << 1] = 0; 
+}
 
-	for (i = 0; i < sizeof(buf); i++)
-		sprintf(dest + (i<<1), "%02x", buf[i]);
+static inline int _hex_value(char ch){
+	if(ch >= '0' && ch <= '9') return ch - '0'; 
+	if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10; 
+	if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10; 
+	return -1; 
+}
 
-	return 0;
+int juci_session_parse_sid(const char *sid, uint8_t id[JUCI_SESSION_ID_SIZE]){
+	if(!sid) return -EINVAL; 
+	for(int i = 0; i < JUCI_SESSION_ID_SIZE; i++){
+		int hi = _hex_value(sid[i << 1]); 
+		if(hi < 0) return -EINVAL; 
+		int lo = _hex_value(sid[(i << 1) + 1]); 
+		if(lo < 0) return -EINVAL; 
+		id[i] = (hi << 4) | lo; 
+	}
+	if(sid[JUCI_SESSION_ID_SIZE << 1] != 0) return -EINVAL; 
+	return 0; 
 }
 
-struct juci_session *juci_session_new(struct juci_user *user){
+struct juci_session *juci_session_new_with_id(struct juci_user *user, const uint8_t id[JUCI_SESSION_ID_SIZE]){
 	struct juci_session *self = calloc(1, sizeof(struct juci_session)); 
 	assert(self); 
 	
-	_generate_sid(self->sid); 
+	memcpy(self->id, id, sizeof(self->id)); 
+	_set_sid(self); 
 
-	self->avl.key = self->sid; 
-
-	avl_init(&self->acl_scopes, avl_strcmp, false, NULL);
 	avl_init(&self->data, avl_strcmp, false, NULL);
+	INIT_LIST_HEAD(&self->timer.list);
 
-	self->user = user; 
+	self->user = juci_user_ref(user); 
 
 	return self; 
 }
 
+struct juci_session *juci_session_new(struct juci_user *user){
+	uint8_t id[JUCI_SESSION_ID_SIZE]; 
+	if(_random_bytes(id, sizeof(id)) < 0) return NULL; 
+	return juci_session_new_with_id(user, id); 
+}
+
 void juci_session_delete(struct juci_session **_self){
 	assert(*_self); 
 	struct juci_session *self = *_self; 
-	struct juci_session_acl *acl, *nacl;
-    struct juci_session_acl_scope *acl_scope, *nacl_scope;
     struct juci_session_data *data, *ndata;
 
-    avl_for_each_element_safe(&self->acl_scopes, acl_scope, avl, nacl_scope) {
-        avl_remove_all_elements(&acl_scope->acls, acl, avl, nacl)
-            free(acl);
-
-        avl_delete(&self->acl_scopes, &acl_scope->avl);
-        free(acl_scope);
-    }
+	juci_user_unref(&self->user);
+	if(self->role) juci_acl_set_unref(&self->role);
+	if(self->overlay) juci_acl_set_unref(&self->overlay);
 
     avl_remove_all_elements(&self->data, data, avl, ndata)
         free(data);
@@ -126,176 +177,63 @@ void juci_session_delete(struct juci_session **_self){
 	*_self = NULL; 
 }
 
-/*
- * Keys in the AVL tree contain all pattern characters up to the first wildcard.
- * To look up entries, start with the last entry that has a key less than or
- * equal to the method name, then work backwards as long as the AVL key still
- * matches its counterpart in the object name
- */
-#define uh_foreach_matching_acl_prefix(_acl, _avl, _obj, _func)     \
-    for (_acl = avl_find_le_element(_avl, _obj, _acl, avl);         \
-         _acl;                                                      \
-         _acl = avl_is_first(_avl, &(_acl)->avl) ? NULL :           \
-            avl_prev_element((_acl), avl))
-
-#define uh_foreach_matching_acl(_acl, _avl, _obj, _func)            \
-    uh_foreach_matching_acl_prefix(_acl, _avl, _obj, _func)         \
-        if (!strncmp((_acl)->object, _obj, (_acl)->sort_len) &&     \
-            !fnmatch((_acl)->object, (_obj), FNM_NOESCAPE) &&       \
-            !fnmatch((_acl)->function, (_func), FNM_NOESCAPE))
+void juci_session_set_role(struct juci_session *ses, struct juci_acl_set *role){
+	if(ses->role) juci_acl_set_unref(&ses->role);
+	ses->role = juci_acl_set_ref(role);
+	ses->acl_generation++;
+}
 
+static struct juci_acl_set *_overlay(struct juci_session *ses){
+	if(!ses->overlay) ses->overlay = juci_acl_set_new(ses->sid);
+	ses->acl_generation++;
+	return ses->overlay;
+}
 
 int juci_session_grant(struct juci_session *ses, const char *scope, const char *object, const char *function, const char *perm){
-    struct juci_session_acl *acl;
-    struct juci_session_acl_scope *acl_scope;
-    char *new_scope, *new_obj, *new_func, *new_id, *new_perms;
-    int id_len;
-
-    if (!object || !function)
-        return -EINVAL;
-
-    acl_scope = avl_find_element(&ses->acl_scopes, scope, acl_scope, avl);
-
-    if (acl_scope) {
-        uh_foreach_matching_acl_prefix(acl, &acl_scope->acls, object, function) {
-            if (!strcmp(acl->object, object) &&
-                !strcmp(acl->function, function))
-                return 0;
-        }
-    }
-
-    if (!acl_scope) {
-        acl_scope = calloc_a(sizeof(*acl_scope),
-                             &new_scope, strlen(scope) + 1);
-		
-        if (!acl_scope)
-            return -1;
-
-        acl_scope->avl.key = strcpy(new_scope, scope);
-        avl_init(&acl_scope->acls, avl_strcmp, true, NULL);
-        avl_insert(&ses->acl_scopes, &acl_scope->avl);
-    }
-
-    id_len = strcspn(object, "*?[");
-    acl = calloc_a(sizeof(*acl),
-        &new_obj, strlen(object) + 1,
-        &new_func, strlen(function) + 1,
-        &new_id, id_len + 1, 
-		&new_perms, strlen(perm) + 1);
-
-    if (!acl)
-        return -1;
-
-    acl->object = strcpy(new_obj, object);
-    acl->function = strcpy(new_func, function);
-	acl->perms = strcpy(new_perms, perm);  
-    acl->avl.key = strncpy(new_id, object, id_len);
-    avl_insert(&acl_scope->acls, &acl->avl);
-
-    return 0;
+	if (!object || !function || !perm)
+		return -EINVAL;
+	return juci_acl_set_grant(_overlay(ses), scope, object, function, perm);
 }
 
-int juci_session_revoke(struct juci_session *ses,
-                   const char *scope, const char *object, const char *function, const char *perm){
-    struct juci_session_acl *acl, *next;
-    struct juci_session_acl_scope *acl_scope;
-    int id_len;
-    char *id;
-
-    acl_scope = avl_find_element(&ses->acl_scopes, scope, acl_scope, avl);
-
-    if (!acl_scope)
-        return 0;
-
-    if (!object && !function) {
-        avl_remove_all_elements(&acl_scope->acls, acl, avl, next)
-            free(acl);
-        avl_delete(&ses->acl_scopes, &acl_scope->avl);
-        free(acl_scope);
-        return 0;
-    }
-
-    id_len = strcspn(object, "*?[");
-    id = alloca(id_len + 1);
-	assert(id); 
-    strncpy(id, object, id_len);
-    id[id_len] = 0;
-
-    acl = avl_find_element(&acl_scope->acls, id, acl, avl);
-    while (acl) {
-        if (!avl_is_last(&acl_scope->acls, &acl->avl))
-            next = avl_next_element(acl, avl);
-        else
-            next = NULL;
-
-        if (strcmp(id, acl->avl.key) != 0)
-            break;
-
-        if (!strcmp(acl->object, object) &&
-            !strcmp(acl->function, function)) {
-            avl_delete(&acl_scope->acls, &acl->avl);
-            free(acl);
-        }
-        acl = next;
-    }
-
-    if (avl_is_empty(&acl_scope->acls)) {
-        avl_delete(&ses->acl_scopes, &acl_scope->avl);
-        free(acl_scope);
-    }
-
-    return 0;
+int juci_session_revoke(struct juci_session *ses, const char *scope, const char *object, const char *function, const char *perm){
+	struct juci_acl_set *overlay = _overlay(ses);
+
+	// the role is shared so revoking is done by masking it with a deny entry
+	if (!object && !function) {
+		juci_acl_set_revoke(overlay, scope, NULL, NULL);
+		return juci_acl_set_grant(overlay, scope, "*", "*", NULL);
+	}
+	return juci_acl_set_grant(overlay, scope, object, function, NULL);
 }
 
 bool juci_session_access(struct juci_session *ses, const char *scope, const char *obj, const char *fun, const char *perm){
-	struct juci_session_acl *acl;
-	struct juci_session_acl_scope *acl_scope;
-
-	acl_scope = avl_find_element(&ses->acl_scopes, scope, acl_scope, avl);
-
-	if (acl_scope) {
-		uh_foreach_matching_acl(acl, &acl_scope->acls, obj, fun){
-			// check each character in perms and see if it is allowed
-			// if no perms are specified then this will always return true
-			for(int c = 0; c < strlen(perm); c++){
-				bool found = false; 
-				for(int j = 0; j < strlen(acl->perms); j++) {
-					if(perm[c] == acl->perms[j]) { 
-						found = true; 
-						break; 
-					}
-				}
-				if(!found) return false; 
-			}
-			return true;
-		}
-	}
+	bool allowed = false;
+	int ret = -1;
+
+	if(juci_acl_cache_lookup(&ses->acl_cache, ses->acl_generation, scope, obj, fun, perm, &allowed))
+		return allowed;
+
+	// session specific entries take precedence over the role
+	if(ses->overlay) ret = juci_acl_set_match(ses->overlay, scope, obj, fun, perm);
+	if(ret < 0 && ses->role) ret = juci_acl_set_match(ses->role, scope, obj, fun, perm);
+	allowed = (ret == 1);
 
-	return false;
+	juci_acl_cache_store(&ses->acl_cache, ses->acl_generation, scope, obj, fun, perm, allowed);
+	return allowed;
 }
 
 void juci_session_to_blob(struct juci_session *self, struct blob *buf){
-	struct juci_session_acl *acl;
-    struct juci_session_acl_scope *acl_scope;
-	
 	blob_reset(buf); 
 	blob_offset_t r = blob_open_table(buf); 
-    avl_for_each_element(&self->acl_scopes, acl_scope, avl) {
-		blob_put_string(buf, acl_scope->avl.key); 
-		blob_offset_t s = blob_open_table(buf); 
-        avl_for_each_element(&acl_scope->acls, acl, avl){
-			blob_put_string(buf, acl->avl.key); 
-			blob_offset_t a = blob_open_table(buf); 
-			blob_put_string(buf, "object"); 
-			blob_put_string(buf, acl->object); 	
-			blob_put_string(buf, "method"); 
-			blob_put_string(buf, acl->function); 	
-			blob_put_string(buf, "perms"); 
-			blob_put_string(buf, acl->perms); 	
-			blob_close_table(buf, a); 
-		}
-		blob_close_table(buf, s); 
-    }
+	if(self->role){
+		blob_put_string(buf, "role"); 
+		blob_put_string(buf, self->role->name); 
+		blob_put_string(buf, "acls"); 
+		juci_acl_set_to_blob(self->role, buf); 
+	}
+	if(self->overlay){
+		blob_put_string(buf, "session_acls"); 
+		juci_acl_set_to_blob(self->overlay, buf); 
+	}
 	blob_close_table(buf, r); 
 }
-
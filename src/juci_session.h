@@ -1,24 +1,67 @@
 #pragma once
 
+#define JUCI_SESSION_ID_SIZE 16
+
 // 1 extra byte for trailing zero
-typedef char juci_sid_t[32 + 1]; 
+typedef char juci_sid_t[JUCI_SESSION_ID_SIZE * 2 + 1]; 
 
+#include <stdint.h>
 #include <libutype/avl.h>
+#include <blobpack/blobpack.h>
 #include "juci_user.h"
+#include "juci_acl.h"
+#include "juci_acl_set.h"
+#include "juci_timer.h"
 
 struct juci_session {
-	struct avl_node avl; 
+	// binary id is the lookup key, sid is its hex form used on the wire
+	uint8_t id[JUCI_SESSION_ID_SIZE]; 
 	juci_sid_t sid; 
+	// session store linkage (see juci_session_store.h)
+	struct juci_session *hash_next; 
+	struct juci_session *retire_next; 
+	uint64_t retire_epoch; 
+
+	// monotonic seconds. last_access is only stored on access and checked
+	// when the expiry timer fires. It is read by snapshots taken outside the
+	// dispatch thread so always go through juci_session_touch() and
+	// juci_session_last_access().
+	uint64_t created; 
+	uint64_t last_access; 
+	struct juci_timer timer; 
+
 	struct avl_tree data; 
-	struct avl_tree acl_scopes; 
+	// acls shared by all sessions of the same role and the grants and
+	// revokes that were made on this session only
+	struct juci_acl_set *role; 
+	struct juci_acl_set *overlay; 
+	// bumped on every acl change so that cached decisions become stale
+	uint32_t acl_generation; 
+	// not synchronized: the cache, the lazily compiled acl sets and the
+	// session data belong to the single thread that dispatches calls. 
+	struct juci_acl_cache acl_cache; 
 	
 	struct juci_user *user; 
 }; 
 
 struct juci_session *juci_session_new(struct juci_user *user); 
+// creates a session with a known id (used when restoring saved sessions)
+struct juci_session *juci_session_new_with_id(struct juci_user *user, const uint8_t id[JUCI_SESSION_ID_SIZE]); 
 void juci_session_delete(struct juci_session **self); 
+// converts a hex session id into binary form. Returns -EINVAL if sid is not a valid id. 
+int juci_session_parse_sid(const char *sid, uint8_t id[JUCI_SESSION_ID_SIZE]); 
 int juci_session_grant(struct juci_session *self, const char *scope, const char *object, const char *method, const char *perm); 
 int juci_session_revoke(struct juci_session *self, const char *scope, const char *object, const char *method, const char *perm); 
+void juci_session_set_role(struct juci_session *self, struct juci_acl_set *role); 
+// fills the acl cache so it may only be called from the dispatch thread
 bool juci_session_access(struct juci_session *ses, const char *scope, const char *obj, const char *fun, const char *perm); 
 
+static inline void juci_session_touch(struct juci_session *self, uint64_t now){
+	__atomic_store_n(&self->last_access, now, __ATOMIC_RELAXED); 
+}
+
+static inline uint64_t juci_session_last_access(struct juci_session *self){
+	return __atomic_load_n(&self->last_access, __ATOMIC_RELAXED); 
+}
+
 void juci_session_to_blob(struct juci_session *self, struct blob *buf); 
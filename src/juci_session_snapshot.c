@@ -0,0 +1,187 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+#include "juci_session_store.h"
+#include "juci_session_snapshot.h"
+#include "juci_private_file.h"
+
+struct _strings {
+	char *buf;
+	uint32_t size;
+	uint32_t cap;
+};
+
+// user and role names repeat a lot so every distinct string is stored once
+static uint32_t _strings_add(struct _strings *self, const char *str){
+	size_t len = strlen(str) + 1;
+	for(uint32_t off = 0; off < self->size; off += strlen(self->buf + off) + 1){
+		if(!strcmp(self->buf + off, str)) return off;
+	}
+	if(self->size + len > self->cap){
+		uint32_t cap = (self->cap)?self->cap * 2:256;
+		while(cap < self->size + len) cap *= 2;
+		char *buf = realloc(self->buf, cap);
+		assert(buf);
+		self->buf = buf;
+		self->cap = cap;
+	}
+	memcpy(self->buf + self->size, str, len);
+	self->size += len;
+	return self->size - len;
+}
+
+static int _write_all(int fd, const void *data, size_t size){
+	const char *ptr = data;
+	while(size){
+		ssize_t ret = write(fd, ptr, size);
+		if(ret < 0 && errno == EINTR) continue;
+		if(ret <= 0) return -EIO;
+		ptr += ret;
+		size -= ret;
+	}
+	return 0;
+}
+
+static int64_t _boottime(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+	return ts.tv_sec;
+}
+
+static void _boot_id(char id[40]){
+	memset(id, 0, 40);
+	int fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return;
+	ssize_t len = read(fd, id, 39);
+	close(fd);
+	if(len > 0 && id[len - 1] == '\n') id[len - 1] = 0;
+}
+
+int juci_session_snapshot_write(int fd, struct juci_session_store *store, uint64_t now){
+	struct juci_session_snapshot_header hdr = {
+		.magic = JUCI_SESSION_SNAPSHOT_MAGIC,
+		.record_size = sizeof(struct juci_session_snapshot_record),
+		.saved_at = _boottime()
+	};
+	_boot_id(hdr.boot_id);
+	struct _strings strings = {0};
+	struct juci_session_snapshot_record *records = calloc(juci_session_store_count(store) + 1, sizeof(*records));
+	assert(records);
+
+	struct juci_session *ses;
+	int shard, bucket;
+	uint32_t max = juci_session_store_count(store);
+	juci_session_store_for_each(store, shard, bucket, ses){
+		if(hdr.count == max) break;
+		// session specific grants and revokes are not saved so neither are sessions that have them
+		if(!ses->role || ses->overlay) continue;
+		struct juci_session_snapshot_record *r = &records[hdr.count++];
+		memcpy(r->id, ses->id, sizeof(r->id));
+		r->user = _strings_add(&strings, ses->user->username);
+		r->role = _strings_add(&strings, ses->role->name);
+		r->age = (now > ses->created)?now - ses->created:0;
+		uint64_t last_access = juci_session_last_access(ses); 
+		r->idle = (now > last_access)?now - last_access:0;
+	}
+	hdr.strings_size = strings.size;
+
+	int ret = _write_all(fd, &hdr, sizeof(hdr));
+	if(!ret) ret = _write_all(fd, records, hdr.count * sizeof(*records));
+	if(!ret) ret = _write_all(fd, strings.buf, strings.size);
+
+	free(records);
+	free(strings.buf);
+	return ret;
+}
+
+int juci_session_snapshot_save(const char *path, struct juci_session_store *store, uint64_t now){
+	size_t len = strlen(path) + 16;
+	char *tmp = alloca(len);
+
+	// the file contains live session ids so only we may read it
+	int fd = juci_private_file_create(path, tmp, len);
+	if(fd < 0) return fd;
+	int ret = juci_session_snapshot_write(fd, store, now);
+	if(close(fd) != 0 && !ret) ret = -EIO;
+	if(!ret && rename(tmp, path) != 0) ret = -errno;
+	if(ret) unlink(tmp);
+	return ret;
+}
+
+int juci_session_snapshot_open_fd(struct juci_session_snapshot *self, int fd){
+	struct stat st;
+	memset(self, 0, sizeof(*self));
+	if(fstat(fd, &st) != 0) return -errno;
+	if(st.st_size < sizeof(struct juci_session_snapshot_header)) return -EINVAL;
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED) return -errno;
+
+	const struct juci_session_snapshot_header *hdr = map;
+	if(memcmp(hdr->magic, JUCI_SESSION_SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+		hdr->record_size != sizeof(struct juci_session_snapshot_record) ||
+		sizeof(*hdr) + (uint64_t)hdr->count * hdr->record_size + hdr->strings_size != (uint64_t)st.st_size){
+		munmap(map, st.st_size);
+		return -EINVAL;
+	}
+
+	self->map = map;
+	self->size = st.st_size;
+	self->header = hdr;
+	self->records = (const void*)((const char*)map + sizeof(*hdr));
+	self->strings = (const char*)(self->records + hdr->count);
+	return 0;
+}
+
+int juci_session_snapshot_open(struct juci_session_snapshot *self, const char *path){
+	int fd = juci_private_file_open(path);
+	if(fd < 0) return fd;
+	int ret = juci_session_snapshot_open_fd(self, fd);
+	close(fd);
+	return ret;
+}
+
+int64_t juci_session_snapshot_age(struct juci_session_snapshot *self){
+	char boot_id[40];
+	_boot_id(boot_id);
+	if(memcmp(boot_id, self->header->boot_id, sizeof(boot_id))) return -1;
+	int64_t age = _boottime() - self->header->saved_at;
+	return (age > 0)?age:0;
+}
+
+void juci_session_snapshot_close(struct juci_session_snapshot *self){
+	if(self->map) munmap(self->map, self->size);
+	memset(self, 0, sizeof(*self));
+}
+
+const char *juci_session_snapshot_string(struct juci_session_snapshot *self, uint32_t offset){
+	if(offset >= self->header->strings_size) return NULL;
+	// the string must be terminated inside the table
+	if(!memchr(self->strings + offset, 0, self->header->strings_size - offset)) return NULL;
+	return self->strings + offset;
+}
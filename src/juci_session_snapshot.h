@@ -0,0 +1,71 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "juci_session.h"
+
+#define JUCI_SESSION_SNAPSHOT_MAGIC "JSS2"
+
+/*
+ * Saved sessions are stored as a header, an array of fixed size records and
+ * a table of zero terminated strings that records refer to by offset. The
+ * file is read by mapping it so loading does not copy or parse anything but
+ * the records that are actually restored. All values are in host byte order
+ * since the file never leaves the machine.
+ */
+struct juci_session_snapshot_header {
+	char magic[4];
+	uint32_t count;
+	uint32_t record_size;
+	uint32_t strings_size;
+	int64_t saved_at; // CLOCK_BOOTTIME seconds of the save, which unlike the wall clock never jumps
+	char boot_id[40]; // kernel boot id of the save, saved_at means nothing after a reboot
+};
+
+struct juci_session_snapshot_record {
+	uint8_t id[JUCI_SESSION_ID_SIZE];
+	uint32_t user; // string offset of the user name
+	uint32_t role; // string offset of the role (acl list) name
+	uint32_t age; // seconds since login
+	uint32_t idle; // seconds since last access
+};
+
+struct juci_session_snapshot {
+	void *map;
+	size_t size;
+	const struct juci_session_snapshot_header *header;
+	const struct juci_session_snapshot_record *records;
+	const char *strings;
+};
+
+// writes all sessions of the store to fd. now is the current monotonic time in seconds.
+int juci_session_snapshot_write(int fd, struct juci_session_store *store, uint64_t now);
+// writes the snapshot to a temporary file and renames it over path
+int juci_session_snapshot_save(const char *path, struct juci_session_store *store, uint64_t now);
+
+int juci_session_snapshot_open_fd(struct juci_session_snapshot *self, int fd);
+// opens a saved snapshot, which must be a private file (see juci_private_file.h)
+int juci_session_snapshot_open(struct juci_session_snapshot *self, const char *path);
+// seconds since the snapshot was written or -1 if the system has rebooted since then
+int64_t juci_session_snapshot_age(struct juci_session_snapshot *self);
+void juci_session_snapshot_close(struct juci_session_snapshot *self);
+// returns NULL if the offset does not point to a valid string
+const char *juci_session_snapshot_string(struct juci_session_snapshot *self, uint32_t offset);
@@ -0,0 +1,184 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "internal.h"
+#include "juci_session_store.h"
+
+// session ids are random so any 32 bits of them make a good hash
+static inline uint32_t _hash(const uint8_t *id){
+	uint32_t h;
+	memcpy(&h, id, sizeof(h));
+	return h;
+}
+
+static inline struct juci_session_store_shard *_shard(struct juci_session_store *self, uint32_t hash){
+	return &self->shards[hash % JUCI_SESSION_STORE_SHARDS];
+}
+
+static inline struct juci_session **_bucket(struct juci_session_store_shard *shard, uint32_t hash){
+	return &shard->buckets[(hash / JUCI_SESSION_STORE_SHARDS) % JUCI_SESSION_STORE_BUCKETS];
+}
+
+void juci_session_store_init(struct juci_session_store *self){
+	memset(self, 0, sizeof(*self));
+	for(int c = 0; c < JUCI_SESSION_STORE_SHARDS; c++){
+		pthread_mutex_init(&self->shards[c].lock, NULL);
+	}
+	pthread_mutex_init(&self->retire_lock, NULL);
+	self->epoch = 1;
+}
+
+void juci_session_store_free(struct juci_session_store *self){
+	struct juci_session *ses, *next;
+	for(int c = 0; c < JUCI_SESSION_STORE_SHARDS; c++){
+		struct juci_session_store_shard *shard = &self->shards[c];
+		for(int b = 0; b < JUCI_SESSION_STORE_BUCKETS; b++){
+			for(ses = shard->buckets[b]; ses; ses = next){
+				next = ses->hash_next;
+				juci_session_delete(&ses);
+			}
+			shard->buckets[b] = NULL;
+		}
+		shard->count = 0;
+		pthread_mutex_destroy(&shard->lock);
+	}
+	for(ses = self->retired; ses; ses = next){
+		next = ses->retire_next;
+		juci_session_delete(&ses);
+	}
+	self->retired = NULL;
+	pthread_mutex_destroy(&self->retire_lock);
+}
+
+int juci_session_store_insert(struct juci_session_store *self, struct juci_session *ses){
+	uint32_t hash = _hash(ses->id);
+	struct juci_session_store_shard *shard = _shard(self, hash);
+	struct juci_session **bucket = _bucket(shard, hash);
+
+	pthread_mutex_lock(&shard->lock);
+	for(struct juci_session *s = *bucket; s; s = s->hash_next){
+		if(!memcmp(s->id, ses->id, sizeof(ses->id))){
+			pthread_mutex_unlock(&shard->lock);
+			return -EEXIST;
+		}
+	}
+	ses->hash_next = *bucket;
+	// publish the fully initialized session to lockless readers
+	__atomic_store_n(bucket, ses, __ATOMIC_RELEASE);
+	shard->count++;
+	pthread_mutex_unlock(&shard->lock);
+	return 0;
+}
+
+int juci_session_store_remove(struct juci_session_store *self, const uint8_t *id){
+	uint32_t hash = _hash(id);
+	struct juci_session_store_shard *shard = _shard(self, hash);
+	struct juci_session **prev = _bucket(shard, hash);
+
+	pthread_mutex_lock(&shard->lock);
+	for(struct juci_session *s = *prev; s; prev = &s->hash_next, s = s->hash_next){
+		if(memcmp(s->id, id, sizeof(s->id))) continue;
+
+		// readers that are already on the removed node can still follow its next pointer
+		__atomic_store_n(prev, s->hash_next, __ATOMIC_RELEASE);
+		shard->count--;
+		pthread_mutex_unlock(&shard->lock);
+
+		pthread_mutex_lock(&self->retire_lock);
+		s->retire_epoch = __atomic_add_fetch(&self->epoch, 1, __ATOMIC_ACQ_REL);
+		s->retire_next = self->retired;
+		self->retired = s;
+		pthread_mutex_unlock(&self->retire_lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&shard->lock);
+	return -ENOENT;
+}
+
+struct juci_session *juci_session_store_find(struct juci_session_store *self, const uint8_t *id){
+	uint32_t hash = _hash(id);
+	struct juci_session_store_shard *shard = _shard(self, hash);
+	struct juci_session **bucket = _bucket(shard, hash);
+
+	for(struct juci_session *s = __atomic_load_n(bucket, __ATOMIC_ACQUIRE); s; s = __atomic_load_n(&s->hash_next, __ATOMIC_ACQUIRE)){
+		if(!memcmp(s->id, id, sizeof(s->id))) return s;
+	}
+	return NULL;
+}
+
+uint32_t juci_session_store_count(struct juci_session_store *self){
+	uint32_t count = 0;
+	for(int c = 0; c < JUCI_SESSION_STORE_SHARDS; c++){
+		count += __atomic_load_n(&self->shards[c].count, __ATOMIC_RELAXED);
+	}
+	return count;
+}
+
+int juci_session_store_reader_register(struct juci_session_store *self){
+	pthread_mutex_lock(&self->retire_lock);
+	for(int c = 0; c < JUCI_SESSION_STORE_MAX_READERS; c++){
+		if(self->readers[c] == 0){
+			__atomic_store_n(&self->readers[c], __atomic_load_n(&self->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+			pthread_mutex_unlock(&self->retire_lock);
+			return c;
+		}
+	}
+	pthread_mutex_unlock(&self->retire_lock);
+	return -EBUSY;
+}
+
+void juci_session_store_reader_unregister(struct juci_session_store *self, int reader){
+	__atomic_store_n(&self->readers[reader], 0, __ATOMIC_RELEASE);
+}
+
+void juci_session_store_quiescent(struct juci_session_store *self, int reader){
+	__atomic_store_n(&self->readers[reader], __atomic_load_n(&self->epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+	if(!__atomic_load_n(&self->retired, __ATOMIC_RELAXED)) return;
+
+	// sessions retired at or before the oldest epoch seen by all readers are unreachable
+	uint64_t min = UINT64_MAX;
+	for(int c = 0; c < JUCI_SESSION_STORE_MAX_READERS; c++){
+		uint64_t e = __atomic_load_n(&self->readers[c], __ATOMIC_ACQUIRE);
+		if(e && e < min) min = e;
+	}
+
+	struct juci_session *free_list = NULL;
+	pthread_mutex_lock(&self->retire_lock);
+	struct juci_session **prev = &self->retired;
+	while(*prev){
+		struct juci_session *s = *prev;
+		if(s->retire_epoch <= min){
+			*prev = s->retire_next;
+			s->retire_next = free_list;
+			free_list = s;
+		} else {
+			prev = &s->retire_next;
+		}
+	}
+	pthread_mutex_unlock(&self->retire_lock);
+
+	while(free_list){
+		struct juci_session *s = free_list;
+		free_list = s->retire_next;
+		juci_session_delete(&s);
+	}
+}
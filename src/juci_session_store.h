@@ -0,0 +1,74 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "juci_session.h"
+
+#define JUCI_SESSION_STORE_SHARDS 16
+#define JUCI_SESSION_STORE_BUCKETS 256 // per shard
+#define JUCI_SESSION_STORE_MAX_READERS 8
+
+struct juci_session_store_shard {
+	// writers of a shard are serialized. Readers never take the lock.
+	pthread_mutex_t lock;
+	struct juci_session *buckets[JUCI_SESSION_STORE_BUCKETS];
+	uint32_t count;
+};
+
+/*
+ * Session table keyed by the binary session id. Lookups walk the hash chains
+ * without locking (chains are only changed with atomic pointer stores) and
+ * removed sessions are not freed until every registered reader has passed a
+ * quiescent point, so a session returned by a lookup stays valid until the
+ * reader that found it calls juci_session_store_quiescent(). Only the lookup
+ * and the lifetime are safe across threads: everything else in a session
+ * (acl cache, data, grants) may only be touched by the one thread that
+ * dispatches calls, other readers just look at last_access.
+ */
+struct juci_session_store {
+	struct juci_session_store_shard shards[JUCI_SESSION_STORE_SHARDS];
+
+	pthread_mutex_t retire_lock;
+	struct juci_session *retired;
+	uint64_t epoch;
+	// epoch each reader last saw. Zero means the slot is not in use.
+	uint64_t readers[JUCI_SESSION_STORE_MAX_READERS];
+};
+
+void juci_session_store_init(struct juci_session_store *self);
+// deletes all sessions. No readers may be active.
+void juci_session_store_free(struct juci_session_store *self);
+
+int juci_session_store_insert(struct juci_session_store *self, struct juci_session *ses);
+// unlinks the session and deletes it once no reader can reference it anymore
+int juci_session_store_remove(struct juci_session_store *self, const uint8_t *id);
+struct juci_session *juci_session_store_find(struct juci_session_store *self, const uint8_t *id);
+uint32_t juci_session_store_count(struct juci_session_store *self);
+
+int juci_session_store_reader_register(struct juci_session_store *self);
+void juci_session_store_reader_unregister(struct juci_session_store *self, int reader);
+// marks that the reader holds no session pointers and frees what can be freed
+void juci_session_store_quiescent(struct juci_session_store *self, int reader);
+
+#define juci_session_store_for_each(store, shard, bucket, ses) \
+	for(shard = 0; shard < JUCI_SESSION_STORE_SHARDS; shard++) \
+		for(bucket = 0; bucket < JUCI_SESSION_STORE_BUCKETS; bucket++) \
+			for(ses = (store)->shards[shard].buckets[bucket]; ses; ses = ses->hash_next)
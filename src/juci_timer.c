@@ -0,0 +1,61 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include "juci_timer.h"
+
+static inline struct list_head *_slot(struct juci_timer_wheel *self, uint64_t tick){
+	return &self->slots[tick & (JUCI_TIMER_WHEEL_SLOTS - 1)];
+}
+
+void juci_timer_wheel_init(struct juci_timer_wheel *self, uint64_t now){
+	for(int c = 0; c < JUCI_TIMER_WHEEL_SLOTS; c++) INIT_LIST_HEAD(&self->slots[c]);
+	self->now = now;
+	self->count = 0;
+}
+
+void juci_timer_wheel_add(struct juci_timer_wheel *self, struct juci_timer *timer, uint64_t expires){
+	// timers that are already due fire on the next tick
+	if(expires <= self->now) expires = self->now + 1;
+	timer->expires = expires;
+	list_add_tail(&timer->list, _slot(self, expires));
+	self->count++;
+}
+
+void juci_timer_wheel_del(struct juci_timer_wheel *self, struct juci_timer *timer){
+	list_del_init(&timer->list);
+	self->count--;
+}
+
+static void _expire_slot(struct juci_timer_wheel *self, struct list_head *slot, uint64_t now, struct list_head *expired){
+	struct juci_timer *timer, *ntimer;
+	list_for_each_entry_safe(timer, ntimer, slot, list){
+		if(timer->expires > now) continue;
+		list_move_tail(&timer->list, expired);
+		self->count--;
+	}
+}
+
+void juci_timer_wheel_advance(struct juci_timer_wheel *self, uint64_t now, struct list_head *expired){
+	if(now <= self->now) return;
+	// after a long stall every slot has to be looked at once anyway
+	if(now - self->now >= JUCI_TIMER_WHEEL_SLOTS){
+		for(int c = 0; c < JUCI_TIMER_WHEEL_SLOTS; c++) _expire_slot(self, &self->slots[c], now, expired);
+	} else {
+		for(uint64_t tick = self->now + 1; tick <= now; tick++) _expire_slot(self, _slot(self, tick), now, expired);
+	}
+	self->now = now;
+}
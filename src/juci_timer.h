@@ -0,0 +1,47 @@
+/*
+	JUCI Backend Websocket API Server
+
+	Copyright (C) 2016 Martin K. Schröder <mkschreder.uk@gmail.com>
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version. (Please read LICENSE file on special
+	permission to include this software in signed images).
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <libutype/list.h>
+
+#define JUCI_TIMER_WHEEL_SLOTS 512 // must be a power of two
+
+struct juci_timer {
+	struct list_head list;
+	uint64_t expires; // in wheel ticks
+};
+
+/*
+ * Hashed timer wheel. A timer lives in the slot of its expiry tick modulo the
+ * number of slots, so adding and removing a timer is O(1) and advancing the
+ * wheel by one tick only looks at the timers of one slot. Timers that are
+ * more than one revolution away are simply passed over until their round
+ * comes.
+ */
+struct juci_timer_wheel {
+	struct list_head slots[JUCI_TIMER_WHEEL_SLOTS];
+	uint64_t now;
+	uint32_t count;
+};
+
+void juci_timer_wheel_init(struct juci_timer_wheel *self, uint64_t now);
+void juci_timer_wheel_add(struct juci_timer_wheel *self, struct juci_timer *timer, uint64_t expires);
+void juci_timer_wheel_del(struct juci_timer_wheel *self, struct juci_timer *timer);
+// advances the wheel to now and moves all timers that are due onto the expired list
+void juci_timer_wheel_advance(struct juci_timer_wheel *self, uint64_t now, struct list_head *expired);
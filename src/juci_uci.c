@@ -4,7 +4,50 @@
 #error "You need libuci installed to build this file!"
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
 #include <blobpack/blobpack.h>
+#include <libutype/avl.h>
+#include <libutype/avl-cmp.h>
+
+#include "internal.h"
+#include "juci_uci.h"
+
+#ifndef UCI_CONFDIR
+#define UCI_CONFDIR "/etc/config"
+#endif
+#ifndef UCI_SAVEDIR
+#define UCI_SAVEDIR "/tmp/.uci"
+#endif
+
+struct juci_uci_config {
+	struct avl_node avl; 
+	// sections by name or empty when the config does not exist
+	struct blob data; 
+	bool exists; 
+	char name[]; 
+}; 
+
+/*
+ * Parsed configs are kept until inotify reports a change to their file in
+ * the config directory or to their uncommitted changes in the save
+ * directory. Lua runs on the main thread only so this needs no locking. 
+ */
+static struct {
+	struct uci_context *ctx; 
+	struct avl_tree configs; 
+	int fd; 
+	int confdir_wd; 
+	int savedir_wd; 
+	bool initialized; 
+	unsigned long hits; 
+	unsigned long loads; 
+} _cache = { .fd = -1, .confdir_wd = -1, .savedir_wd = -1 }; 
 
 static void _uci_option_to_blob(struct uci_option *o, struct blob *buf){
 	struct uci_element *e;
@@ -60,6 +103,7 @@ static void _uci_config_to_blob(struct uci_package *p, struct blob *buf){
 	blob_offset_t c = blob_open_table(buf);
 
 	uci_foreach_element(&p->sections, e){
+		blob_put_string(buf, e->name); 
 		_uci_section_to_blob(uci_to_section(e), e->name, i, buf);
 		i++;
 	}
@@ -67,18 +111,114 @@ static void _uci_config_to_blob(struct uci_package *p, struct blob *buf){
 	blob_close_table(buf, c);
 }
 
-int juci_uci_load_config(const char *config, struct blob *buf){
+static void _cache_drop(struct juci_uci_config *conf){
+	avl_delete(&_cache.configs, &conf->avl); 
+	blob_free(&conf->data); 
+	free(conf); 
+}
+
+static void _cache_drop_all(void){
+	struct juci_uci_config *conf, *nconf; 
+	avl_remove_all_elements(&_cache.configs, conf, avl, nconf){
+		blob_free(&conf->data); 
+		free(conf); 
+	}
+}
+
+// the save directory only exists once something has been changed without a commit
+static void _watch_savedir(void){
+	struct stat st; 
+	if(_cache.savedir_wd >= 0 || stat(UCI_SAVEDIR, &st) != 0) return; 
+	_cache.savedir_wd = inotify_add_watch(_cache.fd, UCI_SAVEDIR, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF); 
+	// changes made before the watch was there are not known
+	if(_cache.savedir_wd >= 0) _cache_drop_all(); 
+}
+
+static void _cache_init(void){
+	_cache.initialized = true; 
+	avl_init(&_cache.configs, avl_strcmp, false, NULL); 
+	_cache.ctx = uci_alloc_context(); 
+	_cache.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); 
+	if(_cache.fd < 0){
+		ERROR("uci: no inotify (%s), configs will not be cached\n", strerror(errno)); 
+		return; 
+	}
+	_cache.confdir_wd = inotify_add_watch(_cache.fd, UCI_CONFDIR, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE); 
+	if(_cache.confdir_wd < 0){
+		ERROR("uci: can not watch %s (%s), configs will not be cached\n", UCI_CONFDIR, strerror(errno)); 
+		close(_cache.fd); 
+		_cache.fd = -1; 
+	}
+}
+
+// drops the configs whose files have changed since the last call
+static void _cache_update(void){
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event)))); 
+	ssize_t len; 
+
+	if(!_cache.initialized) _cache_init(); 
+	if(_cache.fd < 0){
+		_cache_drop_all(); 
+		return; 
+	}
+	while((len = read(_cache.fd, buf, sizeof(buf))) > 0){
+		for(char *ptr = buf; ptr < buf + len; ){
+			struct inotify_event *ev = (struct inotify_event*)ptr; 
+			ptr += sizeof(struct inotify_event) + ev->len; 
+			if(ev->mask & IN_Q_OVERFLOW){
+				_cache_drop_all(); 
+				continue; 
+			}
+			if(ev->wd == _cache.savedir_wd && (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))){
+				// the directory is gone and with it all uncommitted changes
+				_cache.savedir_wd = -1; 
+				_cache_drop_all(); 
+				continue; 
+			}
+			if(!ev->len) continue; 
+			struct juci_uci_config *conf = avl_find_element(&_cache.configs, ev->name, conf, avl); 
+			if(conf) _cache_drop(conf); 
+		}
+	}
+	_watch_savedir(); 
+}
+
+struct blob_field *juci_uci_get_config(const char *config){
 	struct uci_package *p = NULL; 
-	struct uci_ptr ptr = { .package = config }; 
-	struct uci_context *uci = uci_alloc_context(); 
-	assert(uci); 
-	
-	uci_load(uci, ptr.package, &p); 
-	
-	if(!p) return -EACCES; 
-	
-	_uci_config_to_blob(p, buf); 
-
-	uci_free_context(uci); 
+
+	if(!config || !*config || strchr(config, '/') || config[0] == '.') return NULL; 
+	_cache_update(); 
+	struct juci_uci_config *conf = avl_find_element(&_cache.configs, config, conf, avl); 
+	if(conf){
+		_cache.hits++; 
+		return (conf->exists)?blob_field_first_child(blob_head(&conf->data)):NULL; 
+	}
+	if(!_cache.ctx) return NULL; 
+
+	conf = calloc(1, sizeof(struct juci_uci_config) + strlen(config) + 1); 
+	if(!conf) return NULL; 
+	strcpy(conf->name, config); 
+	conf->avl.key = conf->name; 
+	blob_init(&conf->data, 0, 0); 
+	_cache.loads++; 
+	if(uci_load(_cache.ctx, config, &p) == 0 && p){
+		_uci_config_to_blob(p, &conf->data); 
+		uci_unload(_cache.ctx, p); 
+		conf->exists = true; 
+	}
+	// missing configs are remembered too since pages ask for optional ones
+	avl_insert(&_cache.configs, &conf->avl); 
+	return (conf->exists)?blob_field_first_child(blob_head(&conf->data)):NULL; 
+}
+
+int juci_uci_load_config(const char *config, struct blob *buf){
+	struct blob_field *data = juci_uci_get_config(config); 
+	if(!data) return -ENOENT; 
+	blob_put_attr(buf, data); 
 	return 0; 
 }
+
+void juci_uci_cache_stats(unsigned long *hits, unsigned long *loads){
+	*hits = _cache.hits; 
+	*loads = _cache.loads; 
+}
@@ -1,3 +1,14 @@
 #pragma once
 
+#include <blobpack/blobpack.h>
+
+/*
+ * Returns the table of sections (by name) of a config or NULL when there is
+ * no such config. The result comes from a cache that is kept up to date with
+ * inotify and stays valid until the next call. 
+ */
+struct blob_field *juci_uci_get_config(const char *config); 
+// copies the sections of a config into buf
 int juci_uci_load_config(const char *config, struct blob *buf); 
+// number of lookups answered from the cache and of configs that had to be parsed
+void juci_uci_cache_stats(unsigned long *hits, unsigned long *loads); 
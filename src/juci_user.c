@@ -22,11 +22,28 @@ struct juci_user *juci_user_new(const char *username){
 	self->username = strdup(username); 
 	self->avl.key = self->username; 
 	avl_init(&self->acls, avl_strcmp, false, NULL); 
+	self->refcount = 1; 
 	return self; 
 }
 
+struct juci_user *juci_user_ref(struct juci_user *self){
+	__atomic_add_fetch(&self->refcount, 1, __ATOMIC_RELAXED); 
+	return self; 
+}
+
+void juci_user_unref(struct juci_user **_self){
+	if(__atomic_sub_fetch(&(*_self)->refcount, 1, __ATOMIC_ACQ_REL) > 0){
+		*_self = NULL; 
+		return; 
+	}
+	juci_user_delete(_self); 
+}
+
 void juci_user_delete(struct juci_user **_self){
 	struct juci_user *self = *_self; 	
+	struct juci_user_acl *acl, *nacl; 
+	avl_remove_all_elements(&self->acls, acl, avl, nacl)
+		free(acl); 
 	if(self->pwhash) free(self->pwhash); 
 	free(self->username); 
 	free(self); 
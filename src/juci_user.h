@@ -11,10 +11,15 @@ struct juci_user {
 	char *username; 
 	char *pwhash; 
 	struct avl_tree acls; 
+	// held by the user table and by every session of the user
+	int refcount; 
 }; 
 
 struct juci_user *juci_user_new(const char *username); 
 void juci_user_delete(struct juci_user **self); 
+struct juci_user *juci_user_ref(struct juci_user *self); 
+// drops a reference and deletes the user when it was the last one
+void juci_user_unref(struct juci_user **self); 
 
 void juci_user_add_acl(struct juci_user *self, const char *acl); 
 void juci_user_set_pw_hash(struct juci_user *self, const char *pwhash); 
@@ -15,9 +15,9 @@
 	GNU General Public License for more details.
 */
 
+#define _GNU_SOURCE
 #include <blobpack/blobpack.h>
 
-#define _GNU_SOURCE
 #include "juci_ws_server.h"
 
 #include "mimetypes.h"
@@ -37,14 +37,14 @@
 #include <poll.h>
 
 #include "juci.h"
-#include "juci_id.h"
+#include "juci_peer_table.h"
 #include "internal.h"
 
 struct lws_context; 
 struct ubus_srv_ws {
 	struct lws_context *ctx; 
 	struct lws_protocols *protocols; 
-	struct avl_tree clients; 
+	struct juci_peer_table clients; 
 	//struct blob buf; 
 	const struct ubus_server_api *api; 
 	bool shutdown; 
@@ -54,10 +54,13 @@ struct ubus_srv_ws {
 	struct list_head rx_queue; 
 	const char *www_root; 
 	void *user_data; 
+	// we accept connections ourselves so that the socket can be handed over
+	int listen_fd; 
 }; 
 
 struct ubus_srv_ws_client {
-	struct ubus_id id; 
+	uint64_t id; 
+	uint8_t nonce[JUCI_PEER_NONCE_SIZE]; 
 	struct list_head tx_queue; 
 	struct ubus_message *msg; // incoming message
 	struct lws *wsi; 
@@ -97,6 +100,14 @@ void ubus_srv_ws_frame_delete(struct ubus_srv_ws_frame **self){
 }
 
 
+static int _read_random(void *buf, size_t size){
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC); 
+	if(fd < 0) return -errno; 
+	ssize_t ret = read(fd, buf, size); 
+	close(fd); 
+	return (ret == size)?0:-EIO; 
+}
+
 static struct ubus_srv_ws_client *ubus_srv_ws_client_new(){
 	struct ubus_srv_ws_client *self = calloc(1, sizeof(struct ubus_srv_ws_client)); 
 	assert(self); 
@@ -132,11 +143,22 @@ static int _ubus_socket_callback(struct lws *wsi, enum lws_callback_reasons reas
 			struct ubus_srv_ws *self = (struct ubus_srv_ws*)proto->user; 
 			pthread_mutex_lock(&self->qlock); 
 			struct ubus_srv_ws_client *client = ubus_srv_ws_client_new(lws_get_socket_fd(wsi)); 
-			ubus_id_alloc(&self->clients, &client->id, 0); 
+			if(_read_random(client->nonce, sizeof(client->nonce)) < 0){
+				ERROR("websocket: could not read random data for the login challenge\n"); 
+				ubus_srv_ws_client_delete(&client); 
+				pthread_mutex_unlock(&self->qlock); 
+				return -1; 
+			}
+			if(juci_peer_table_alloc(&self->clients, client, &client->id) < 0){
+				ERROR("websocket: too many clients\n"); 
+				ubus_srv_ws_client_delete(&client); 
+				pthread_mutex_unlock(&self->qlock); 
+				return -1; 
+			}
 			*user = client; 
 			char hostname[255], ipaddr[255]; 
 			lws_get_peer_addresses(wsi, peer_id, hostname, sizeof(hostname), ipaddr, sizeof(ipaddr)); 
-			DEBUG("connection established! %s %s %d %08x\n", hostname, ipaddr, peer_id, client->id.id); 
+			DEBUG("connection established! %s %s %d %016" PRIx64 "\n", hostname, ipaddr, peer_id, client->id); 
 			//if(self->on_message) self->on_message(&self->api, (*user)->id.id, UBUS_MSG_PEER_CONNECTED, 0, NULL); 
 			client->wsi = wsi; 
 			pthread_mutex_unlock(&self->qlock); 
@@ -148,10 +170,11 @@ static int _ubus_socket_callback(struct lws *wsi, enum lws_callback_reasons reas
 			break; 
 		case LWS_CALLBACK_CLOSED: {
 			DEBUG("websocket: client disconnected %p %p\n", _user, *user); 
+			if(!*user) break; 
 			struct ubus_srv_ws *self = (struct ubus_srv_ws*)proto->user; 
 			pthread_mutex_lock(&self->qlock); 
 			//if(self->on_message) self->on_message(&self->api, (*user)->id.id, UBUS_MSG_PEER_DISCONNECTED, 0, NULL); 
-			ubus_id_free(&self->clients, &(*user)->id); 
+			juci_peer_table_release(&self->clients, (*user)->id); 
 			ubus_srv_ws_client_delete(user); 	
 			pthread_mutex_unlock(&self->qlock); 
 			*user = 0; 
@@ -224,7 +247,8 @@ static int _ubus_socket_callback(struct lws *wsi, enum lws_callback_reasons reas
 					break; 
 				}
 				// place the message on the queue
-				(*user)->msg->peer = (*user)->id.id; 
+				(*user)->msg->peer = (*user)->id; 
+				memcpy((*user)->msg->nonce, (*user)->nonce, sizeof((*user)->nonce)); 
 				pthread_mutex_lock(&self->qlock); 
 				list_add_tail(&(*user)->msg->list, &self->rx_queue); 
 				(*user)->msg = ubus_message_new(); 
@@ -284,13 +308,14 @@ void _websocket_destroy(juci_server_t socket){
 	pthread_cond_destroy(&self->rx_ready); 
 
 	if(self->ctx) lws_context_destroy(self->ctx); 
+	if(self->listen_fd >= 0) close(self->listen_fd); 
 
-	struct ubus_id *id, *tmp; 
-	avl_for_each_element_safe(&self->clients, id, avl, tmp){
-		struct ubus_srv_ws_client *client = container_of(id, struct ubus_srv_ws_client, id);  
-		ubus_id_free(&self->clients, &client->id); 
+	struct ubus_srv_ws_client *client; 
+	uint32_t slot; 
+	juci_peer_table_for_each(&self->clients, slot, client){
 		ubus_srv_ws_client_delete(&client); 
 	}
+	juci_peer_table_free(&self->clients); 
 	
 	struct ubus_message *msg, *nmsg; 
 	list_for_each_entry_safe(msg, nmsg, &self->rx_queue, list){
@@ -302,19 +327,11 @@ void _websocket_destroy(juci_server_t socket){
 	free(self);  
 }
 
-int _websocket_listen(juci_server_t socket, const char *path){
-	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
+static int _websocket_create_context(struct ubus_srv_ws *self){
 	struct lws_context_creation_info info; 
 	memset(&info, 0, sizeof(info)); 
 
-	char proto[NAME_MAX], host[NAME_MAX], file[NAME_MAX]; 
-	int port = 5303; 
-	if(!url_scanf(path, proto, host, &port, file)){
-		fprintf(stderr, "Could not parse url: %s\n", path); 
-		return -1; 
-	}
-
-	info.port = port;
+	info.port = CONTEXT_PORT_NO_LISTEN;
 	info.gid = -1; 
 	info.uid = -1; 
 	info.user = self; 
@@ -323,10 +340,61 @@ int _websocket_listen(juci_server_t socket, const char *path){
 	info.options = LWS_SERVER_OPTION_VALIDATE_UTF8;
 
 	self->ctx = lws_create_context(&info); 
-
+	if(!self->ctx) return -1; 
 	return 0; 
 }
 
+int _websocket_listen(juci_server_t socket, const char *path){
+	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
+
+	char proto[NAME_MAX], host[NAME_MAX], file[NAME_MAX], port_str[16]; 
+	int port = 5303; 
+	if(!url_scanf(path, proto, host, &port, file)){
+		fprintf(stderr, "Could not parse url: %s\n", path); 
+		return -1; 
+	}
+	snprintf(port_str, sizeof(port_str), "%d", port); 
+
+	// listen on all interfaces like lws does when no interface is given
+	int fd = usock(USOCK_TCP | USOCK_SERVER | USOCK_NONBLOCK, NULL, port_str); 
+	if(fd < 0){
+		ERROR("could not listen on port %d\n", port); 
+		return -1; 
+	}
+	self->listen_fd = fd; 
+
+	return _websocket_create_context(self); 
+}
+
+static int _websocket_adopt_listener(juci_server_t socket, int fd, const char *path){
+	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK); 
+	fcntl(fd, F_SETFD, FD_CLOEXEC); 
+	self->listen_fd = fd; 
+	return _websocket_create_context(self); 
+}
+
+static int _websocket_listener_fd(juci_server_t socket){
+	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
+	return self->listen_fd; 
+}
+
+static void _websocket_close_listener(juci_server_t socket){
+	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
+	pthread_mutex_lock(&self->qlock); 
+	if(self->listen_fd >= 0) close(self->listen_fd); 
+	self->listen_fd = -1; 
+	pthread_mutex_unlock(&self->qlock); 
+}
+
+static int _websocket_num_clients(juci_server_t socket){
+	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
+	pthread_mutex_lock(&self->qlock); 
+	int count = juci_peer_table_count(&self->clients); 
+	pthread_mutex_unlock(&self->qlock); 
+	return count; 
+}
+
 static int _websocket_connect(juci_server_t socket, const char *path){
 	//struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
 	return -1; 
@@ -336,6 +404,16 @@ static void *_websocket_server_thread(void *ptr){
 	struct ubus_srv_ws *self = (struct ubus_srv_ws*)ptr; 
 	while(!self->shutdown){
 		if(!self->ctx) { sleep(1); continue;} 
+		pthread_mutex_lock(&self->qlock); 
+		while(self->listen_fd >= 0){
+			// CLOEXEC must be set by accept itself since a hot restart may exec from the main thread at any time
+			int fd = accept4(self->listen_fd, NULL, NULL, SOCK_CLOEXEC); 
+			if(fd < 0) break; 
+			pthread_mutex_unlock(&self->qlock); 
+			if(!lws_adopt_socket(self->ctx, fd)) close(fd); 
+			pthread_mutex_lock(&self->qlock); 
+		}
+		pthread_mutex_unlock(&self->qlock); 
 		lws_service(self->ctx, 10);	
 	}
 	pthread_exit(0); 
@@ -345,13 +423,13 @@ static void *_websocket_server_thread(void *ptr){
 static int _websocket_send(juci_server_t socket, struct ubus_message **msg){
 	struct ubus_srv_ws *self = container_of(socket, struct ubus_srv_ws, api); 
 	pthread_mutex_lock(&self->qlock); 
-	struct ubus_id *id = ubus_id_find(&self->clients, (*msg)->peer); 
-	if(!id) {
+	// ids of peers that have disconnected in the meantime are not found
+	struct ubus_srv_ws_client *client = juci_peer_table_find(&self->clients, (*msg)->peer); 
+	if(!client) {
 		pthread_mutex_unlock(&self->qlock); 
 		return -1; 
 	}
 	
-	struct ubus_srv_ws_client *client = (struct ubus_srv_ws_client*)container_of(id, struct ubus_srv_ws_client, id);  
 	struct ubus_srv_ws_frame *frame = ubus_srv_ws_frame_new(blob_head(&(*msg)->buf)); 
 	list_add_tail(&frame->list, &client->tx_queue); 	
 	pthread_mutex_unlock(&self->qlock); 
@@ -418,6 +496,7 @@ juci_server_t juci_ws_server_new(const char *www_root){
 	struct ubus_srv_ws *self = calloc(1, sizeof(struct ubus_srv_ws)); 
 	assert(self); 
 	self->www_root = (www_root)?www_root:"/www/"; 
+	self->listen_fd = -1; 
 	self->protocols = calloc(2, sizeof(struct lws_protocols)); 
 	assert(self->protocols); 
 	self->protocols[0] = (struct lws_protocols){
@@ -426,7 +505,7 @@ juci_server_t juci_ws_server_new(const char *www_root){
 		.per_session_data_size = sizeof(struct ubus_srv_ws_client*),
 		.user = self
 	};
-	ubus_id_tree_init(&self->clients); 
+	juci_peer_table_init(&self->clients); 
 	pthread_mutex_init(&self->qlock, NULL); 
 	pthread_cond_init(&self->rx_ready, NULL); 
 	INIT_LIST_HEAD(&self->rx_queue); 
@@ -436,7 +515,11 @@ juci_server_t juci_ws_server_new(const char *www_root){
 		.connect = _websocket_connect, 
 		.send = _websocket_send, 
 		.recv = _websocket_recv, 
-		.userdata = _websocket_userdata
+		.userdata = _websocket_userdata, 
+		.adopt_listener = _websocket_adopt_listener, 
+		.listener_fd = _websocket_listener_fd, 
+		.close_listener = _websocket_close_listener, 
+		.num_clients = _websocket_num_clients
 	}; 
 	self->api = &api; 
 	pthread_create(&self->thread, NULL, _websocket_server_thread, self); 
@@ -25,20 +25,86 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include <libutype/avl-cmp.h>
 
 #include "juci.h"
 #include "juci_luaobject.h"
 #include "juci_ws_server.h"
+#include "juci_handoff.h"
+
+// time the garbage collector may run each time the loop goes idle
+#define JUCI_IDLE_GC_BUDGET_US 2000
+// how long a replaced instance keeps serving its connections after a hot restart
+#define JUCI_DRAIN_TIMEOUT_S 300
 
 bool running = true; 
+volatile sig_atomic_t restart_requested = 0; 
 
 void handle_sigint(){
 	DEBUG("Interrupted!\n"); 
 	running = false; 
 }
 
+void handle_sigusr2(){
+	restart_requested = 1; 
+}
+
+// state file of a hot restart while the new instance is starting up
+static int handoff_state_fd = -1; 
+
+/*
+ * Starts a new instance of the server and hands it our listening socket.
+ * We keep serving while it loads its plugins (see _hot_restart_poll). 
+ */
+static int _hot_restart(char **argv, juci_server_t server){
+	int listen_fd = ubus_server_listener_fd(server); 
+	if(listen_fd < 0) return -EINVAL; 
+	int state_fd = juci_handoff_state_fd(); 
+	if(state_fd < 0) return state_fd; 
+	int ret = juci_handoff_start(argv, listen_fd, state_fd); 
+	if(ret < 0){
+		close(state_fd); 
+		return ret; 
+	}
+	handoff_state_fd = state_fd; 
+	return 0; 
+}
+
+/*
+ * Hands our sessions to the new instance once it is ready. After that we
+ * stop accepting connections and only serve the ones that are already open.
+ * Returns 1 when done and 0 while the new instance is still starting up. 
+ */
+static int _hot_restart_poll(juci_server_t server, struct juci *app){
+	int ret = juci_handoff_poll(); 
+	if(ret == 0) return 0; 
+	if(ret > 0){
+		ret = juci_export_sessions(app, handoff_state_fd); 
+		if(ret == 0) ret = juci_handoff_finish(); 
+		else juci_handoff_abort(); 
+	}
+	close(handoff_state_fd); 
+	handoff_state_fd = -1; 
+	if(ret < 0) return ret; 
+	ubus_server_close_listener(server); 
+	juci_stop_session_snapshots(app); 
+	return 1; 
+}
+
+/*
+ * The challenge of a connection is the random nonce the server gave it when
+ * it connected, so a response that was seen on one connection is no good on
+ * any other. 
+ */
+static void _challenge_token(const struct ubus_message *msg, char *token, size_t size){
+	token[0] = 0; 
+	for(int c = 0; c < JUCI_PEER_NONCE_SIZE && (c << 1) + 2 < size; c++)
+		snprintf(token + (c << 1), 3, "%02x", msg->nonce[c]); 
+}
+
 static bool rpcmsg_parse_call(struct blob *msg, uint32_t *id, const char **method, struct blob_field **params){
 	if(!msg) return false; 
 	struct blob_policy policy[] = {
@@ -104,17 +170,43 @@ static bool rpcmsg_parse_login(struct blob_field *params, const char **username,
 	return !!(username && response); 
 }
 
+static bool rpcmsg_parse_subscribe(struct blob_field *params, const char **sid, const char **topic){
+	if(!params) return false; 
+	struct blob_policy policy[] = {
+		{ .type = BLOB_FIELD_STRING }, // sid
+		{ .type = BLOB_FIELD_STRING } // topic
+	}; 
+	if(!blob_field_parse_values(params, policy, 2)) return false;  
+	*sid = blob_field_get_string(policy[0].value); 
+	*topic = blob_field_get_string(policy[1].value); 
+	return !!(sid && topic); 
+}
+
+// queues an event for a peer. Fails once the peer has disconnected. 
+static int _send_event(uint64_t peer, struct blob *msg, void *arg){
+	juci_server_t server = arg; 
+	struct ubus_message *ev = ubus_message_new(); 
+	ev->peer = peer; 
+	blob_put_attr(&ev->buf, blob_field_first_child(blob_head(msg))); 
+	if(ubus_server_send(server, &ev) < 0){
+		ubus_message_delete(&ev); 
+		return -ENOTCONN; 
+	}
+	return 0; 
+}
+
 int main(int argc, char **argv){
   	const char *www_root = "/www"; 
 	const char *listen_socket = "ws://localhost:1234"; 
 	const char *plugin_dir = "plugins"; 
 	const char *pw_file = "/etc/juci-shadow"; 
+	int flags = 0; 
 	
 	printf("RevoRPCD v%s\n",VERSION); 
 	printf("Copyright (c) 2016 Martin Schröder\n"); 
 
 	int c = 0; 	
-	while((c = getopt(argc, argv, "d:l:p:vx:")) != -1){
+	while((c = getopt(argc, argv, "d:l:p:svx:")) != -1){
 		switch(c){
 			case 'd': 
 				www_root = optarg; 
@@ -125,6 +217,9 @@ int main(int argc, char **argv){
 			case 'p': 
 				plugin_dir = optarg; 
 				break; 
+			case 's': 
+				flags |= JUCI_FLAG_SHARED_LUA; 
+				break; 
 			case 'v': 
 				juci_debug_level++; 
 				break; 
@@ -137,14 +232,32 @@ int main(int argc, char **argv){
 	
     juci_server_t server = juci_ws_server_new(www_root); 
 
-    if(ubus_server_listen(server, listen_socket) < 0){
+	// when started by a running instance take over its socket instead of binding a new one
+	int handoff_listen = -1, handoff_state = -1; 
+	if(juci_handoff_receive(&handoff_listen, &handoff_state) == 0){
+		if(ubus_server_adopt_listener(server, handoff_listen, listen_socket) < 0){
+			fprintf(stderr, "server could not take over listening socket!\n"); 
+			return -1; 
+		}
+	} else if(ubus_server_listen(server, listen_socket) < 0){
         fprintf(stderr, "server could not listen on specified socket!\n"); 
         return -1;                       
     }
 
 	signal(SIGINT, handle_sigint); 
+	signal(SIGUSR2, handle_sigusr2); 
 
-	struct juci *app = juci_new(plugin_dir, pw_file); 
+	struct juci *app = juci_new(plugin_dir, pw_file, flags); 
+	juci_set_event_sender(app, _send_event, server); 
+
+	if(handoff_state >= 0){
+		// the old instance writes its sessions once we are ready to serve
+		if(juci_handoff_ready() == 0) juci_import_sessions(app, handoff_state); 
+		close(handoff_state); 
+	}
+
+	bool draining = false; 
+	time_t drain_deadline = 0; 
 
 	struct blob buf, out; 
 	blob_init(&buf, 0, 0); 
@@ -154,15 +267,38 @@ int main(int argc, char **argv){
         struct ubus_message *msg = NULL;         
 		struct timespec tss, tse; 
 		clock_gettime(CLOCK_MONOTONIC, &tss); 
+		juci_tick(app); 
+
+		if(restart_requested && !draining && handoff_state_fd < 0){
+			restart_requested = 0; 
+			if(_hot_restart(argv, server) < 0) ERROR("hot restart failed, continuing to serve\n"); 
+		}
+		if(handoff_state_fd >= 0){
+			int ret = _hot_restart_poll(server, app); 
+			if(ret > 0){
+				INFO("handed over to new instance, draining connections\n"); 
+				draining = true; 
+				drain_deadline = tss.tv_sec + JUCI_DRAIN_TIMEOUT_S; 
+			} else if(ret < 0){
+				ERROR("hot restart failed, continuing to serve\n"); 
+			}
+		}
+		if(draining && (ubus_server_num_clients(server) == 0 || tss.tv_sec >= drain_deadline)){
+			running = false; 
+			continue; 
+		}
 		
 		// 10ms delay 
         if(ubus_server_recv(server, &msg, 10000UL) < 0 || !msg){  
+			// nothing to do so collect some garbage
+			juci_idle(app, JUCI_IDLE_GC_BUDGET_US); 
+			juci_quiescent(app); 
             continue;                   
         }
 		clock_gettime(CLOCK_MONOTONIC, &tse); 
 		TRACE("waited %lus %luns for message\n", tse.tv_sec - tss.tv_sec, tse.tv_nsec - tss.tv_nsec); 
         if(juci_debug_level >= JUCI_DBG_DEBUG){
-			DEBUG("got message from %08x: ", msg->peer); 
+			DEBUG("got message from %016" PRIx64 ": ", msg->peer); 
         	blob_dump_json(&msg->buf);
 		}
 		struct blob_field *params = NULL, *args = NULL; 
@@ -191,6 +327,10 @@ int main(int argc, char **argv){
 					if(!str) str = "UNKNOWN"; 
 					blob_put_string(&result->buf, "error"); 
 					blob_put_string(&result->buf, str);  
+					if(ret == -EAGAIN && app->retry_after){
+						blob_put_string(&result->buf, "retry_after"); 
+						blob_put_int(&result->buf, app->retry_after); 
+					}
 				}
 			} else {
 				DEBUG("Could not parse call params!\n"); 
@@ -205,23 +345,29 @@ int main(int argc, char **argv){
 			blob_put_string(&result->buf, "result"); 
 			blob_offset_t o = blob_open_table(&result->buf); 
 			blob_put_string(&result->buf, "token"); 
-			char token[32]; 
-			snprintf(token, sizeof(token), "%08x", msg->peer); //TODO: make hash
+			char token[JUCI_PEER_NONCE_SIZE * 2 + 1]; 
+			_challenge_token(msg, token, sizeof(token)); 
 			blob_put_string(&result->buf, token);  
 			blob_close_table(&result->buf, o); 
 		} else if(rpc_method && strcmp(rpc_method, "login") == 0){
 			// TODO: make challenge response work. Perhaps use custom pw database where only sha1 hasing is used. 
 			const char *username = NULL, *response = NULL, *sid = ""; 
 
-			char token[32]; 
-			snprintf(token, sizeof(token), "%08x", msg->peer); //TODO: make hash
+			char token[JUCI_PEER_NONCE_SIZE * 2 + 1]; 
+			_challenge_token(msg, token, sizeof(token)); 
 
 			if(rpcmsg_parse_login(params, &username, &response)){
 				blob_put_string(&result->buf, "result"); 
 				blob_offset_t o = blob_open_table(&result->buf); 
-				if(juci_login(app, username, token, response, &sid) == 0){
+				int ret = juci_login(app, username, token, response, &sid); 
+				if(ret == 0){
 					blob_put_string(&result->buf, "success"); 
 					blob_put_string(&result->buf, sid); 
+				} else if(ret == -EAGAIN){
+					blob_put_string(&result->buf, "error"); 
+					blob_put_string(&result->buf, "EAGAIN"); 
+					blob_put_string(&result->buf, "retry_after"); 
+					blob_put_int(&result->buf, app->retry_after); 
 				} else {
 					blob_put_string(&result->buf, "error"); 
 					blob_put_string(&result->buf, "EACCESS"); 
@@ -232,6 +378,25 @@ int main(int argc, char **argv){
 				blob_put_string(&result->buf, "Invalid Parameters"); 
 				DEBUG("Could not parse login parameters!\n"); 
 			}
+		} else if(rpc_method && strcmp(rpc_method, "login_batch") == 0){
+			// params is a list of [username, response] pairs answering the same challenge
+			char token[JUCI_PEER_NONCE_SIZE * 2 + 1]; 
+			_challenge_token(msg, token, sizeof(token)); 
+
+			if(params && blob_field_type(params) == BLOB_FIELD_ARRAY){
+				blob_reset(&out); 
+				int ret = juci_login_batch(app, token, params, &out); 
+				if(ret >= 0){
+					blob_put_string(&result->buf, "result"); 
+					blob_put_attr(&result->buf, blob_field_first_child(blob_head(&out))); 
+				} else {
+					blob_put_string(&result->buf, "error"); 
+					blob_put_string(&result->buf, strerror(-ret)); 
+				}
+			} else {
+				blob_put_string(&result->buf, "error"); 
+				blob_put_string(&result->buf, "Invalid Parameters"); 
+			}
 		} else if(rpc_method && strcmp(rpc_method, "logout") == 0){
 			const char *sid = NULL; 
 			if(rpcmsg_parse_authenticate(params, &sid) && juci_logout(app, sid) == 0){
@@ -244,6 +409,49 @@ int main(int argc, char **argv){
 				blob_put_string(&result->buf, "error"); 
 				blob_put_string(&result->buf, "Could not logout!"); 
 			}
+		} else if(rpc_method && strcmp(rpc_method, "stats") == 0){
+			const char *sid = NULL; 
+			if(rpcmsg_parse_authenticate(params, &sid) && juci_find_session(app, sid)){
+				blob_put_string(&result->buf, "result"); 
+				juci_stats(app, &result->buf); 
+			} else {
+				blob_put_string(&result->buf, "error"); 
+				blob_put_string(&result->buf, "Access Denied"); 
+			}
+		} else if(rpc_method && strcmp(rpc_method, "subscribe") == 0){
+			const char *sid = NULL, *topic = NULL; 
+			if(rpcmsg_parse_subscribe(params, &sid, &topic)){
+				blob_reset(&out); 
+				int ret = juci_subscribe(app, sid, msg->peer, topic, &out); 
+				if(ret == 0){
+					blob_put_string(&result->buf, "result"); 
+					blob_put_attr(&result->buf, blob_field_first_child(blob_head(&out))); 
+				} else {
+					blob_put_string(&result->buf, "error"); 
+					blob_put_string(&result->buf, (ret == -EACCES)?"Access Denied":strerror(-ret)); 
+				}
+			} else {
+				blob_put_string(&result->buf, "error"); 
+				blob_put_string(&result->buf, "Invalid Parameters"); 
+			}
+		} else if(rpc_method && strcmp(rpc_method, "unsubscribe") == 0){
+			const char *sid = NULL, *topic = NULL; 
+			// without a topic all subscriptions of the connection are removed
+			if(rpcmsg_parse_subscribe(params, &sid, &topic) || rpcmsg_parse_authenticate(params, &sid)){
+				if(juci_unsubscribe(app, sid, msg->peer, topic) == 0){
+					blob_put_string(&result->buf, "result"); 
+					blob_offset_t o = blob_open_table(&result->buf); 
+						blob_put_string(&result->buf, "success"); 
+						blob_put_string(&result->buf, "VALID"); 
+					blob_close_table(&result->buf, o); 
+				} else {
+					blob_put_string(&result->buf, "error"); 
+					blob_put_string(&result->buf, "Not Subscribed"); 
+				}
+			} else {
+				blob_put_string(&result->buf, "error"); 
+				blob_put_string(&result->buf, "Invalid Parameters"); 
+			}
 		} else if(rpc_method && strcmp(rpc_method, "authenticate") == 0){
 			const char *sid = NULL; 
 			struct juci_session *session = NULL; 
@@ -271,6 +479,7 @@ int main(int argc, char **argv){
 		}
 		ubus_server_send(server, &result); 		
 		ubus_message_delete(&msg); 
+		juci_quiescent(app); 
     }
 
 	DEBUG("cleaning up\n"); 